@@ -17,6 +17,7 @@
  */
 
 #include <errno.h>
+#include <linux/falloc.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -64,7 +65,32 @@ static bool a1fs_init(fs_ctx *fs, a1fs_opts *opts)
 	void *image = map_file(opts->img_path, A1FS_BLOCK_SIZE, &size);
 	if (!image) return false;
 
-	return fs_ctx_init(fs, image, size);
+	// a thin image is mapped to its full size for the file to grow into
+	int fd = -1;
+	size_t file_size = size;
+	const a1fs_superblock *sb = image;
+	if (sb->magic == A1FS_MAGIC && (sb->features & A1FS_FEATURE_THIN) && sb->size > size) {
+		size_t full = sb->size;
+		munmap(image, size);
+		image = map_file_growable(opts->img_path, A1FS_BLOCK_SIZE, full, &file_size, &fd);
+		if (!image) return false;
+		size = full;
+	}
+
+	if (!fs_ctx_init(fs, image, size)) return false;
+	if (fd >= 0) set_image_file(fs, fd, file_size);
+	fs->alloc_policy = opts->best_fit ? ALLOC_BEST_FIT : ALLOC_NEXT_FIT;
+	fs->delayed_alloc = opts->delalloc;
+	if (opts->noprealloc) {
+		fs->prealloc_min = 0;
+	} else {
+		if (opts->prealloc_min != 0) fs->prealloc_min = opts->prealloc_min;
+		if (opts->prealloc_max != 0) fs->prealloc_max = opts->prealloc_max;
+		if (fs->prealloc_max < fs->prealloc_min) fs->prealloc_max = fs->prealloc_min;
+	}
+	fs->discard = opts->discard;
+	if (opts->discard_batch != 0) fs->discard_batch = opts->discard_batch;
+	return true;
 }
 
 /**
@@ -77,6 +103,13 @@ static void a1fs_destroy(void *ctx)
 {
 	fs_ctx *fs = (fs_ctx*)ctx;
 	if (fs->image) {
+		// nothing can report an error anymore, so whatever can't be placed
+		// is lost
+		if (flush_all_delalloc(fs) != 0) {
+			fprintf(stderr, "a1fs: no space for buffered data\n");
+		}
+		release_all_prealloc(fs);
+		flush_discards(fs);
 		munmap(fs->image, fs->size);
 		fs_ctx_destroy(fs);
 	}
@@ -88,6 +121,23 @@ static fs_ctx *get_fs(void)
 	return (fs_ctx*)fuse_get_context()->private_data;
 }
 
+/**
+ * Get the handle of a file opened by a1fs_open(), a1fs_create() or
+ * a1fs_opendir(). If there is none (e.g. truncate() of a path), look the path
+ * up and fill in tmp instead.
+ */
+static a1fs_handle *get_handle(fs_ctx *fs, const char *path, struct fuse_file_info *fi,
+                               a1fs_handle *tmp)
+{
+	a1fs_handle *handle = fi == NULL ? NULL : handle_get(&fs->handles, fi->fh);
+	if (handle == NULL) {
+		handle = tmp;
+		handle->ino = (a1fs_ino_t) path_lookup(fs, path);
+		handle->cursor.extent.count = 0;
+	}
+	return handle;
+}
+
 
 /**
  * Get file system statistics.
@@ -113,8 +163,11 @@ static int a1fs_statfs(const char *path, struct statvfs *st) {
 	st->f_frsize = A1FS_BLOCK_SIZE;
 
 	// ADDED: assign metadata based on information in the superblock
-	st->f_bfree = *(fs->available_blocks);
-	st->f_bavail = *(fs->available_blocks);
+	st->f_blocks = fs->num_of_data_blocks;
+	// blocks reserved for buffered data are as good as used, while the
+	// preallocated ones are given back when the others run out
+	st->f_bfree = get_unreserved_blocks(fs) + fs->prealloc.blocks;
+	st->f_bavail = get_unreserved_blocks(fs) + fs->prealloc.blocks;
 	st->f_files = fs->num_inodes;
 	st->f_ffree = *(fs->available_inodes);
 	st->f_favail = *(fs->available_inodes);
@@ -123,6 +176,29 @@ static int a1fs_statfs(const char *path, struct statvfs *st) {
 
 }
 
+/**
+ * Fill in the fields of st that a1fs_getattr() has to from an inode, and the
+ * inode number, which FUSE passes on with the use_ino option. Inode numbers
+ * are shifted by one since some readdir(3) users skip entries with d_ino 0.
+ */
+static void fill_stat(fs_ctx *fs, uint32_t inode_num, struct stat *st)
+{
+	a1fs_inode *inode = &fs->inode_table[inode_num];
+	st->st_ino = (ino_t) inode_num + 1;
+	st->st_mode = inode->mode;
+	st->st_nlink = (nlink_t) inode->links;
+	st->st_size = inode->size;
+	// in 512-byte units, the blocks actually taken and those that buffered
+	// data will take
+	blkcnt_t blocks = get_exact_num_blks_of_file(fs, inode);
+	delalloc_file *pending = delalloc_find(&fs->delalloc, inode_num);
+	if (pending != NULL) {
+		blocks += pending->count;
+	}
+	st->st_blocks = blocks * (A1FS_BLOCK_SIZE / 512);
+	st->st_mtim = inode->mtime;
+}
+
 /**
  * Get file or directory attributes.
  *
@@ -162,70 +238,124 @@ static int a1fs_getattr(const char *path, struct stat *st)
 	if (inode_num == -2) {
 		return -ENOTDIR;
 	}
-	a1fs_inode inode_entry = fs->inode_table[inode_num];
-	st->st_mode = inode_entry.mode;
-	st->st_nlink = (nlink_t) inode_entry.links;
-	st->st_size = inode_entry.size;
-	st->st_blocks = get_exact_num_blks_of_file(inode_entry);
-	st->st_mtim = inode_entry.mtime;
+	fill_stat(fs, (uint32_t) inode_num, st);
+	return 0;
+}
+
+/**
+ * Get attributes of an open file. See a1fs_getattr().
+ *
+ * @param path  path to the file or directory.
+ * @param st    pointer to the struct stat that receives the result.
+ * @param fi    handle from a1fs_open(), a1fs_create() or a1fs_opendir().
+ * @return      0 on success; -errno on error;
+ */
+static int a1fs_fgetattr(const char *path, struct stat *st, struct fuse_file_info *fi)
+{
+	fs_ctx *fs = get_fs();
+	a1fs_handle *handle = handle_get(&fs->handles, fi->fh);
+	if (handle == NULL) {
+		return a1fs_getattr(path, st);
+	}
 
+	memset(st, 0, sizeof(*st));
+	fill_stat(fs, handle->ino, st);
 	return 0;
 }
 
+/** Argument of readdir_entry(). */
+typedef struct readdir_arg {
+	fs_ctx *fs;
+	void *buf;
+	fuse_fill_dir_t filler;
+} readdir_arg;
+
+/**
+ * Offset passed to the filler for "." and "..". An entry gets the position to
+ * resume the iteration from after it, plus READDIR_DOTS.
+ */
+#define READDIR_DOTS 2
+
+/**
+ * iterate_dentries() callback that passes an entry and its attributes to the
+ * filler. The kernel gets the file type and inode number of each entry with
+ * it, so e.g. find -type doesn't have to stat every entry.
+ */
+static int readdir_entry(void *arg, a1fs_ino_t ino, const char *name, uint32_t slot, uint32_t next)
+{
+	(void)slot;// unused
+	readdir_arg *rd = (readdir_arg *) arg;
+	struct stat st;
+	memset(&st, 0, sizeof(st));
+	fill_stat(rd->fs, ino, &st);
+	return rd->filler(rd->buf, name, &st, (off_t) next + READDIR_DOTS);
+}
+
 /**
  * Read a directory.
  *
- * Implements the readdir() system call. Should call filler(buf, name, NULL, 0)
- * for each directory entry. See fuse.h in libfuse source code for details.
+ * Implements the readdir() system call. Calls filler(buf, name, st, off) for
+ * each directory entry from the given offset on, with the attributes of the
+ * entry in st, until the filler's buffer is full. See fuse.h in libfuse
+ * source code for details.
+ *
+ * The offset of an entry is its position in the directory (a slot, or a byte
+ * offset with A1FS_FEATURE_VARDIR). Entries never move, so the kernel can
+ * resume a listing from any offset it got, and a directory is streamed a
+ * buffer at a time instead of being read into memory whole.
  *
  * Assumptions (already verified by FUSE using getattr() calls):
  *   "path" exists and is a directory.
  *
- * Errors:
- *   ENOMEM  not enough memory (e.g. a filler() call failed).
+ * Errors: none
  *
  * @param path    path to the directory.
  * @param buf     buffer that receives the result.
  * @param filler  function that needs to be called for each directory entry.
- *                Pass 0 as offset (4th argument). 3rd argument can be NULL.
- * @param offset  unused.
- * @param fi      unused.
+ * @param offset  offset of the last entry returned before, or 0.
+ * @param fi      handle from a1fs_opendir().
  * @return        0 on success; -errno on error.
  */
 static int a1fs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
                         off_t offset, struct fuse_file_info *fi)
 {
-	(void)offset;// unused
-	(void)fi;// unused
 	fs_ctx *fs = get_fs();
 
 	// ADDED: lookup the directory inode for given path and iterate through its
 	// directory entries
-	int inode_num = path_lookup(fs, path);
-	filler(buf, "." , NULL, 0);
-	filler(buf, "..", NULL, 0);
-	a1fs_inode *itable = fs->inode_table;
-	uint32_t dir_count = 0;
-	for (uint32_t i = 0; i < itable[inode_num].extent_num; i++) {
-		a1fs_dentry *dir_entry_list = (a1fs_dentry *) (fs->data_block + ((a1fs_extent *) itable[inode_num].
-                indirect_pt)[i].start * A1FS_BLOCK_SIZE);
-        uint32_t num_dentries_in_extent = ((a1fs_extent *)itable[inode_num].indirect_pt)[i].count
-                * A1FS_BLOCK_SIZE / sizeof(a1fs_dentry);
-		for (uint32_t j = 0; j < num_dentries_in_extent; j++) {
-
-			if (filler(buf, dir_entry_list[j].name, NULL, 0) == 1) {
-			    return -ENOMEM;
-			}
-
-			dir_count++;
-
-			// no more directory entries left
-			if (dir_count >= itable[inode_num].num_dir_entry) {
-				goto END;
-			}
+	// the parent is not recorded in the directory, so it is found from the
+	// path (the root is its own parent), taken before get_handle() may
+	// tokenize the path in place
+	char parent_dir[A1FS_PATH_MAX] = {'\0'};
+	if (path != NULL && offset < READDIR_DOTS) {
+		extract_parent_path((char *) path, parent_dir);
+	}
+	a1fs_handle tmp;
+	uint32_t inode_num = get_handle(fs, path, fi, &tmp)->ino;
+	if (offset < 1) {
+		struct stat st;
+		memset(&st, 0, sizeof(st));
+		fill_stat(fs, inode_num, &st);
+		if (filler(buf, "." , &st, 1) != 0) {
+			return 0;
 		}
 	}
-    END:
+	if (offset < READDIR_DOTS) {
+		// with no path to go by, ".." gets the attributes of the directory
+		// itself, as some readdir(3) users skip entries without an inode number
+		int parent = parent_dir[0] != '\0' ? path_lookup(fs, parent_dir) : -1;
+		struct stat st;
+		memset(&st, 0, sizeof(st));
+		fill_stat(fs, parent >= 0 ? (uint32_t) parent : inode_num, &st);
+		if (filler(buf, "..", &st, READDIR_DOTS) != 0) {
+			return 0;
+		}
+	}
+
+	// iteration stops early once the buffer is full
+	readdir_arg rd = {fs, buf, filler};
+	uint32_t start = offset < READDIR_DOTS ? 0 : (uint32_t) (offset - READDIR_DOTS);
+	iterate_dentries(fs, inode_num, start, readdir_entry, &rd);
 	return 0;
 }
 
@@ -253,8 +383,6 @@ static int a1fs_mkdir(const char *path, mode_t mode) {
 	fs_ctx *fs = get_fs();
 
 	// ADDED: create a directory at given path with given mode
-	// my comment: when we create a directory entry, we always add to the end of
-	// the last existing extent if there's any space left
 
 	// create a new directory
 	a1fs_inode new_dir;
@@ -265,124 +393,40 @@ static int a1fs_mkdir(const char *path, mode_t mode) {
 		fprintf(stderr, "Set system time failed");
 	}
 	new_dir.extent_num = 0;
+	new_dir.extent_blocks = 0;
 	new_dir.num_dir_entry = 0;
-	if (*(fs->available_inodes) == 0 || *(fs->available_blocks) == 0) {
-        return -ENOSPC;
-    }
-	uint32_t new_inode = get_first_available_position(fs->num_inodes, fs->inode_bitmap);
-	set_bitmap(fs->inode_bitmap, new_inode);
-	*(fs->available_inodes) -= 1;
-	fs->inode_table[new_inode] = new_dir;
+	new_dir.dir_free_slot = 0;
+	new_dir.flags = 0;
 
 	// modify information in the parent directory
     char parent_dir[A1FS_PATH_MAX] = {'\0'};
     extract_parent_path((char *) path, parent_dir);
     int inode_num = path_lookup(fs, parent_dir); // inode num of the parent directory
 
+	// next to the parent, or in a group with room for a new tree
+	uint32_t new_inode;
+	if (!allocate_inode(fs, (uint32_t) inode_num, true, &new_inode)) {
+        return -ENOSPC;
+    }
 
-	if (clock_gettime(CLOCK_REALTIME, &(fs->inode_table[inode_num].mtime)) == -1) {
-		fprintf(stderr, "Set system time failed");
-	}
+	// the name is most likely cached as a negative entry by now
+	char child_name[A1FS_NAME_MAX] = {'\0'};
+	extract_child_path((char *) path, child_name);
+	dcache_invalidate(&fs->dcache, (a1fs_ino_t) inode_num, child_name);
 
 	// Add the new directory entry to the parent directory
-
-	// when the parent is empty;
-	if(fs->inode_table[inode_num].num_dir_entry == 0){ 
-		// have to firstly allocate extent for parent
-		if (*(fs->available_inodes) == 0 || *(fs->available_blocks) == 0) {
-        	return -ENOSPC;
-    	}
-		uint32_t new_single_indirect_block_num =
-				get_first_available_position(fs->num_of_data_blocks, fs->data_bitmap);
-		set_bitmap(fs->data_bitmap, new_single_indirect_block_num);
-		*(fs->available_blocks) -= 1;
-		uint64_t new_single_indirect_block_addr =
-				get_addr_of_block(fs, new_single_indirect_block_num);
-		fs->inode_table[inode_num].indirect_pt = new_single_indirect_block_addr;
-
-		// create new data block
-		if (*(fs->available_inodes) == 0 || *(fs->available_blocks) == 0) {
-        	return -ENOSPC;
-    	}
-		uint32_t new_data_block = get_first_available_position(fs->num_of_data_blocks, fs->data_bitmap);
-		set_bitmap(fs->data_bitmap, new_data_block);
-		*(fs->available_blocks) -= 1;
-		((a1fs_extent *)fs->inode_table[inode_num].indirect_pt)[0].start = new_data_block;
-		((a1fs_extent *)fs->inode_table[inode_num].indirect_pt)[0].count = 1;
-		a1fs_dentry* new_data_block_addr = (a1fs_dentry*)get_addr_of_block(fs, new_data_block);
-		
-
-		//create new entry 
-		a1fs_dentry new_entry;
-		new_entry.ino = (a1fs_ino_t)new_inode;
-		extract_child_path((char*)path, new_entry.name);
-		new_data_block_addr[0] = new_entry; 
-
-		// update parent's info
-		fs->inode_table[inode_num].size += sizeof(a1fs_dentry);
-		fs->inode_table[inode_num].links++;
-		fs->inode_table[inode_num].num_dir_entry++;
-		fs->inode_table[inode_num].extent_num++;
-		return 0;
-	}
-
-	// the parent is not empty when reach here.
-	uint32_t last_block = find_last_block(fs,inode_num); // last block's number
-	if(fs->inode_table[inode_num].size % A1FS_BLOCK_SIZE != 0){
-		// if the parents' last block is not full
-		uint64_t num_of_entry_in_last_block = (fs->inode_table[inode_num].num_dir_entry) % (A1FS_BLOCK_SIZE / sizeof(a1fs_dentry));// number of entry in last block
-
-		a1fs_dentry new_entry;
-		new_entry.ino = (a1fs_ino_t)new_inode;
-		extract_child_path((char*)path, new_entry.name);
-		a1fs_dentry* last_block_addr = (a1fs_dentry*)get_addr_of_block(fs, last_block);
-		last_block_addr[num_of_entry_in_last_block] = new_entry;
-	}else{
-		// if the parents' last block is full
-		if(is_bit_set(last_block + 1, fs->data_bitmap) == 0){ // the next block is free
-			uint32_t new_block_num = last_block + 1; // new block's number
-			set_bitmap(fs->data_bitmap, new_block_num);
-			*(fs->available_blocks) -= 1;
-			a1fs_dentry* new_block_addr = (a1fs_dentry*)get_addr_of_block(fs, new_block_num); // new block's address
-			a1fs_dentry new_entry;
-			new_entry.ino = (a1fs_ino_t)new_inode;
-			extract_child_path((char*)path, new_entry.name);
-			new_block_addr[0] = new_entry;
-
-			((a1fs_extent *)fs->inode_table[inode_num].indirect_pt)[fs->inode_table[inode_num].extent_num - 1].count++;
-		}else{ // the next block is not free
-
-			// create new block
-			if (*(fs->available_inodes) == 0 || *(fs->available_blocks) == 0) {
-        		return -ENOSPC;
-    		}
-			uint32_t new_data_block_num = (uint32_t)get_first_available_position(fs->num_of_data_blocks, fs->data_bitmap);
-			set_bitmap(fs->data_bitmap, new_data_block_num);
-			*(fs->available_blocks) -= 1;
-
-			// create new extent
-			((a1fs_extent *)fs->inode_table[inode_num].indirect_pt)[fs->inode_table[inode_num].extent_num].start = new_data_block_num;
-			((a1fs_extent *)fs->inode_table[inode_num].indirect_pt)[fs->inode_table[inode_num].extent_num].count = 1;
-
-			// create entry
-			a1fs_dentry new_entry;
-			new_entry.ino = (a1fs_ino_t)new_inode;
-			extract_child_path((char*)path, new_entry.name);
-
-			a1fs_dentry* new_data_block_addr = (a1fs_dentry*)get_addr_of_block(fs, new_data_block_num);
-			new_data_block_addr[0] = new_entry;
-			
-
-			fs->inode_table[inode_num].extent_num++;
-		}
+	int ret = add_dentry(fs, (uint32_t) inode_num, child_name, (a1fs_ino_t) new_inode);
+	if (ret != 0) {
+		free_inode(fs, new_inode, true);
+		return ret;
 	}
+	fs->inode_table[new_inode] = new_dir;
 
 	// update parent's info
-	fs->inode_table[inode_num].size += sizeof(a1fs_dentry);
 	fs->inode_table[inode_num].links++;
-	fs->inode_table[inode_num].num_dir_entry++;
-	
-
+	if (clock_gettime(CLOCK_REALTIME, &(fs->inode_table[inode_num].mtime)) == -1) {
+		fprintf(stderr, "Set system time failed");
+	}
 	return 0;
 }
 
@@ -409,132 +453,32 @@ static int a1fs_rmdir(const char *path)
 	char parent_dir[A1FS_PATH_MAX] = {'\0'};
     extract_parent_path((char *) path, parent_dir);
     uint32_t parent_inode_num = (uint32_t)path_lookup(fs, parent_dir);
-	
-	// firstly change the modification time of the parent dirctory
-	if (clock_gettime(CLOCK_REALTIME, &(fs->inode_table[parent_inode_num].mtime)) == -1) {
-		fprintf(stderr, "Set system time failed");
-	}
+
+	// path_lookup() tokenizes the path in place, so take the name out first
+	char child_name[A1FS_NAME_MAX] = {'\0'};
+	extract_child_path((char *) path, child_name);
 
 	uint32_t target_dir_inode_num = (uint32_t)path_lookup(fs, path);
 	
 	// check if the target dir is empty 
-	if(fs->inode_table[target_dir_inode_num].size != 0){
+	if(fs->inode_table[target_dir_inode_num].num_dir_entry != 0){
 		return -ENOTEMPTY; 
 	}
 
-	// the target is empty
-	// firstly  place (the last dentry in the dir) on the place of the target dentry.
-
-	// pick the last entry
-	uint32_t parent_last_block_num = find_last_block(fs, parent_inode_num);
-	uint32_t num_of_entry_in_last_block = (fs->inode_table[parent_inode_num].num_dir_entry) % (A1FS_BLOCK_SIZE / sizeof(a1fs_dentry)); // number of entry in last block
-	if(num_of_entry_in_last_block == 0){
-		num_of_entry_in_last_block = A1FS_BLOCK_SIZE / sizeof(a1fs_dentry);
-	}
-
-	a1fs_dentry* parent_last_block_addr = (a1fs_dentry*)get_addr_of_block(fs, parent_last_block_num);
-	a1fs_dentry parent_last_dentry = parent_last_block_addr[num_of_entry_in_last_block - 1];
-
-	a1fs_dentry target_dentry;
+	// the name is gone from the parent, and the inode number can be reused by
+	// a new directory, so forget any (negative) entries cached under it as well
+	dcache_insert(&fs->dcache, parent_inode_num, child_name, DCACHE_NEGATIVE);
+	dcache_invalidate_dir(&fs->dcache, target_dir_inode_num);
 
-	if(parent_last_dentry.ino == target_dir_inode_num){ // the last dentry is the target dentry, no need to replace
-		target_dentry = parent_last_dentry;
-		goto NEXT;
-	}
-	
-	// find the target dentry, then hold it, then place the last dentry on the place of the target dentry
-	
-	for(uint32_t i = 0; i < fs->inode_table[parent_inode_num].extent_num; i++){ // traverse each extent
-		a1fs_extent temp_extent = ((a1fs_extent *)fs->inode_table[parent_inode_num].indirect_pt)[i];
-		for(uint32_t j = 0; j < temp_extent.count; j++){ // traverse each block
-			uint64_t temp_block_addr = get_addr_of_block(fs, temp_extent.start + j); 
-			for(uint32_t k = 0; k < A1FS_BLOCK_SIZE / sizeof(a1fs_dentry); k++){ // traverse each dentry
-				a1fs_dentry temp_dentry = ((a1fs_dentry*)temp_block_addr)[k];
-				if(temp_dentry.ino == target_dir_inode_num){ // find the target dentry
-					target_dentry = temp_dentry; // hold the target dentry
-					((a1fs_dentry*)temp_block_addr)[k] = parent_last_dentry; // place the last dentry on the place of the target dentry
-					goto NEXT;
-				}
-			}
-		}
-	}
+	// it is empty so no data blocks needs to be free, the only thing is to free the inode
+	remove_dentry(fs, parent_inode_num, child_name);
+	free_inode(fs, target_dir_inode_num, true);
 
-	NEXT: // at this time we have target_dentry and it place have been replaced by the last dentry.
-	
-	// when the target entry is the only entry in parent
-	if(fs->inode_table[parent_inode_num].num_dir_entry == 1){
-		
-		// firstly clean up itself
-		unset_bitmap(fs->inode_bitmap, target_dentry.ino); // it is empty so no data blocks needs to be free, the only thing is to unset inode_bitmap
-		*fs->available_inodes += 1;
-		// then clean up its parent
-		
-		// parent's data block need to be cleaned
-		uint32_t parent_indirect_block_num = get_num_of_block(fs, (uint64_t)(fs->inode_table[parent_inode_num].indirect_pt));
-		unset_bitmap(fs->data_bitmap, parent_last_block_num); // clean the block
-		*fs->available_blocks += 1;
-		unset_bitmap(fs->data_bitmap, parent_indirect_block_num); // clean the indirect pointer
-		*fs->available_blocks += 1;
-
-		// parent's data need to be cleaned, it should be totally empty
-		fs->inode_table[parent_inode_num].extent_num = 0;
-		fs->inode_table[parent_inode_num].links = 2;
-		fs->inode_table[parent_inode_num].num_dir_entry = 0;
-		fs->inode_table[parent_inode_num].size = 0;
-			
-
-	}else{ // it is not the only entry in parent
-		if(fs->inode_table[parent_inode_num].num_dir_entry % (A1FS_BLOCK_SIZE / sizeof(a1fs_dentry)) != 1){ 
-			// the last dentry of the parent is not the first dentry inside a data block, so no need to unset any data block
-
-			unset_bitmap(fs->inode_bitmap, target_dentry.ino); // clean up the target dir's inode
-			*fs->available_inodes += 1;
-
-			// set parent's data
-			fs->inode_table[parent_inode_num].links -= 1;
-			fs->inode_table[parent_inode_num].num_dir_entry -= 1;
-			fs->inode_table[parent_inode_num].size -= sizeof(a1fs_dentry);
-
-		}else{ // the last dentry of the parent is the first dentry of a datablock, we need to free 1 data block
-			uint32_t parent_extent_num = fs->inode_table[parent_inode_num].extent_num; // how many extents are there in the parent
-
-			if(((a1fs_extent *)fs->inode_table[parent_inode_num].indirect_pt)[parent_extent_num - 1].count > 1){
-				// the last extent's count > 1, so no need to free extent, but have to make extent.count--
-
-				unset_bitmap(fs->inode_bitmap, target_dentry.ino); // clean up the target dir's inode
-				*fs->available_inodes += 1;
-
-				// free the last data block of the parent
-				unset_bitmap(fs->data_bitmap, parent_last_block_num); // clean the block
-				*fs->available_blocks += 1;
-				((a1fs_extent *)fs->inode_table[parent_inode_num].indirect_pt)[parent_extent_num - 1].count -= 1;
-
-				// modify parent's data
-				fs->inode_table[parent_inode_num].links -= 1;
-				fs->inode_table[parent_inode_num].num_dir_entry -= 1;
-				fs->inode_table[parent_inode_num].size -= sizeof(a1fs_dentry);
-
-			}else{ // the last extent's count == 1, so need to free one extent
-
-				unset_bitmap(fs->inode_bitmap, target_dentry.ino); // clean up the target dir's inode
-				*fs->available_inodes += 1;
-				
-				// free the last block of the parent
-				unset_bitmap(fs->data_bitmap, parent_last_block_num); // clean the block
-				*fs->available_blocks += 1;
-
-				//free the extent
-				fs->inode_table[parent_inode_num].extent_num -= 1;
-
-				// modify parent's data
-				fs->inode_table[parent_inode_num].links -= 1;
-				fs->inode_table[parent_inode_num].num_dir_entry -= 1;
-				fs->inode_table[parent_inode_num].size -= sizeof(a1fs_dentry);
-			}			
-		}
-	
+	// update parent's info
+	fs->inode_table[parent_inode_num].links -= 1;
+	if (clock_gettime(CLOCK_REALTIME, &(fs->inode_table[parent_inode_num].mtime)) == -1) {
+		fprintf(stderr, "Set system time failed");
 	}
-
 	return 0;
 }
 
@@ -559,137 +503,61 @@ static int a1fs_rmdir(const char *path)
  */
 static int a1fs_create(const char *path, mode_t mode, struct fuse_file_info *fi)
 {
-	(void)fi;// unused
 	assert(S_ISREG(mode));
 	fs_ctx *fs = get_fs();
 
 
 	// ADDED: create a file at given path with given mode
-	if (*(fs->available_inodes) == 0 || *(fs->available_blocks) == 0) {
-        return -ENOSPC;
-    }
-	a1fs_inode new_dir;
-	new_dir.mode = mode;
-	new_dir.links = 1; // by itself and its parent
-	new_dir.size = 0;
-	new_dir.extent_num = 0;
-	new_dir.num_dir_entry = 0;
-	if (*(fs->available_inodes) == 0 || *(fs->available_blocks) == 0) {
-        return -ENOSPC;
-    }
-	uint32_t new_inode = get_first_available_position(fs->num_inodes, fs->inode_bitmap);
-	set_bitmap(fs->inode_bitmap, new_inode);
-	*(fs->available_inodes) -= 1;
-	fs->inode_table[new_inode] = new_dir;
+	a1fs_inode new_file;
+	new_file.mode = mode;
+	new_file.links = 1; // by its parent
+	new_file.size = 0;
+	if (clock_gettime(CLOCK_REALTIME, &(new_file.mtime)) == -1) {
+		fprintf(stderr, "Set system time failed");
+	}
+	new_file.extent_num = 0;
+	new_file.extent_blocks = 0;
+	new_file.num_dir_entry = 0;
+	new_file.dir_free_slot = 0;
+	new_file.flags = 0;
 
 	// modify information in the parent directory
-    char parent_dir[A1FS_NAME_MAX] = {'\0'};
+    char parent_dir[A1FS_PATH_MAX] = {'\0'};
     extract_parent_path((char *) path, parent_dir);
     int inode_num = path_lookup(fs, parent_dir); // inode num of the parent directory
 
+	// next to the parent
+	uint32_t new_inode;
+	if (!allocate_inode(fs, (uint32_t) inode_num, false, &new_inode)) {
+        return -ENOSPC;
+    }
 
-	if (clock_gettime(CLOCK_REALTIME, &(fs->inode_table[inode_num].mtime)) == -1) {
-		fprintf(stderr, "Set system time failed");
+	// the new file is open as well; the handle is taken first, so that
+	// nothing has to be undone if there is no memory for it
+	fi->fh = handle_open(&fs->handles, (a1fs_ino_t) new_inode);
+	if (fi->fh == 0) {
+		free_inode(fs, new_inode, false);
+		return -ENOMEM;
 	}
 
-	// add the directory entry in the parent directory, possibly allocating new blocks for it
-
-	// when the parent is empty;
-	if(fs->inode_table[inode_num].num_dir_entry == 0){ 
-		// have to firstly allocate extent for parent
-		if (*(fs->available_inodes) == 0 || *(fs->available_blocks) == 0) {
-        	return -ENOSPC;
-    	}
-		uint32_t new_single_indirect_block_num =
-				get_first_available_position(fs->num_of_data_blocks, fs->data_bitmap);
-		set_bitmap(fs->data_bitmap, new_single_indirect_block_num);
-		*(fs->available_blocks) -= 1;
-		uint64_t new_single_indirect_block_addr =
-				get_addr_of_block(fs, new_single_indirect_block_num);
-		fs->inode_table[inode_num].indirect_pt = new_single_indirect_block_addr;
-
-		// create new data block
-		if (*(fs->available_inodes) == 0 || *(fs->available_blocks) == 0) {
-        	return -ENOSPC;
-    	}
-		uint32_t new_data_block = get_first_available_position(fs->num_of_data_blocks, fs->data_bitmap);
-		set_bitmap(fs->data_bitmap, new_data_block);
-		*(fs->available_blocks) -= 1;
-		((a1fs_extent *)fs->inode_table[inode_num].indirect_pt)[0].start = new_data_block;
-		((a1fs_extent *)fs->inode_table[inode_num].indirect_pt)[0].count = 1;
-		a1fs_dentry* new_data_block_addr = (a1fs_dentry*)get_addr_of_block(fs, new_data_block);
-		
-		
-
-		//create new entry 
-		a1fs_dentry new_entry;
-		new_entry.ino = (a1fs_ino_t)new_inode;
-		extract_child_path((char*)path, new_entry.name);
-		new_data_block_addr[0] = new_entry; 
+	// the name is most likely cached as a negative entry by now
+	char child_name[A1FS_NAME_MAX] = {'\0'};
+	extract_child_path((char *) path, child_name);
+	dcache_invalidate(&fs->dcache, (a1fs_ino_t) inode_num, child_name);
 
-		// update parent's info
-		fs->inode_table[inode_num].size += sizeof(a1fs_dentry);
-		fs->inode_table[inode_num].num_dir_entry++;
-		fs->inode_table[inode_num].extent_num++;
-		return 0;
+	// add the directory entry in the parent directory, possibly allocating new blocks for it
+	int ret = add_dentry(fs, (uint32_t) inode_num, child_name, (a1fs_ino_t) new_inode);
+	if (ret != 0) {
+		handle_release(&fs->handles, fi->fh);
+		fi->fh = 0;
+		free_inode(fs, new_inode, false);
+		return ret;
 	}
+	fs->inode_table[new_inode] = new_file;
 
-	// the parent is not empty when reach here.
-	uint32_t last_block = find_last_block(fs,inode_num); // last block's number
-	if(fs->inode_table[inode_num].size % A1FS_BLOCK_SIZE != 0){
-		// if the parents' last block is not full
-		uint64_t num_of_entry_in_last_block = (fs->inode_table[inode_num].num_dir_entry) % (A1FS_BLOCK_SIZE / sizeof(a1fs_dentry));// number of entry in last block
-
-		a1fs_dentry new_entry;
-		new_entry.ino = (a1fs_ino_t)new_inode;
-		extract_child_path((char*)path, new_entry.name);
-		a1fs_dentry* last_block_addr = (a1fs_dentry*)get_addr_of_block(fs, last_block);
-		last_block_addr[num_of_entry_in_last_block] = new_entry;
-	}else{
-		// if the parents' last block is full
-		if(is_bit_set(last_block + 1, fs->data_bitmap) == 0){ // the next block is free
-			uint32_t new_block_num = last_block + 1; // new block's number
-			set_bitmap(fs->data_bitmap, new_block_num);
-			*(fs->available_blocks) -= 1;
-			a1fs_dentry* new_block_addr = (a1fs_dentry*)get_addr_of_block(fs, new_block_num); // new block's address
-			a1fs_dentry new_entry;
-			new_entry.ino = (a1fs_ino_t)new_inode;
-			extract_child_path((char*)path, new_entry.name);
-			new_block_addr[0] = new_entry;
-
-			((a1fs_extent *)fs->inode_table[inode_num].indirect_pt)[fs->inode_table[inode_num].extent_num - 1].count++;
-		}else{ // the next block is not free
-
-			// create new block
-			if (*(fs->available_inodes) == 0 || *(fs->available_blocks) == 0) {
-        		return -ENOSPC;
-    		}
-			uint32_t new_data_block_num = (uint32_t)get_first_available_position(fs->num_of_data_blocks, fs->data_bitmap);
-			set_bitmap(fs->data_bitmap, new_data_block_num);
-			*(fs->available_blocks) -= 1;
-
-			// create new extent
-			((a1fs_extent *)fs->inode_table[inode_num].indirect_pt)[fs->inode_table[inode_num].extent_num].start = new_data_block_num;
-			((a1fs_extent *)fs->inode_table[inode_num].indirect_pt)[fs->inode_table[inode_num].extent_num].count = 1;
-
-			// create entry
-			a1fs_dentry new_entry;
-			new_entry.ino = (a1fs_ino_t)new_inode;
-			extract_child_path((char*)path, new_entry.name);
-
-			a1fs_dentry* new_data_block_addr = (a1fs_dentry*)get_addr_of_block(fs, new_data_block_num);
-			new_data_block_addr[0] = new_entry;
-			
-
-			fs->inode_table[inode_num].extent_num++;
-		}
+	if (clock_gettime(CLOCK_REALTIME, &(fs->inode_table[inode_num].mtime)) == -1) {
+		fprintf(stderr, "Set system time failed");
 	}
-
-	// update parent's info
-	fs->inode_table[inode_num].size += sizeof(a1fs_dentry);
-	fs->inode_table[inode_num].num_dir_entry++;
-	
-
 	return 0;
 
 }
@@ -722,140 +590,24 @@ static int a1fs_unlink(const char *path)
 		fprintf(stderr, "Set system time failed");
 	}
 
-	uint32_t target_inode_num = (uint32_t)path_lookup(fs, path);
-	
-
-	if(fs->inode_table[target_inode_num].size != 0){ // if the target file is not empty
-		// clean up the target file's data block and indirect pointer. ie. makes the file to be an empty file
-
-		for(uint32_t i = 0; i < fs->inode_table[target_inode_num].extent_num; i++){ // traverse through each extent
-			a1fs_extent this_extent = ((a1fs_extent *)fs->inode_table[target_inode_num].indirect_pt)[i];
-			for(uint32_t j = 0; j < (uint32_t)this_extent.count; j++){ // traverse through each block and free them
-				unset_bitmap(fs->data_bitmap, this_extent.start + j);
-				*fs->available_blocks += 1;
-			}
-		}
+	// path_lookup() tokenizes the path in place, so take the name out first
+	char child_name[A1FS_NAME_MAX] = {'\0'};
+	extract_child_path((char *) path, child_name);
 
-		// free target file's indirect block
-		uint32_t target_file_indirect_num = get_num_of_block(fs, (uint64_t)(fs->inode_table[target_inode_num].indirect_pt));
-		unset_bitmap(fs->data_bitmap, target_file_indirect_num);
-		*fs->available_blocks += 1;
+	uint32_t target_inode_num = (uint32_t)path_lookup(fs, path);
 
-		// set file's stat
-		fs->inode_table[target_inode_num].extent_num = 0;
-		fs->inode_table[target_inode_num].size = 0;
+	dcache_insert(&fs->dcache, parent_inode_num, child_name, DCACHE_NEGATIVE);
+	discard_delalloc(fs, target_inode_num);
+	release_prealloc(fs, target_inode_num);
 
-	}
+	// clean up the target file's data blocks and extent tree nodes, if any (inline data has none)
+	shrink_file_blocks(fs, target_inode_num, 0);
+	fs->inode_table[target_inode_num].size = 0;
 
 
 	// the target is empty
-	// first place (the last dentry in the dir) on the place of the target dentry.
-
-	// pick the last entry
-	uint32_t parent_last_block_num = find_last_block(fs, parent_inode_num);
-	uint32_t num_of_entry_in_last_block = (fs->inode_table[parent_inode_num].num_dir_entry) % (A1FS_BLOCK_SIZE / sizeof(a1fs_dentry)); // number of entry in last block
-	if(num_of_entry_in_last_block == 0){
-		num_of_entry_in_last_block = A1FS_BLOCK_SIZE / sizeof(a1fs_dentry);
-	}
-	a1fs_dentry* parent_last_block_addr = (a1fs_dentry*)get_addr_of_block(fs, parent_last_block_num);
-	a1fs_dentry parent_last_dentry = parent_last_block_addr[num_of_entry_in_last_block - 1];
-
-	a1fs_dentry target_dentry;
-
-	if(parent_last_dentry.ino == target_inode_num){ // the last dentry is the target dentry, no need to replace
-		target_dentry = parent_last_dentry;
-		goto COUNTINUE;
-	}
-	
-	// find the target dentry, then hold it, then place the last dentry on the place of the target dentry
-	
-	for(uint32_t i = 0; i < fs->inode_table[parent_inode_num].extent_num; i++){ // traverse each extent
-		a1fs_extent temp_extent = ((a1fs_extent *)fs->inode_table[parent_inode_num].indirect_pt)[i];
-		for(uint32_t j = 0; j < temp_extent.count; j++){ // traverse each block
-			uint64_t temp_block_addr = get_addr_of_block(fs, temp_extent.start + j); 
-			for(uint32_t k = 0; k < A1FS_BLOCK_SIZE / sizeof(a1fs_dentry); k++){ // traverse each dentry
-				a1fs_dentry temp_dentry = ((a1fs_dentry*)temp_block_addr)[k];
-				if(temp_dentry.ino == target_inode_num){ // find the target dentry
-					target_dentry = temp_dentry; // hold the target dentry
-					((a1fs_dentry*)temp_block_addr)[k] = parent_last_dentry; // place the last dentry on the place of the target dentry
-					goto COUNTINUE;
-				}
-			}
-		}
-	}
-
-	COUNTINUE: // at this time we have target_dentry and it place have been replaced by the last dentry.
-	
-	// when the target entry is the only entry in parent
-	if(fs->inode_table[parent_inode_num].num_dir_entry == 1){
-		
-		// firstly clean up itself
-		unset_bitmap(fs->inode_bitmap, target_dentry.ino); // it is empty so no data blocks needs to be free, the only thing is to unset inode_bitmap
-		*fs->available_inodes += 1;
-		// then clean up its parent
-		
-		// parent's data block need to be cleaned
-		uint32_t parent_indirect_block_num = get_num_of_block(fs, (uint64_t)(fs->inode_table[parent_inode_num].indirect_pt));
-		unset_bitmap(fs->data_bitmap, parent_last_block_num); // clean the block
-		*fs->available_blocks += 1;
-		unset_bitmap(fs->data_bitmap, parent_indirect_block_num); // clean the indirect pointer
-		*fs->available_blocks += 1;
-
-		// parent's data need to be cleaned, it should be totally empty
-		fs->inode_table[parent_inode_num].extent_num = 0;
-		fs->inode_table[parent_inode_num].links = 2;
-		fs->inode_table[parent_inode_num].num_dir_entry = 0;
-		fs->inode_table[parent_inode_num].size = 0;
-			
-
-	}else{ // it is not the only entry in parent
-		if(fs->inode_table[parent_inode_num].num_dir_entry % (A1FS_BLOCK_SIZE / sizeof(a1fs_dentry)) != 1){ 
-			// the last dentry of the parent is not the first dentry inside a data block, so no need to unset any data block
-
-			unset_bitmap(fs->inode_bitmap, target_dentry.ino); // clean up the target dir's inode
-			*fs->available_inodes += 1;
-
-			// set parent's data
-			fs->inode_table[parent_inode_num].num_dir_entry -= 1;
-			fs->inode_table[parent_inode_num].size -= sizeof(a1fs_dentry);
-
-		}else{ // the last dentry of the parent is the first dentry of a datablock, we need to free 1 data block
-			uint32_t parent_extent_num = fs->inode_table[parent_inode_num].extent_num; // how many extents are there in the parent
-
-			if(((a1fs_extent *)fs->inode_table[parent_inode_num].indirect_pt)[parent_extent_num - 1].count > 1){
-				// the last extent's count > 1, so no need to free extent, but have to make extent.count--
-
-				unset_bitmap(fs->inode_bitmap, target_dentry.ino); // clean up the target dir's inode
-				*fs->available_inodes += 1;
-
-				// free the last data block of the parent
-				unset_bitmap(fs->data_bitmap, parent_last_block_num); // clean the block
-				*fs->available_blocks += 1;
-				((a1fs_extent *) fs->inode_table[parent_inode_num].indirect_pt)[parent_extent_num - 1].count -= 1;
-
-				// modify parent's data
-				fs->inode_table[parent_inode_num].num_dir_entry -= 1;
-				fs->inode_table[parent_inode_num].size -= sizeof(a1fs_dentry);
-
-			}else{ // the last extent's count == 1, so need to free one extent
-
-				unset_bitmap(fs->inode_bitmap, target_dentry.ino); // clean up the target dir's inode
-				*fs->available_inodes += 1;
-				
-				// free the last block of the parent
-				unset_bitmap(fs->data_bitmap, parent_last_block_num); // clean the block
-				*fs->available_blocks += 1;
-
-				//free the extent
-				fs->inode_table[parent_inode_num].extent_num -= 1;
-
-				// modify parent's data
-				fs->inode_table[parent_inode_num].num_dir_entry -= 1;
-				fs->inode_table[parent_inode_num].size -= sizeof(a1fs_dentry);
-			}			
-		}
-	
-	}
+	remove_dentry(fs, parent_inode_num, child_name);
+	free_inode(fs, target_inode_num, false);
 
 	return 0;
 }
@@ -911,17 +663,50 @@ static int a1fs_utimens(const char *path, const struct timespec times[2])
  *
  * @param path  path to the file to set the size.
  * @param size  new file size in bytes.
+ * @param fi    handle from a1fs_open() or a1fs_create(), or NULL.
  * @return      0 on success; -errno on error.
  */
-static int a1fs_truncate(const char *path, off_t size)
+static int a1fs_ftruncate(const char *path, off_t size, struct fuse_file_info *fi)
 {
 	fs_ctx *fs = get_fs();
 
 	// ADDED: set new file size, possibly "zeroing out" the uninitialized range
 
-	uint32_t file_inode_num = (uint32_t) path_lookup(fs, path);
+	a1fs_handle tmp;
+	uint32_t file_inode_num = get_handle(fs, path, fi, &tmp)->ino;
 	uint64_t file_original_size = fs->inode_table[file_inode_num].size;
+	a1fs_inode *inode = &fs->inode_table[file_inode_num];
 
+	// buffered data is placed first, so that there are only blocks to cut or add
+	int flushed = flush_delalloc(fs, file_inode_num);
+	if(flushed != 0){
+		return flushed;
+	}
+	release_prealloc(fs, file_inode_num);
+
+	// a file with no blocks keeps its data in the inode while it fits
+	if(inode->extent_num == 0 && (uint64_t) size <= A1FS_INLINE_DATA_SIZE){
+		if(!(inode->flags & A1FS_INODE_INLINE_DATA)){
+			memset(inode->inline_data, '\0', A1FS_INLINE_DATA_SIZE);
+			inode->flags |= A1FS_INODE_INLINE_DATA;
+		}else if((uint64_t) size < file_original_size){
+			memset(inode->inline_data + size, '\0', file_original_size - size);
+		}
+		if(size == 0){
+			inode->flags &= ~A1FS_INODE_INLINE_DATA;
+		}
+		inode->size = (uint64_t) size;
+		if (clock_gettime(CLOCK_REALTIME, &(inode->mtime)) == -1) {
+			fprintf(stderr, "Set system time failed");
+		}
+		return 0;
+	}
+	if(inode->flags & A1FS_INODE_INLINE_DATA){
+		int ret = spill_inline_data(fs, file_inode_num);
+		if(ret != 0){
+			return ret;
+		}
+	}
 
 	if((uint64_t) size == file_original_size){
 
@@ -930,53 +715,15 @@ static int a1fs_truncate(const char *path, off_t size)
 	}else if((uint64_t) size < file_original_size){
 
 
-		uint32_t new_file_block_count;
-		if(size % A1FS_BLOCK_SIZE == 0){
-			new_file_block_count = (uint32_t) size / A1FS_BLOCK_SIZE;
-		}else{
-			new_file_block_count = (uint32_t) size / A1FS_BLOCK_SIZE + 1;
-		}
+		uint32_t new_file_block_count = (uint32_t) ((size + A1FS_BLOCK_SIZE - 1) / A1FS_BLOCK_SIZE);
 
 
 		
-		uint32_t target_extent_index = 0; // the extent that we are keeping
-		uint32_t count = 0;
-		uint32_t target_block_num_in_extent = 1;
-		a1fs_extent temp_extent;
-		for(uint32_t i = 0; i < fs->inode_table[file_inode_num].extent_num; i++) { // traverse each extent
-			temp_extent = ((a1fs_extent *)fs->inode_table[file_inode_num].indirect_pt)[i];
-			if(temp_extent.count + count >= new_file_block_count){ // this is the target extent
-				target_extent_index = i;
-				target_block_num_in_extent = new_file_block_count - count; // this is the target block's order in the extent
-				goto FOUND;
-			}
-			count += temp_extent.count;
-
-			
-		}
-		FOUND: // we have found the target block and extent
-
-		// free other blocks
+		// free the blocks past the new end of the file
+		shrink_file_blocks(fs, file_inode_num, new_file_block_count);
 
-		// free the other blocks in the target extent
-		for(uint32_t i = target_block_num_in_extent; i < temp_extent.count; i++){
-			unset_bitmap(fs->data_bitmap,temp_extent.start + i - 1);
-			*fs->available_blocks += 1;
-		}
-		((a1fs_extent *)fs->inode_table[file_inode_num].indirect_pt)[target_extent_index].count = target_block_num_in_extent;
-
-		// free other blocks
-		for(uint32_t i = target_extent_index + 1; i < fs->inode_table[file_inode_num].extent_num; i++){ //traverse these extents
-
-			for(uint32_t j = 0; j < ((a1fs_extent *)fs->inode_table[file_inode_num].indirect_pt)[i].count; j++){ // traverse each blocks
-				unset_bitmap((unsigned char *) fs->data_block, ((a1fs_extent *)fs->inode_table[file_inode_num].indirect_pt)[i].start + j); // free them
-				*fs->available_blocks += 1;
-			}
-
-		}
-
-		// free the extents
-		fs->inode_table[file_inode_num].extent_num = target_extent_index + 1;
+		// zero the rest of the last block, so that extending the file again reads zeros
+		zero_block_tail(fs, file_inode_num, (uint64_t) size);
 
 		// update size and mtime
 		fs->inode_table[file_inode_num].size = (uint64_t) size;
@@ -992,24 +739,9 @@ static int a1fs_truncate(const char *path, off_t size)
 
 	}else{ // when we have to extend the file
 
-		uint32_t original_file_block_count = get_num_blks_of_file(fs->inode_table[file_inode_num]);
-		
-		uint32_t new_file_block_count;
-		if(size % A1FS_BLOCK_SIZE == 0){
-			new_file_block_count = (uint32_t) size / A1FS_BLOCK_SIZE;
-		}else{
-			new_file_block_count = (uint32_t) size / A1FS_BLOCK_SIZE + 1;
-		}
-
-		uint32_t num_blocks_we_have_to_add = new_file_block_count - original_file_block_count;
-
-		for(uint32_t i = 0; i < num_blocks_we_have_to_add; i++){
-			
-			if(growing_a_block_for_file(fs, file_inode_num) == -1){
-				return -ENOSPC;
-			}
-
-		}
+		// the new range is a hole, which reads as zeros and takes no blocks
+		// until it is written to; only the rest of the last block is zeroed
+		zero_block_tail(fs, file_inode_num, file_original_size);
 
 		// update size and mtime
 		fs->inode_table[file_inode_num].size = (uint64_t) size;
@@ -1023,6 +755,12 @@ static int a1fs_truncate(const char *path, off_t size)
 
 }
 
+/** Change the size of a file given by its path. See a1fs_ftruncate(). */
+static int a1fs_truncate(const char *path, off_t size)
+{
+	return a1fs_ftruncate(path, size, NULL);
+}
+
 
 /**
  * Read data from a file.
@@ -1041,57 +779,49 @@ static int a1fs_truncate(const char *path, off_t size)
  * @param buf     pointer to the buffer that receives the data.
  * @param size    buffer size (number of bytes requested).
  * @param offset  offset from the beginning of the file to read from.
- * @param fi      unused.
+ * @param fi      handle from a1fs_open() or a1fs_create().
  * @return        number of bytes read on success; 0 if offset is beyond EOF;
  *                -errno on error.
  */
 static int a1fs_read(const char *path, char *buf, size_t size, off_t offset,
                      struct fuse_file_info *fi)
 {
-	(void)fi;// unused
 	fs_ctx *fs = get_fs();
 
 	// ADDED: read data from the file at given offset into the buffer
-	int inode_num = path_lookup(fs, path);
-	a1fs_inode inode = fs->inode_table[inode_num];
+	a1fs_handle tmp;
+	a1fs_handle *handle = get_handle(fs, path, fi, &tmp);
+	a1fs_inode *inode = &fs->inode_table[handle->ino];
 	// return 0 when offset is beyond EOF
-	if ((uint32_t) offset >= inode.size) {
+	if ((uint64_t) offset >= inode->size) {
 		return 0;
 	}
 
 	int ret;
-	if ((uint32_t) offset + size > inode.size) { // offset + size is beyond EOF
-		ret = (int) (inode.size - (uint32_t) offset);
+	if ((uint64_t) offset + size > inode->size) { // offset + size is beyond EOF
+		ret = (int) (inode->size - (uint64_t) offset);
 	} else { // offset and size are both valid
 		ret = (int) size;
 	}
 
-	uint64_t offset_in_blk = (uint64_t) offset % A1FS_BLOCK_SIZE; // bytes
-	off_t offset_copy = (uint64_t) offset;
-	uint32_t extent_index = 0;
-
-	// get the index of the extent at which the offset is located
-	for (uint32_t i = 0; i < inode.extent_num; i++) {
-		if (offset_copy - ((a1fs_extent *)(inode.indirect_pt))[i].count * A1FS_BLOCK_SIZE < 0) {
-			extent_index = i;
-			break;
-		}
-		offset_copy -= ((a1fs_extent *) inode.indirect_pt)[i].count * A1FS_BLOCK_SIZE;
+	if (inode->flags & A1FS_INODE_INLINE_DATA) {
+		memcpy(buf, inode->inline_data + offset, ret);
+		return ret;
 	}
-
-	// get the index of the block in the acquired extent at which the offset is located
-	uint32_t blk_index_in_extent = 0;
-	for (uint32_t j = 0; j < ((a1fs_extent *) inode.indirect_pt)[extent_index].count; j++) {
-		if (offset_copy - A1FS_BLOCK_SIZE < 0) {
-			blk_index_in_extent = j;
-			break;
-		}
-		offset_copy -= A1FS_BLOCK_SIZE;
+	if (delalloc_read(fs, handle->ino, buf, ret, offset)) {
+		return ret;
 	}
 
-	char *data_to_read = (char *) ((uint64_t) (((a1fs_extent *)inode.indirect_pt)[extent_index].start
-			+ blk_index_in_extent) * A1FS_BLOCK_SIZE + fs->data_block + offset_in_blk);
-	memcpy(buf, data_to_read, ret);
+	// the range is within a single block, found from where the last read of
+	// this handle was
+	char *block_addr = (char *) get_addr_of_file_block_at(fs, handle->ino,
+			(uint32_t) (offset / A1FS_BLOCK_SIZE), &handle->cursor);
+	if (block_addr == NULL || (handle->cursor.extent.flags & A1FS_EXTENT_UNWRITTEN)) {
+		// a hole, or blocks from fallocate() that were never written
+		memset(buf, 0, ret);
+		return ret;
+	}
+	memcpy(buf, block_addr + offset % A1FS_BLOCK_SIZE, ret);
 	return ret;
 }
 
@@ -1110,19 +840,17 @@ static int a1fs_read(const char *path, char *buf, size_t size, off_t offset,
  * Errors:
  *   ENOMEM  not enough memory (e.g. a malloc() call failed).
  *   ENOSPC  not enough free space in the file system.
- *   ENOSPC  too many extents (a1fs only needs to support 512 extents per file)
  *
  * @param path    path to the file to write to.
  * @param buf     pointer to the buffer containing the data.
  * @param size    buffer size (number of bytes requested).
  * @param offset  offset from the beginning of the file to write to.
- * @param fi      unused.
+ * @param fi      handle from a1fs_open() or a1fs_create().
  * @return        number of bytes written on success; -errno on error.
  */
 static int a1fs_write(const char *path, const char *buf, size_t size,
                       off_t offset, struct fuse_file_info *fi)
 {
-	(void)fi;// unused
 	fs_ctx *fs = get_fs();
 
 	// ADDED: write data from the buffer into the file at given offset, possibly
@@ -1134,103 +862,325 @@ static int a1fs_write(const char *path, const char *buf, size_t size,
 	}
 
 	// init essential block
-	uint32_t file_inode_num = (uint32_t) path_lookup(fs,path);
+	a1fs_handle tmp;
+	a1fs_handle *handle = get_handle(fs, path, fi, &tmp);
+	uint32_t file_inode_num = handle->ino;
 	uint64_t file_size = fs->inode_table[file_inode_num].size;
+	a1fs_inode *inode = &fs->inode_table[file_inode_num];
+
+	// with delayed allocation, what goes past the blocks of the file is
+	// buffered until it is flushed
+	if(fs->delayed_alloc){
+		int ret = delalloc_write(fs, file_inode_num, buf, size, offset);
+		if(ret < 0){
+			return ret;
+		}
+		if(ret > 0){
+			if (clock_gettime(CLOCK_REALTIME, &(inode->mtime)) == -1) {
+				fprintf(stderr, "Set system time failed");
+			}
+			goto END_WRITE;
+		}
+		file_size = inode->size;
+	}
 
-
-	// the most normal case, size + offset <= file_size ie.(case 4)
-	if(size + offset <= file_size){
-		// find the address where we need to begin to write data
-
-		// offset % A1FS_BLOCK_SIZE must != 0, since size != 0 at this point.
-		char* addr_of_write_begin = (char *)get_addr_of_starting_write_point(fs, file_inode_num, (uint64_t) offset);
-
-		memcpy(addr_of_write_begin, buf, size); // write in the data
-		// update mtime
-		if (clock_gettime(CLOCK_REALTIME, &(fs->inode_table[file_inode_num].mtime)) == -1) {
+	// a file with no blocks keeps its data in the inode while it fits (and
+	// isn't one large hole)
+	if(inode->extent_num == 0 && size + offset <= A1FS_INLINE_DATA_SIZE && file_size <= A1FS_INLINE_DATA_SIZE){
+		if(!(inode->flags & A1FS_INODE_INLINE_DATA)){
+			memset(inode->inline_data, '\0', A1FS_INLINE_DATA_SIZE);
+			inode->flags |= A1FS_INODE_INLINE_DATA;
+		}
+		memcpy(inode->inline_data + offset, buf, size);
+		if(size + offset > file_size){
+			inode->size = size + offset;
+		}
+		if (clock_gettime(CLOCK_REALTIME, &(inode->mtime)) == -1) {
 			fprintf(stderr, "Set system time failed");
 		}
 		goto END_WRITE;
 	}
+	if(inode->flags & A1FS_INODE_INLINE_DATA){
+		int ret = spill_inline_data(fs, file_inode_num);
+		if(ret != 0){
+			return ret;
+		}
+	}
 
-	// file_size < size + offset <= num_of_blocks_in_the_file * block_size (case 5 and 6)
-	if(size + offset <= A1FS_BLOCK_SIZE * get_num_blks_of_file(fs->inode_table[file_inode_num])){
-
-		// offset % A1FS_BLOCK_SIZE must != 0, since size != 0 at this point.
-		char* addr_of_write_begin = (char *)get_addr_of_starting_write_point(fs, file_inode_num, (uint64_t) offset);
-		
-		if((uint64_t) offset <= file_size){ // (case 5)
-			memset(addr_of_write_begin, '\0', A1FS_BLOCK_SIZE * get_num_blks_of_file(fs->inode_table[file_inode_num]) - offset); // firstly zero all bytes after offset inside that block.
-			memcpy(addr_of_write_begin, buf, size); // write in the data
-			
-		
-		}else{ // (case 6)
-		    // get the index of the last block of the file
-			uint32_t file_last_block = find_last_block(fs, file_inode_num);
-            uint64_t file_last_block_addr = get_addr_of_block(fs, file_last_block);
 
-			char* hole_begin = (char*)(file_last_block_addr + A1FS_BLOCK_SIZE - (A1FS_BLOCK_SIZE * get_num_blks_of_file(fs->inode_table[file_inode_num]) - file_size));
-			memset(hole_begin, '\0', A1FS_BLOCK_SIZE * get_num_blks_of_file(fs->inode_table[file_inode_num]) - file_size); // firslty zero all bytes after offset inside that block.
-			memcpy(addr_of_write_begin, buf, size); // write in the data
+	// the bytes between the end of the file and the write read as zeros
+	if((uint64_t) offset > file_size){
+		zero_block_tail(fs, file_inode_num, file_size);
+	}
 
+	// the bytes of the block around the write are zeroed if it was not written
+	// before; those past the end of the file needn't be, as they are zeroed
+	// when the file grows over them
+	uint32_t block_index = (uint32_t) (offset / A1FS_BLOCK_SIZE);
+	uint32_t file_block_count = get_num_blks_of_file(fs, inode);
+	uint32_t from = (uint32_t) (offset % A1FS_BLOCK_SIZE);
+	uint32_t to = (uint64_t) offset + size >= file_size ? A1FS_BLOCK_SIZE : from + (uint32_t) size;
+
+	// the write is right after the last block (case 1, 2 and 3): append a
+	// block to the file
+	bool fresh = block_index == file_block_count;
+	if(fresh){
+		int ret = grow_file_blocks(fs, file_inode_num, 1, NULL, 0);
+		if(ret != 0){
+			return ret;
 		}
-
-		// upadate file size and mtime
-		if (clock_gettime(CLOCK_REALTIME, &(fs->inode_table[file_inode_num].mtime)) == -1) {
-			fprintf(stderr, "Set system time failed");
+		// a file appended to (rather than written past its end) is likely to be
+		// appended to again
+		if((uint64_t) offset == file_size){
+			speculative_prealloc(fs, file_inode_num);
 		}
-		fs->inode_table[file_inode_num].size = size + offset;
-		goto END_WRITE;
+	}
 
+	// within the blocks of the file (case 4, 5 and 6), or past them, which may
+	// be a hole, only the block written to being allocated, or unwritten if the
+	// file was given blocks by fallocate()
+	char *write_begin = (char *) get_block_for_write(fs, file_inode_num, block_index, from, to, &handle->cursor);
+	if(write_begin == NULL){
+		return -ENOSPC;
 	}
-	
-	// num_of_blocks_in_the_file * block_size < size + offset <= (num_of_blocks_in_the_file + 1) * block_size (case 1, 2)
-	if(size + offset <= A1FS_BLOCK_SIZE * (1 + get_num_blks_of_file(fs->inode_table[file_inode_num])) ){
+	if(fresh){
+		zero_block_around(fs, write_begin, from, to);
+	}
+	memcpy(write_begin + from, buf, size);
 
-		if(growing_a_block_for_file(fs, file_inode_num) == -1){
-			return -ENOSPC;
-		}
+	// update file size and mtime
+	if (clock_gettime(CLOCK_REALTIME, &(inode->mtime)) == -1) {
+		fprintf(stderr, "Set system time failed");
+	}
+	if(size + offset > file_size){
+		inode->size = size + offset;
+	}
 
+	END_WRITE:
+	return (int)size;
 
-		char* current_last_block_addr = (char*)get_addr_of_block(fs, find_last_block(fs, file_inode_num));
-		char* write_begin = current_last_block_addr + offset % A1FS_BLOCK_SIZE;
-		memcpy(write_begin, buf, size);
+}
 
-		// update file size and mtime
-		if (clock_gettime(CLOCK_REALTIME, &(fs->inode_table[file_inode_num].mtime)) == -1) {
-			fprintf(stderr, "Set system time failed");
-		}
-		fs->inode_table[file_inode_num].size = size + offset;
-		goto END_WRITE;
+/**
+ * Zero the bytes [from, to) of a file, which are within one block, unless the
+ * block reads as zeros already.
+ */
+static void zero_range(fs_ctx *fs, uint32_t file_inode_num, uint64_t from, uint64_t to)
+{
+	extent_cursor cursor = {{0, 0, 0, 0}, 0};
+	char *block_addr = (char *) get_addr_of_file_block_at(fs, file_inode_num,
+			(uint32_t) (from / A1FS_BLOCK_SIZE), &cursor);
+	if (block_addr != NULL && !(cursor.extent.flags & A1FS_EXTENT_UNWRITTEN)) {
+		memset(block_addr + from % A1FS_BLOCK_SIZE, 0, to - from);
+		fs->zeroed_bytes += to - from;
+	}
+}
 
+/**
+ * Allocate or deallocate the space of a range of a file.
+ *
+ * Implements the fallocate() system call. See "man 2 fallocate" for details.
+ * Mode 0 allocates the blocks of the range that the file does not have, as
+ * unwritten extents that read as zeros without being zeroed, and extends the
+ * file to the end of the range; with FALLOC_FL_KEEP_SIZE the size stays as it
+ * is. FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE zeroes the range, freeing
+ * the whole blocks in it.
+ *
+ * Assumptions (already verified by FUSE using getattr() calls):
+ *   "path" exists and is a file.
+ *
+ * Errors:
+ *   EOPNOTSUPP  any other mode.
+ *   ENOMEM      not enough memory (e.g. a malloc() call failed).
+ *   ENOSPC      not enough free space in the file system.
+ *
+ * @param path    path to the file.
+ * @param mode    FALLOC_FL_* flags.
+ * @param offset  start of the range in bytes.
+ * @param length  length of the range in bytes.
+ * @param fi      handle from a1fs_open() or a1fs_create().
+ * @return        0 on success; -errno on error.
+ */
+static int a1fs_fallocate(const char *path, int mode, off_t offset, off_t length,
+                          struct fuse_file_info *fi)
+{
+	fs_ctx *fs = get_fs();
+
+	bool punch = mode == (FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE);
+	if (!punch && mode != 0 && mode != FALLOC_FL_KEEP_SIZE) {
+		return -EOPNOTSUPP;
+	}
+	if (length <= 0 || offset < 0) {
+		return -EINVAL;
 	}
 
-    // size + offset > (num_of_blocks_in_the_file + 1) * block_size (case 3)
-	if(size + offset > A1FS_BLOCK_SIZE * (1 + get_num_blks_of_file(fs->inode_table[file_inode_num])) ){
+	a1fs_handle tmp;
+	uint32_t file_inode_num = get_handle(fs, path, fi, &tmp)->ino;
+	a1fs_inode *inode = &fs->inode_table[file_inode_num];
+	uint64_t end = (uint64_t) offset + (uint64_t) length;
 
-		if(growing_a_block_for_file(fs, file_inode_num) == -1){
-			return -ENOSPC;
-		}
+	// buffered data is placed first, so that there are only blocks to deal with
+	int ret = flush_delalloc(fs, file_inode_num);
+	if (ret != 0) {
+		return ret;
+	}
+	release_prealloc(fs, file_inode_num);
 
-		if(growing_a_block_for_file(fs, file_inode_num) == -1){
-			return -ENOSPC;
+	if (punch) {
+		// past the end of the file there is nothing to zero
+		if (end > inode->size) {
+			end = inode->size;
+		}
+		if ((uint64_t) offset >= end) {
+			return 0;
+		}
+		if (inode->flags & A1FS_INODE_INLINE_DATA) {
+			memset(inode->inline_data + offset, 0, end - offset);
+			return 0;
+		}
+		// whole blocks are freed, the parts of blocks at the ends zeroed
+		uint32_t first = (uint32_t) ((offset + A1FS_BLOCK_SIZE - 1) / A1FS_BLOCK_SIZE);
+		uint32_t last = (uint32_t) (end / A1FS_BLOCK_SIZE);
+		if (first < last) {
+			ret = punch_file_range(fs, file_inode_num, first, last - first);
+			if (ret != 0) {
+				return ret;
+			}
+		}
+		if (offset % A1FS_BLOCK_SIZE != 0) {
+			uint64_t head_end = (uint64_t) first * A1FS_BLOCK_SIZE;
+			zero_range(fs, file_inode_num, (uint64_t) offset, head_end < end ? head_end : end);
+		}
+		// the part in the last block, all of a range that starts on a block
+		// and ends inside it
+		if (end % A1FS_BLOCK_SIZE != 0 && (uint64_t) last * A1FS_BLOCK_SIZE >= (uint64_t) offset) {
+			zero_range(fs, file_inode_num, (uint64_t) last * A1FS_BLOCK_SIZE, end);
+		}
+	} else {
+		// a file that stays small enough keeps its data in the inode
+		if (inode->extent_num == 0 && end <= A1FS_INLINE_DATA_SIZE && inode->size <= A1FS_INLINE_DATA_SIZE
+		    && mode == 0) {
+			return a1fs_ftruncate(path, end > inode->size ? (off_t) end : (off_t) inode->size, fi);
+		}
+		if (inode->flags & A1FS_INODE_INLINE_DATA) {
+			ret = spill_inline_data(fs, file_inode_num);
+			if (ret != 0) {
+				return ret;
+			}
+		}
+		uint32_t first = (uint32_t) (offset / A1FS_BLOCK_SIZE);
+		uint32_t last = (uint32_t) ((end + A1FS_BLOCK_SIZE - 1) / A1FS_BLOCK_SIZE);
+		ret = allocate_file_range(fs, file_inode_num, first, last - first);
+		if (ret != 0) {
+			return ret;
 		}
+		if (mode == 0 && end > inode->size) {
+			zero_block_tail(fs, file_inode_num, inode->size);
+			inode->size = end;
+		}
+	}
 
-		char* begin_write = (char*)get_addr_of_block(fs, find_last_block(fs, file_inode_num));
-		memcpy(begin_write, buf, size);
+	if (clock_gettime(CLOCK_REALTIME, &(inode->mtime)) == -1) {
+		fprintf(stderr, "Set system time failed");
+	}
+	return 0;
+}
 
-		// update file size and mtime
-		if (clock_gettime(CLOCK_REALTIME, &(fs->inode_table[file_inode_num].mtime)) == -1) {
-			fprintf(stderr, "Set system time failed");
-		}
-		fs->inode_table[file_inode_num].size = size + offset;
-		goto END_WRITE;
+/**
+ * Open a file.
+ *
+ * Implements the open() system call. The inode of the file is kept in a handle
+ * in fi->fh, so that reads and writes don't have to look the path up again.
+ *
+ * Assumptions (already verified by FUSE using getattr() calls):
+ *   "path" exists and is a file.
+ *
+ * Errors:
+ *   ENOMEM  not enough memory for the handle.
+ *
+ * @param path  path to the file to open.
+ * @param fi    receives the handle in fi->fh.
+ * @return      0 on success; -errno on error.
+ */
+static int a1fs_open(const char *path, struct fuse_file_info *fi)
+{
+	fs_ctx *fs = get_fs();
 
+	fi->fh = handle_open(&fs->handles, (a1fs_ino_t) path_lookup(fs, path));
+	if (fi->fh == 0) {
+		return -ENOMEM;
 	}
+	return 0;
+}
 
-	END_WRITE:
-	return (int)size;
+/**
+ * Close a file opened by a1fs_open() or a1fs_create(), placing the data of the
+ * file that delayed allocation buffered and freeing what is left of its
+ * preallocated window.
+ *
+ * Errors: none (FUSE ignores them; the data stays buffered if there is no
+ * space for it)
+ *
+ * @param path  unused.
+ * @param fi    handle to close.
+ * @return      0.
+ */
+static int a1fs_release(const char *path, struct fuse_file_info *fi)
+{
+	(void)path;// unused
+	fs_ctx *fs = get_fs();
+
+	a1fs_handle *handle = handle_get(&fs->handles, fi->fh);
+	if (handle != NULL) {
+		flush_delalloc(fs, handle->ino);
+		release_prealloc(fs, handle->ino);
+	}
+	handle_release(&fs->handles, fi->fh);
+	return 0;
+}
 
+/**
+ * Write out the data of a file.
+ *
+ * Implements the fsync() system call. The image is mapped, so only the data
+ * buffered by delayed allocation has to be placed.
+ *
+ * Errors:
+ *   ENOSPC  not enough free space for the buffered data.
+ *
+ * @param path      path to the file.
+ * @param datasync  unused.
+ * @param fi        handle from a1fs_open() or a1fs_create().
+ * @return          0 on success; -errno on error.
+ */
+static int a1fs_fsync(const char *path, int datasync, struct fuse_file_info *fi)
+{
+	(void)datasync;// unused
+	fs_ctx *fs = get_fs();
+
+	a1fs_handle tmp;
+	return flush_delalloc(fs, get_handle(fs, path, fi, &tmp)->ino);
+}
+
+/**
+ * Open a directory. See a1fs_open().
+ *
+ * Assumptions (already verified by FUSE using getattr() calls):
+ *   "path" exists and is a directory.
+ *
+ * @param path  path to the directory to open.
+ * @param fi    receives the handle in fi->fh.
+ * @return      0 on success; -errno on error.
+ */
+static int a1fs_opendir(const char *path, struct fuse_file_info *fi)
+{
+	return a1fs_open(path, fi);
+}
+
+/** Close a directory opened by a1fs_opendir(). See a1fs_release(). */
+static int a1fs_releasedir(const char *path, struct fuse_file_info *fi)
+{
+	return a1fs_release(path, fi);
 }
 
 
@@ -1238,15 +1188,23 @@ static struct fuse_operations a1fs_ops = {
 	.destroy  = a1fs_destroy,
 	.statfs   = a1fs_statfs,
 	.getattr  = a1fs_getattr,
+	.fgetattr = a1fs_fgetattr,
+	.opendir  = a1fs_opendir,
 	.readdir  = a1fs_readdir,
+	.releasedir = a1fs_releasedir,
 	.mkdir    = a1fs_mkdir,
 	.rmdir    = a1fs_rmdir,
 	.create   = a1fs_create,
 	.unlink   = a1fs_unlink,
 	.utimens  = a1fs_utimens,
 	.truncate = a1fs_truncate,
+	.ftruncate = a1fs_ftruncate,
+	.open     = a1fs_open,
+	.release  = a1fs_release,
+	.fsync    = a1fs_fsync,
 	.read     = a1fs_read,
 	.write    = a1fs_write,
+	.fallocate = a1fs_fallocate,
 };
 
 int main(int argc, char *argv[])
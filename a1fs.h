@@ -83,24 +83,146 @@ typedef struct a1fs_superblock {
 	// inode number of the root directory
 	a1fs_ino_t root_directory_inode;
 
+	/** A1FS_FEATURE_* flags chosen by mkfs */
+	uint32_t features;
+
+	/** Number of allocation groups; 1 without A1FS_FEATURE_GROUPS */
+	uint32_t num_groups;
+
+	/** Number of data blocks in a group (the last one may have fewer) */
+	uint32_t blocks_per_group;
+
+	/** Number of inodes in a group (the last ones may have fewer, or none) */
+	uint32_t inodes_per_group;
+
+	/** Length of the group descriptor table, right after the superblock */
+	uint32_t group_table_length;
+
+	/** Blocks written to one device of the array before the next; 0 without A1FS_FEATURE_STRIPE */
+	uint32_t stripe_unit;
+
+	/** Blocks in a full stripe over all the devices, a multiple of stripe_unit */
+	uint32_t stripe_width;
+
+	/** Blocks the image file grows by at a time; 0 without A1FS_FEATURE_THIN */
+	uint32_t thin_chunk;
 
 } a1fs_superblock;
 
+/** Directories use variable length entries (a1fs_dirent) instead of a1fs_dentry. */
+#define A1FS_FEATURE_VARDIR 0x1
+/** The image is divided into allocation groups (see a1fs_group_desc). */
+#define A1FS_FEATURE_GROUPS 0x2
+/**
+ * The image is on a striped device (RAID, or an SSD with large erase units).
+ * The data blocks (and allocation groups) start on a full stripe, and large
+ * files get extents that start on a stripe unit.
+ */
+#define A1FS_FEATURE_STRIPE 0x4
+/**
+ * The image is thin-provisioned: size is the most it can grow to, and the
+ * image file only has the metadata and the data blocks up to the highest
+ * one allocated so far, rounded up to thin_chunk. It grows as blocks past
+ * its end are allocated, which are taken from the lowest free ones first.
+ */
+#define A1FS_FEATURE_THIN 0x8
+
 // Superblock must fit into a single block
 static_assert(sizeof(a1fs_superblock) <= A1FS_BLOCK_SIZE,
               "superblock is too large");
 
 
+/**
+ * Allocation groups.
+ *
+ * With A1FS_FEATURE_GROUPS, group g has the data blocks from
+ * g * blocks_per_group and the inodes from g * inodes_per_group on, and its
+ * own free counts in the g-th descriptor of the group table. Both numbers are
+ * multiples of 64, so that each group has its own words of the bitmaps and its
+ * blocks and inodes can be allocated without touching any other group. The
+ * superblock keeps the totals of all groups.
+ */
+typedef struct a1fs_group_desc {
+	/** Number of free data blocks in the group. */
+	uint32_t free_blocks;
+	/** Number of free inodes in the group. */
+	uint32_t free_inodes;
+	/** Number of directories in the group. */
+	uint32_t used_dirs;
+	uint32_t padding;
+} a1fs_group_desc;
+
+/** Number of group descriptors in a block of the group table. */
+#define A1FS_GROUP_DESCS_PER_BLOCK (A1FS_BLOCK_SIZE / sizeof(a1fs_group_desc))
+
+/** The number of data blocks and inodes in a group must be a multiple of this. */
+#define A1FS_GROUP_ALIGN 64
+
+
 /** Extent - a contiguous range of blocks. */
 typedef struct a1fs_extent {
+	/** First block of the file that the extent maps. */
+	a1fs_blk_t logical;
 	/** Starting block of the extent. */
 	a1fs_blk_t start;
 	/** Number of blocks in the extent. */
 	a1fs_blk_t count;
+	/** A1FS_EXTENT_* flags */
+	uint32_t flags;
 } a1fs_extent;
 
-/** maximum number of extents per file/directory */
-#define A1FS_MAX_EXT_NUM 512
+/**
+ * The blocks of the extent are allocated but were never written (e.g. by
+ * fallocate()), so they read as zeros whatever they hold.
+ */
+#define A1FS_EXTENT_UNWRITTEN 0x1
+
+/**
+ * Header of a node of the extent tree of a file or directory.
+ *
+ * The extents are kept in a B+tree ordered by their logical blocks. The root
+ * node is in the inode; all the others take a block each. A node is followed
+ * by its entries: a1fs_extent records in a leaf (depth 0), and
+ * a1fs_extent_index records, one per child node, in an internal node.
+ */
+typedef struct a1fs_extent_header {
+	/** Number of entries in the node. */
+	uint16_t count;
+	/** Number of entries that fit in the node. */
+	uint16_t max;
+	/** Height of the node above the leaves. */
+	uint16_t depth;
+	uint16_t padding;
+} a1fs_extent_header;
+
+/** Entry of an internal node of the extent tree. */
+typedef struct a1fs_extent_index {
+	/** First logical block of the child; no extent of the child starts before it. */
+	a1fs_blk_t logical;
+	/** Block that holds the child node. */
+	a1fs_blk_t child;
+} a1fs_extent_index;
+
+/** Number of leaf entries in a node block. */
+#define A1FS_EXTENT_LEAF_MAX \
+	((A1FS_BLOCK_SIZE - sizeof(a1fs_extent_header)) / sizeof(a1fs_extent))
+/** Number of internal node entries in a node block. */
+#define A1FS_EXTENT_INDEX_MAX \
+	((A1FS_BLOCK_SIZE - sizeof(a1fs_extent_header)) / sizeof(a1fs_extent_index))
+
+/**
+ * Size of the inline data area of an inode, so that the inode is 256 bytes.
+ * Files up to this size, and directories whose entries fit in it (only with
+ * A1FS_FEATURE_VARDIR, since an a1fs_dentry is larger), take no blocks.
+ */
+#define A1FS_INLINE_DATA_SIZE 192
+
+/** Number of leaf entries in the root node, in the inode. */
+#define A1FS_INODE_EXTENT_LEAF_MAX \
+	((A1FS_INLINE_DATA_SIZE - sizeof(a1fs_extent_header)) / sizeof(a1fs_extent))
+/** Number of internal node entries in the root node, in the inode. */
+#define A1FS_INODE_EXTENT_INDEX_MAX \
+	((A1FS_INLINE_DATA_SIZE - sizeof(a1fs_extent_header)) / sizeof(a1fs_extent_index))
 
 /** a1fs inode. */
 typedef struct a1fs_inode {
@@ -136,23 +258,52 @@ typedef struct a1fs_inode {
 	uint32_t extent_num;
 
 
-	/** Single Indirect Block */
-	uint64_t indirect_pt; // points to one data block(512 extent structs: 512 * 8 = 4096)
-//	a1fs_ino_t indirect_pt_2;
+	/** Number of blocks taken by the nodes of the extent tree */
+	uint32_t extent_blocks;
 
 	/** Number of directory entries */
     uint32_t num_dir_entry; // 0 if mode is a regular file or empty directory
 
+	/** A1FS_INODE_* flags */
+	uint32_t flags;
+
+	/** Root block of the hashed index, if A1FS_INODE_DIR_INDEX is set */
+	a1fs_blk_t dir_index;
+
+	/** No a1fs_dentry slot before this one is unused (only a hint) */
+	uint32_t dir_free_slot;
+
 	// NOTE: You might have to add padding (e.g. a dummy char array field)
 	// at the end of the struct in order to satisfy the assertion below.
 	// Try to keep the size of this struct minimal, but don't worry about
 	// the "wasted space" introduced by the required padding.
-    char padding[8];
+	uint32_t padding[2];
+
+	union {
+		/**
+		 * Contents of a small file, or the a1fs_dirent records of a small
+		 * directory, if A1FS_INODE_INLINE_DATA is set. The file then has no
+		 * blocks at all.
+		 */
+		char inline_data[A1FS_INLINE_DATA_SIZE];
+
+		/**
+		 * Root node of the extent tree, followed by its entries. Only
+		 * valid if extent_num is not 0.
+		 */
+		a1fs_extent_header extent_root;
+	};
 
 } a1fs_inode;
 
+/** The directory has a hashed index (see a1fs_dx_root). */
+#define A1FS_INODE_DIR_INDEX 0x1
+/** The contents are stored in inline_data instead of extents. */
+#define A1FS_INODE_INLINE_DATA 0x2
+
 // A single block must fit an integral number of inodes
 static_assert(A1FS_BLOCK_SIZE % sizeof(a1fs_inode) == 0, "invalid inode size");
+static_assert(sizeof(a1fs_inode) == 256, "invalid inode size");
 
 
 /** Maximum file name (path component) length. Includes the null terminator. */
@@ -165,9 +316,101 @@ static_assert(A1FS_BLOCK_SIZE % sizeof(a1fs_inode) == 0, "invalid inode size");
 typedef struct a1fs_dentry {
 	/** Inode number. */
 	a1fs_ino_t ino;
-	/** File name. A null-terminated string. */
+	/**
+	 * File name. A null-terminated string. An empty name marks an unused
+	 * slot: entries are never moved, so that a slot can be used to resume
+	 * readdir().
+	 */
 	char name[A1FS_NAME_MAX];
 
 } a1fs_dentry;
 
 static_assert(sizeof(a1fs_dentry) == 256, "invalid dentry size");
+
+/** Number of fixed size directory entries in a block. */
+#define A1FS_DENTRIES_PER_BLOCK (A1FS_BLOCK_SIZE / sizeof(a1fs_dentry))
+
+/**
+ * Variable length directory entry, used if A1FS_FEATURE_VARDIR is set.
+ *
+ * The records of a directory block cover the whole block: each record's
+ * rec_len is the distance to the next one, and the last record extends to the
+ * end of the block. A removed record is merged into the previous one, or
+ * marked unused (name_len == 0) if it is the first record in the block.
+ */
+typedef struct a1fs_dirent {
+	/** Inode number. */
+	a1fs_ino_t ino;
+	/** Length of this record in bytes, including any unused space after it. */
+	uint16_t rec_len;
+	/** Length of the name, not including the null terminator; 0 if unused. */
+	uint8_t name_len;
+	uint8_t padding;
+	/** File name. A null-terminated string. */
+	char name[];
+
+} a1fs_dirent;
+
+/** Space needed for a record with a name of the given length (4-byte aligned). */
+#define A1FS_DIRENT_SIZE(name_len) ((sizeof(a1fs_dirent) + (name_len) + 1 + 3) & ~3u)
+
+
+/**
+ * Hashed directory index.
+ *
+ * Once a directory has A1FS_DX_THRESHOLD entries, every entry is also recorded
+ * in a hash table of (name hash, slot) pairs, where the slot is the position
+ * of the dentry in the directory. The table has num_buckets buckets of one
+ * block each; bucket b is found through the map block map[b / 1024]. A lookup
+ * reads the root, one map block, one bucket and the matching dentry block(s),
+ * regardless of the directory size. The dentries themselves stay in the usual
+ * linear layout, so readdir does not use the index at all.
+ */
+
+/** Number of entries at which a directory gets a hashed index. */
+#define A1FS_DX_THRESHOLD 128
+
+/** Number of bucket block numbers in a map block. */
+#define A1FS_DX_MAP_ENTRIES (A1FS_BLOCK_SIZE / sizeof(a1fs_blk_t))
+
+/** Maximum number of map blocks. */
+#define A1FS_DX_MAX_MAP_BLOCKS 1022
+
+/** Root block of a directory index. */
+typedef struct a1fs_dx_root {
+	/** Number of buckets; always a power of 2. */
+	uint32_t num_buckets;
+	/** Number of map blocks in use. */
+	uint32_t num_map_blocks;
+	/** Map blocks, each holding A1FS_DX_MAP_ENTRIES bucket block numbers. */
+	a1fs_blk_t map[A1FS_DX_MAX_MAP_BLOCKS];
+
+} a1fs_dx_root;
+
+static_assert(sizeof(a1fs_dx_root) == A1FS_BLOCK_SIZE, "invalid dx root size");
+
+/** A single index entry. */
+typedef struct a1fs_dx_entry {
+	/** Hash of the entry name. */
+	uint32_t hash;
+	/**
+	 * Position of the dentry in the directory: the index of the a1fs_dentry,
+	 * or the byte offset of the a1fs_dirent with A1FS_FEATURE_VARDIR.
+	 */
+	uint32_t slot;
+
+} a1fs_dx_entry;
+
+/** Number of entries in a bucket block. */
+#define A1FS_DX_BUCKET_ENTRIES 511
+
+/** A bucket block of a directory index. */
+typedef struct a1fs_dx_bucket {
+	/** Number of entries in use. */
+	uint32_t count;
+	uint32_t padding;
+	a1fs_dx_entry entries[A1FS_DX_BUCKET_ENTRIES];
+
+} a1fs_dx_bucket;
+
+static_assert(sizeof(a1fs_dx_bucket) == A1FS_BLOCK_SIZE, "invalid dx bucket size");
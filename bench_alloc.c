@@ -0,0 +1,133 @@
+//
+// Inode and block allocation latency on a nearly full image.
+//
+// Usage: ./bench_alloc <directory> [operations] [percent full]
+//
+// Fills the file system with 96-block files until it is 95% full (by
+// statvfs()), truncates every tenth one by a block so that the free space is
+// spread over the whole image, then times creating empty files (one inode
+// allocation each) and appending a block to each of them (one block
+// allocation each). The image should be otherwise empty, and large (several
+// GiB) for the allocation cost to show.
+//
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BLOCK 4096
+#define FILL_BLOCKS 96
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void report(const char *what, double *lat, int n) {
+    double sum = 0;
+    qsort(lat, n, sizeof(*lat), cmp_double);
+    for (int i = 0; i < n; i++) {
+        sum += lat[i];
+    }
+    printf("%-8s %8d ops  mean %8.1f us  p50 %8.1f us  p99 %8.1f us  max %8.1f us\n", what, n,
+           sum / n * 1e6, lat[n / 2] * 1e6, lat[n * 99 / 100] * 1e6, lat[n - 1] * 1e6);
+}
+
+static double used_percent(const char *dir) {
+    struct statvfs sv;
+    if (statvfs(dir, &sv) == -1) {
+        perror(dir);
+        exit(1);
+    }
+    return 100.0 - 100.0 * sv.f_bfree / sv.f_blocks;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <directory> [operations] [percent full]\n", argv[0]);
+        return 1;
+    }
+    const char *dir = argv[1];
+    int ops = argc > 2 ? atoi(argv[2]) : 10000;
+    double full = argc > 3 ? atof(argv[3]) : 95.0;
+    char path[4096 + 32], buf[BLOCK];
+    double *lat = malloc(ops * sizeof(*lat));
+    if (lat == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    memset(buf, 'x', BLOCK);
+
+    snprintf(path, sizeof(path), "%s/fill", dir);
+    mkdir(path, 0755);
+    int files = 0;
+    while (used_percent(dir) < full) {
+        snprintf(path, sizeof(path), "%s/fill/f%d", dir, files++);
+        int fd = open(path, O_CREAT | O_WRONLY, 0644);
+        if (fd == -1) {
+            perror(path);
+            return 1;
+        }
+        for (int b = 0; b < FILL_BLOCKS; b++) {
+            if (pwrite(fd, buf, BLOCK, (off_t) b * BLOCK) != BLOCK) {
+                perror(path);
+                return 1;
+            }
+        }
+        close(fd);
+    }
+    for (int i = 0; i < files; i += 10) {
+        snprintf(path, sizeof(path), "%s/fill/f%d", dir, i);
+        if (truncate(path, (off_t) (FILL_BLOCKS - 1) * BLOCK) == -1) {
+            perror(path);
+            return 1;
+        }
+    }
+    printf("%.1f%% full with %d files\n", used_percent(dir), files);
+
+    snprintf(path, sizeof(path), "%s/new", dir);
+    mkdir(path, 0755);
+    for (int i = 0; i < ops; i++) {
+        snprintf(path, sizeof(path), "%s/new/n%d", dir, i);
+        double start = now_s();
+        int fd = open(path, O_CREAT | O_EXCL | O_WRONLY, 0644);
+        lat[i] = now_s() - start;
+        if (fd == -1) {
+            perror(path);
+            return 1;
+        }
+        close(fd);
+    }
+    report("create", lat, ops);
+
+    // the first block of a file may be inline, so the appended one is the second
+    for (int i = 0; i < ops; i++) {
+        snprintf(path, sizeof(path), "%s/new/n%d", dir, i);
+        int fd = open(path, O_WRONLY);
+        if (fd == -1 || pwrite(fd, buf, BLOCK, 0) != BLOCK) {
+            perror(path);
+            return 1;
+        }
+        double start = now_s();
+        if (pwrite(fd, buf, BLOCK, BLOCK) != BLOCK) {
+            perror(path);
+            return 1;
+        }
+        lat[i] = now_s() - start;
+        close(fd);
+    }
+    report("append", lat, ops);
+    free(lat);
+    return 0;
+}
@@ -0,0 +1,150 @@
+//
+// Bitmap range operations against the single-bit helpers.
+//
+// Usage: gcc -O2 bench_bitmap.c bitmap.c -o bench_bitmap && ./bench_bitmap [bits] [rounds]
+//
+// On an in-memory bitmap of 4 GiB worth of blocks (by default), times
+// freeing and allocating the 262144 blocks of a 1 GiB extent, counting the
+// free bits of the whole bitmap, and finding a run of 4096 free bits past a
+// region where every 64th bit is used: with set_bitmap()/unset_bitmap()/
+// is_bit_set() one bit at a time, then with the range operations on plain
+// 64-bit words and with AVX2 (if the CPU has it).
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bitmap.h"
+
+#define EXTENT (1u << 18)
+#define RUN 4096
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint32_t size;
+static unsigned char *bits;
+static uint32_t available;
+static bitmap bm;
+
+// A full bitmap but for the extent at the start and a run at the end, with
+// free bits between used ones in between.
+static void reset(void) {
+    bitmap_destroy(&bm);
+    memset(bits, 0xff, size / 8);
+    memset(bits, 0, EXTENT / 8);
+    for (uint32_t i = EXTENT; i < size - 2 * RUN; i += 64) {
+        memset(bits + i / 8, 0xff, 8);
+        bits[i / 8] = 0xfe;
+    }
+    memset(bits + (size - 2 * RUN) / 8, 0, 2 * RUN / 8);
+    available = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        available += !(bits[i / 8] >> (i % 8) & 1);
+    }
+    if (!bitmap_init(&bm, bits, size, &available)) {
+        perror("bitmap_init");
+        exit(1);
+    }
+}
+
+static uint32_t bitwise_count(void) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        n += !is_bit_set(i, &bm);
+    }
+    return n;
+}
+
+static uint32_t bitwise_find_run(void) {
+    uint32_t run = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        run = is_bit_set(i, &bm) ? 0 : run + 1;
+        if (run == RUN) {
+            return i + 1 - RUN;
+        }
+    }
+    return UINT32_MAX;
+}
+
+// Time each operation over the given number of rounds, with or without the
+// range operations. Every round frees and sets the extent, so the bitmap is
+// the same at the start of the next one.
+static void run(const char *name, int rounds, int ranges) {
+    double t_free = 0, t_set = 0, t_count = 0, t_find = 0;
+    uint32_t expect_run = size - 2 * RUN;
+    for (int r = 0; r < rounds; r++) {
+        double t = now_ns();
+        if (ranges) {
+            bitmap_set_range(&bm, 0, EXTENT);
+        } else {
+            for (uint32_t i = 0; i < EXTENT; i++) {
+                set_bitmap(&bm, i);
+            }
+        }
+        t_set += now_ns() - t;
+
+        t = now_ns();
+        uint32_t found = ranges ? bitmap_find_free_run(&bm, RUN) : bitwise_find_run();
+        t_find += now_ns() - t;
+        if (found != expect_run) {
+            fprintf(stderr, "%s: found the run at %u, not %u\n", name, found, expect_run);
+            exit(1);
+        }
+
+        t = now_ns();
+        if (ranges) {
+            bitmap_clear_range(&bm, 0, EXTENT);
+        } else {
+            for (uint32_t i = 0; i < EXTENT; i++) {
+                unset_bitmap(&bm, i);
+            }
+        }
+        t_free += now_ns() - t;
+
+        t = now_ns();
+        uint32_t n = ranges ? bitmap_count_free(&bm, 0, size) : bitwise_count();
+        t_count += now_ns() - t;
+        if (n != available) {
+            fprintf(stderr, "%s: counted %u free bits, not %u\n", name, n, available);
+            exit(1);
+        }
+    }
+    printf("%-10s %12.0f %12.0f %12.0f %12.0f\n", name, t_free / rounds, t_set / rounds,
+           t_count / rounds, t_find / rounds);
+}
+
+int main(int argc, char *argv[]) {
+    size = argc > 1 ? (uint32_t) atol(argv[1]) : 1u << 20;
+    int rounds = argc > 2 ? atoi(argv[2]) : 20;
+    size = size / 64 * 64;
+    if (size < EXTENT + 4 * RUN) {
+        fprintf(stderr, "need at least %u bits\n", EXTENT + 4 * RUN);
+        return 1;
+    }
+    bits = malloc(size / 8);
+    if (bits == NULL) {
+        perror("malloc");
+        return 1;
+    }
+
+    printf("%u bits, %u-bit extent, %u-bit run, ns per operation\n", size, EXTENT, RUN);
+    printf("%-10s %12s %12s %12s %12s\n", "", "free", "allocate", "count", "find run");
+    bitmap_use_avx2(false);
+    reset();
+    run("bit", rounds, 0);
+    reset();
+    run("word", rounds, 1);
+    if (bitmap_use_avx2(true)) {
+        reset();
+        run("avx2", rounds, 1);
+    }
+    bitmap_destroy(&bm);
+    free(bits);
+    return 0;
+}
@@ -0,0 +1,142 @@
+//
+// Extents of large files written among small files and directories.
+//
+// Usage: ./bench_classes <directory> <image> [large files] [rounds]
+//
+// Appends 64 KiB to each of the large files in turn, a block at a time, and
+// after each round creates 8 small files (1 to 8 blocks) spread over 16
+// directories and deletes every other small file of the round before last,
+// so that the large files grow among directory blocks, extent tree nodes and
+// the small files and the holes they leave behind. Then writes as many large
+// files again, one after another, into what is left. Maps the image (the
+// mounted file system keeps it mapped shared, so this sees the current
+// contents; mount without -o delalloc) and reports the number of extents of
+// the large files of both kinds, from their inodes.
+//
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "a1fs.h"
+
+#define BLOCK 4096
+#define CHUNK 16
+#define DIRS 16
+#define SMALL 8
+
+static char buf[BLOCK];
+
+static void append(int fd, const char *path, int blocks) {
+    for (int b = 0; b < blocks; b++) {
+        if (write(fd, buf, BLOCK) != BLOCK) {
+            perror(path);
+            exit(1);
+        }
+    }
+}
+
+static int create(const char *path) {
+    int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd == -1) {
+        perror(path);
+        exit(1);
+    }
+    return fd;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <directory> <image> [large files] [rounds]\n", argv[0]);
+        return 1;
+    }
+    const char *dir = argv[1];
+    int large = argc > 3 ? atoi(argv[3]) : 4;
+    int rounds = argc > 4 ? atoi(argv[4]) : 256;
+    if (large < 1 || large > 64 || rounds < 1) {
+        fprintf(stderr, "Usage: %s <directory> <image> [large files (1-64)] [rounds]\n", argv[0]);
+        return 1;
+    }
+    memset(buf, 'c', BLOCK);
+    srand(369);
+
+    char path[4096 + 64];
+    for (int d = 0; d < DIRS; d++) {
+        snprintf(path, sizeof(path), "%s/d%d", dir, d);
+        if (mkdir(path, 0755) == -1) {
+            perror(path);
+            return 1;
+        }
+    }
+    int fds[64];
+    for (int l = 0; l < large; l++) {
+        snprintf(path, sizeof(path), "%s/interleaved%d", dir, l);
+        fds[l] = create(path);
+    }
+    for (int r = 0; r < rounds; r++) {
+        for (int l = 0; l < large; l++) {
+            append(fds[l], "large file", CHUNK);
+        }
+        for (int s = 0; s < SMALL; s++) {
+            snprintf(path, sizeof(path), "%s/d%d/s%d-%d", dir, r % DIRS, r, s);
+            int fd = create(path);
+            append(fd, path, 1 + rand() % 8);
+            close(fd);
+        }
+        for (int s = 1; r >= 2 && s < SMALL; s += 2) {
+            snprintf(path, sizeof(path), "%s/d%d/s%d-%d", dir, (r - 2) % DIRS, r - 2, s);
+            unlink(path);
+        }
+    }
+    for (int l = 0; l < large; l++) {
+        close(fds[l]);
+    }
+    for (int l = 0; l < large; l++) {
+        snprintf(path, sizeof(path), "%s/later%d", dir, l);
+        int fd = create(path);
+        append(fd, path, rounds * CHUNK);
+        close(fd);
+    }
+
+    int fd = open(argv[2], O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        perror(argv[2]);
+        return 1;
+    }
+    size_t image_size = (size_t) st.st_size;
+    void *image = mmap(NULL, image_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (image == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    const a1fs_superblock *sb = image;
+    size_t group_table_length = (sb->features & A1FS_FEATURE_GROUPS) ? sb->group_table_length : 0;
+    const a1fs_inode *inodes = (const a1fs_inode *) ((const char *) image + A1FS_BLOCK_SIZE
+            * (1 + group_table_length + sb->inode_bitmap_length + sb->data_bitmap_length));
+
+    const char *kinds[] = {"interleaved", "later"};
+    for (int k = 0; k < 2; k++) {
+        long extents = 0, max = 0;
+        for (int l = 0; l < large; l++) {
+            snprintf(path, sizeof(path), "%s/%s%d", dir, kinds[k], l);
+            // the inode number seen through the mount is a1fs's plus one
+            if (stat(path, &st) == -1) {
+                perror(path);
+                return 1;
+            }
+            long n = inodes[st.st_ino - 1].extent_num;
+            extents += n;
+            max = n > max ? n : max;
+        }
+        printf("%d %s files of %d KiB: %.1f extents per file (max %ld)\n",
+               large, kinds[k], rounds * CHUNK * BLOCK / 1024, (double) extents / large, max);
+    }
+    munmap(image, image_size);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,95 @@
+//
+// Space the image takes on the host after files are created and deleted, and
+// the time to delete them.
+//
+// Usage: ./bench_discard <directory> <image> [rounds] [files per round]
+//
+// Each round creates the given number of files (100 by default) of 4 KiB to
+// 256 KiB in the mounted file system and deletes them again, timing each
+// unlink(). Reports the mean and worst unlink() time, and the space the image
+// file takes on the host (what `du` shows) before and after, from st_blocks.
+// Mount with and without -o discard (and with -o discard_batch=1 to discard
+// on every free instead of in batches) to compare; holes for the last batch
+// are only punched at unmount. Made with mkfs.a1fs -z, the image takes all its
+// size on the host to start with.
+//
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BLOCK 4096
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long long host_kib(const char *image) {
+    struct stat st;
+    if (stat(image, &st) == -1) {
+        perror(image);
+        exit(1);
+    }
+    return (long long) st.st_blocks * 512 / 1024;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <directory> <image> [rounds] [files per round]\n", argv[0]);
+        return 1;
+    }
+    const char *dir = argv[1];
+    const char *image = argv[2];
+    int rounds = argc > 3 ? atoi(argv[3]) : 20;
+    int files = argc > 4 ? atoi(argv[4]) : 100;
+    if (rounds < 1 || files < 1) {
+        fprintf(stderr, "Usage: %s <directory> <image> [rounds] [files per round]\n", argv[0]);
+        return 1;
+    }
+    char buf[BLOCK];
+    memset(buf, 'd', BLOCK);
+    srand(369);
+    long long before = host_kib(image);
+
+    char path[4096 + 32];
+    double total = 0, worst = 0;
+    for (int r = 0; r < rounds; r++) {
+        for (int f = 0; f < files; f++) {
+            snprintf(path, sizeof(path), "%s/churn%d", dir, f);
+            int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+            if (fd == -1) {
+                perror(path);
+                return 1;
+            }
+            for (int b = 1 + rand() % 64; b > 0; b--) {
+                if (write(fd, buf, BLOCK) != BLOCK) {
+                    perror(path);
+                    return 1;
+                }
+            }
+            close(fd);
+        }
+        for (int f = 0; f < files; f++) {
+            snprintf(path, sizeof(path), "%s/churn%d", dir, f);
+            double start = now_s();
+            if (unlink(path) == -1) {
+                perror(path);
+                return 1;
+            }
+            double t = now_s() - start;
+            total += t;
+            worst = t > worst ? t : worst;
+        }
+    }
+
+    printf("%d rounds of %d files: unlink %.1f us mean, %.1f us worst; image on the host %lld KiB before, "
+           "%lld KiB after\n", rounds, files, total / ((double) rounds * files) * 1e6, worst * 1e6, before,
+           host_kib(image));
+    return 0;
+}
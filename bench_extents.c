@@ -0,0 +1,120 @@
+//
+// Stress test of files with a very large number of extents.
+//
+// Usage: ./bench_extents <directory> [extents] [reads]
+//
+// Appends a block at a time to two files in turn, so that (with the first-fit
+// allocator) each gets one extent per block, checks every block of one of
+// them, times random 4 KiB reads from it, then truncates it back in steps.
+// The default of 100000 extents needs an image of about 1 GiB. Mount with
+// "-o direct_io" so that every read reaches a1fs instead of the page cache.
+//
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BLOCK 4096
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Every block starts with its own index, so misplaced blocks are caught.
+static int check_block(int fd, long b) {
+    char buf[BLOCK];
+    long got;
+    if (pread(fd, buf, BLOCK, (off_t) b * BLOCK) != BLOCK) {
+        return 0;
+    }
+    memcpy(&got, buf, sizeof(got));
+    return got == b;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <directory> [extents] [reads]\n", argv[0]);
+        return 1;
+    }
+    const char *dir = argv[1];
+    long extents = argc > 2 ? atol(argv[2]) : 100000;
+    long reads = argc > 3 ? atol(argv[3]) : 1000000;
+    char path_a[4096], path_b[4096], buf[BLOCK];
+    struct stat st;
+
+    snprintf(path_a, sizeof(path_a), "%s/extents-a", dir);
+    snprintf(path_b, sizeof(path_b), "%s/extents-b", dir);
+    int fd_a = open(path_a, O_CREAT | O_TRUNC | O_RDWR, 0644);
+    int fd_b = open(path_b, O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if (fd_a == -1 || fd_b == -1) {
+        perror("open");
+        return 1;
+    }
+
+    memset(buf, 'x', BLOCK);
+    double start = now_s();
+    for (long b = 0; b < extents; b++) {
+        memcpy(buf, &b, sizeof(b));
+        if (pwrite(fd_a, buf, BLOCK, (off_t) b * BLOCK) != BLOCK
+            || pwrite(fd_b, buf, BLOCK, (off_t) b * BLOCK) != BLOCK) {
+            fprintf(stderr, "append of block %ld: ", b);
+            perror("pwrite");
+            return 1;
+        }
+    }
+    double elapsed = now_s() - start;
+    printf("append   %9ld extents %9.3f s %9.0f ns/append\n", extents, elapsed, elapsed * 1e9 / (2 * extents));
+    if (fstat(fd_a, &st) == -1) {
+        perror("fstat");
+        return 1;
+    }
+    printf("space    %9ld blocks of data, %ld of extent tree\n", extents, (long) st.st_blocks - extents);
+
+    start = now_s();
+    for (long b = 0; b < extents; b++) {
+        if (!check_block(fd_a, b)) {
+            fprintf(stderr, "bad block %ld\n", b);
+            return 1;
+        }
+    }
+    elapsed = now_s() - start;
+    printf("seqread  %9ld blocks  %9.3f s %9.0f ns/read\n", extents, elapsed, elapsed * 1e9 / extents);
+
+    srand(369);
+    start = now_s();
+    for (long i = 0; i < reads; i++) {
+        long b = ((long) rand() * RAND_MAX + rand()) % extents;
+        if (!check_block(fd_a, b)) {
+            fprintf(stderr, "bad block %ld\n", b);
+            return 1;
+        }
+    }
+    elapsed = now_s() - start;
+    printf("randread %9ld blocks  %9.3f s %9.0f ns/read\n", reads, elapsed, elapsed * 1e9 / reads);
+
+    // shrink in steps, checking the new last block each time
+    start = now_s();
+    for (long n = extents / 2; n > 0; n /= 2) {
+        if (ftruncate(fd_a, (off_t) n * BLOCK) == -1 || !check_block(fd_a, n - 1)) {
+            fprintf(stderr, "truncate to %ld blocks failed\n", n);
+            return 1;
+        }
+    }
+    if (ftruncate(fd_a, 0) == -1 || fstat(fd_a, &st) == -1 || st.st_blocks != 0) {
+        fprintf(stderr, "truncate to 0 failed\n");
+        return 1;
+    }
+    printf("truncate %9ld extents %9.3f s\n", extents, now_s() - start);
+
+    close(fd_a);
+    close(fd_b);
+    unlink(path_a);
+    unlink(path_b);
+    return 0;
+}
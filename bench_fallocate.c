@@ -0,0 +1,91 @@
+//
+// Writing a file that was preallocated with fallocate(), against extending it
+// with the writes.
+//
+// Usage: ./bench_fallocate <directory> [MiB]
+//
+// Writes a file of the given size (64 MiB by default) 4 KiB at a time, twice:
+// once extending it with each write, and once after a single fallocate() of
+// the whole size, which a1fs maps to unwritten extents without zero-filling
+// them. A second file is appended to in turn with the first, as by another
+// program, so that the blocks after the file are not free for it to grow into.
+//
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BLOCK 4096
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Write the file 4 KiB at a time, appending to the other one after each write.
+static int write_file(int fd, int other, off_t size) {
+    char buf[BLOCK];
+    memset(buf, 'x', BLOCK);
+    for (off_t off = 0; off < size; off += BLOCK) {
+        if (pwrite(fd, buf, BLOCK, off) != BLOCK || pwrite(other, buf, BLOCK, off) != BLOCK) {
+            perror("pwrite");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int run(const char *dir, off_t size, int preallocate) {
+    char path[4096 + 32], other_path[4096 + 32];
+    snprintf(path, sizeof(path), "%s/fallocate", dir);
+    snprintf(other_path, sizeof(other_path), "%s/fallocate-other", dir);
+    int fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+    int other = open(other_path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if (fd == -1 || other == -1) {
+        perror("open");
+        return -1;
+    }
+
+    double start = now_s();
+    if (preallocate && fallocate(fd, 0, 0, size) != 0) {
+        perror("fallocate");
+        return -1;
+    }
+    double allocated = now_s();
+    if (write_file(fd, other, size) != 0) {
+        return -1;
+    }
+    double end = now_s();
+
+    struct stat st;
+    fstat(fd, &st);
+    printf("%-22s %8.1f ms (fallocate %6.1f ms), %lld blocks\n",
+           preallocate ? "fallocate, then write" : "write-extend",
+           (end - start) * 1e3, (allocated - start) * 1e3, (long long) st.st_blocks);
+
+    close(fd);
+    close(other);
+    unlink(path);
+    unlink(other_path);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <directory> [MiB]\n", argv[0]);
+        return 1;
+    }
+    const char *dir = argv[1];
+    off_t size = (off_t) (argc > 2 ? atol(argv[2]) : 64) << 20;
+
+    if (run(dir, size, 0) != 0 || run(dir, size, 1) != 0) {
+        return 1;
+    }
+    return 0;
+}
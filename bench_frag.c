@@ -0,0 +1,122 @@
+//
+// Extents per file after a mixed workload of parallel writers.
+//
+// Usage: ./bench_frag <directory> <image> [writers] [files]
+//
+// Forks the given number of writers, each of which writes its files one after
+// another, appending a block at a time, most of them small (up to 256 KiB)
+// and every fourth one up to 8 MiB, and deletes every fourth file again to
+// leave holes behind. The writers run at the same time, so their appends
+// reach a1fs interleaved. Then maps the image (the mounted file system keeps
+// it mapped shared, so this sees the current contents) and reports the
+// number of extents of the files that are left, from their inodes.
+//
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "a1fs.h"
+
+#define BLOCK 4096
+
+static void writer(const char *dir, int w, int files) {
+    char path[4096 + 32], buf[BLOCK];
+    memset(buf, 'w', BLOCK);
+    srand(369 + w);
+    for (int f = 0; f < files; f++) {
+        snprintf(path, sizeof(path), "%s/w%d-%d", dir, w, f);
+        int blocks = 1 + (rand() % 4 ? rand() % 64 : rand() % 2048);
+        int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+        if (fd == -1) {
+            perror(path);
+            exit(1);
+        }
+        for (int b = 0; b < blocks; b++) {
+            if (pwrite(fd, buf, BLOCK, (off_t) b * BLOCK) != BLOCK) {
+                perror(path);
+                exit(1);
+            }
+        }
+        close(fd);
+        if (f % 4 == 3) {
+            unlink(path);
+        }
+    }
+    exit(0);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <directory> <image> [writers] [files]\n", argv[0]);
+        return 1;
+    }
+    const char *dir = argv[1];
+    int writers = argc > 3 ? atoi(argv[3]) : 8;
+    int files = argc > 4 ? atoi(argv[4]) : 40;
+
+    for (int w = 0; w < writers; w++) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            perror("fork");
+            return 1;
+        }
+        if (pid == 0) {
+            writer(dir, w, files);
+        }
+    }
+    int status, failed = 0;
+    while (wait(&status) > 0) {
+        failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    }
+    if (failed) {
+        return 1;
+    }
+
+    int fd = open(argv[2], O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        perror(argv[2]);
+        return 1;
+    }
+    size_t image_size = (size_t) st.st_size;
+    void *image = mmap(NULL, image_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (image == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    const a1fs_superblock *sb = image;
+    size_t group_table_length = (sb->features & A1FS_FEATURE_GROUPS) ? sb->group_table_length : 0;
+    const a1fs_inode *inodes = (const a1fs_inode *) ((const char *) image + A1FS_BLOCK_SIZE
+            * (1 + group_table_length + sb->inode_bitmap_length + sb->data_bitmap_length));
+
+    long count = 0, extents = 0, max = 0, big = 0, big_extents = 0;
+    char path[4096 + 32];
+    for (int w = 0; w < writers; w++) {
+        for (int f = 0; f < files; f++) {
+            snprintf(path, sizeof(path), "%s/w%d-%d", dir, w, f);
+            // the inode number seen through the mount is a1fs's plus one
+            if (stat(path, &st) == -1) {
+                continue;
+            }
+            long n = inodes[st.st_ino - 1].extent_num;
+            count++;
+            extents += n;
+            max = n > max ? n : max;
+            if (st.st_size >= 1 << 20) {
+                big++;
+                big_extents += n;
+            }
+        }
+    }
+    printf("%ld files: %.1f extents per file (max %ld); %ld files of 1 MiB or more: %.1f\n",
+           count, count ? (double) extents / count : 0.0, max, big, big ? (double) big_extents / big : 0.0);
+    munmap(image, image_size);
+    close(fd);
+    return 0;
+}
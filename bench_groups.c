@@ -0,0 +1,178 @@
+//
+// Allocator throughput of threads creating and writing files, with one
+// allocation group and with many.
+//
+// Usage: gcc -O2 -pthread bench_groups.c group.c bitmap.c free_extents.c -o bench_groups
+//        && ./bench_groups [max threads] [files per thread] [blocks per file]
+//
+// The mounted file system is single-threaded, so this drives the allocation
+// groups directly, on in-memory bitmaps of 8 GiB worth of blocks and 256Ki
+// inodes. Each thread has a directory of its own in group (thread % groups),
+// and creates its files in it: it allocates an inode near the directory, then
+// appends the blocks of the file one at a time (after the last one if it is
+// free, else anywhere in the group of the inode, else in the groups after it)
+// and fills a block of memory for each. Every 256 files the thread deletes
+// them again. Reports files per second for 1, 2, 4, ... threads, with a single
+// group (one lock for all) and with groups of 32768 blocks.
+//
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "group.h"
+
+#define BLOCK 4096
+#define NUM_BLOCKS (1u << 21)
+#define NUM_INODES (1u << 18)
+#define BATCH 256
+
+static unsigned char *inode_bits, *data_bits;
+static uint32_t total_free_inodes, total_free_blocks;
+static uint32_t *group_free;
+static alloc_group *groups;
+static uint32_t num_groups, blocks_per_group, inodes_per_group;
+static int files_per_thread, blocks_per_file;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void setup(uint32_t n) {
+    num_groups = n;
+    blocks_per_group = NUM_BLOCKS / n;
+    inodes_per_group = NUM_INODES / n;
+    memset(inode_bits, 0, NUM_INODES / 8);
+    memset(data_bits, 0, NUM_BLOCKS / 8);
+    total_free_inodes = NUM_INODES;
+    total_free_blocks = NUM_BLOCKS;
+    groups = calloc(n, sizeof(*groups));
+    group_free = calloc(2 * n, sizeof(*group_free));
+    for (uint32_t i = 0; i < n; i++) {
+        group_free[2 * i] = inodes_per_group;
+        group_free[2 * i + 1] = blocks_per_group;
+        if (!group_init(&groups[i], inode_bits, i * inodes_per_group, inodes_per_group, &group_free[2 * i],
+                        data_bits, i * blocks_per_group, blocks_per_group, &group_free[2 * i + 1])) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        if (n > 1) {
+            groups[i].total_free_inodes = &total_free_inodes;
+            groups[i].total_free_blocks = &total_free_blocks;
+        }
+    }
+}
+
+static void teardown(void) {
+    for (uint32_t i = 0; i < num_groups; i++) {
+        group_destroy(&groups[i]);
+    }
+    free(groups);
+    free(group_free);
+}
+
+static uint32_t alloc_inode(uint32_t near) {
+    uint32_t first = near / inodes_per_group;
+    for (uint32_t i = 0; i < num_groups; i++) {
+        alloc_group *g = &groups[(first + i) % num_groups];
+        uint32_t ino = group_alloc_inode(g, i == 0 ? near : g->first_inode, false);
+        if (ino != UINT32_MAX) {
+            return ino;
+        }
+    }
+    fprintf(stderr, "out of inodes\n");
+    exit(1);
+}
+
+static uint32_t alloc_block(uint32_t goal, uint32_t ino) {
+    if (goal != UINT32_MAX && goal < NUM_BLOCKS && group_alloc_at(&groups[goal / blocks_per_group], 1, goal) == 1) {
+        return goal;
+    }
+    uint32_t first = ino / inodes_per_group, start;
+    for (uint32_t i = 0; i < num_groups; i++) {
+        alloc_group *g = &groups[(first + i) % num_groups];
+        if (group_alloc_extent(g, 1, i == 0 ? g->first_block : UINT32_MAX, 0, ALLOC_NEXT_FIT, ALLOC_SMALL, &start)) {
+            return start;
+        }
+    }
+    fprintf(stderr, "out of blocks\n");
+    exit(1);
+}
+
+typedef struct file {
+    uint32_t ino;
+    uint32_t blocks[64];
+} file;
+
+static void *worker(void *arg) {
+    uint32_t t = (uint32_t) (uintptr_t) arg;
+    uint32_t dir = (t % num_groups) * inodes_per_group;
+    file *files = malloc(BATCH * sizeof(*files));
+    char *block = malloc(BLOCK);
+    for (int done = 0; done < files_per_thread; done += BATCH) {
+        for (int f = 0; f < BATCH; f++) {
+            files[f].ino = alloc_inode(dir);
+            uint32_t last = UINT32_MAX;
+            for (int b = 0; b < blocks_per_file; b++) {
+                last = files[f].blocks[b] = alloc_block(last == UINT32_MAX ? last : last + 1, files[f].ino);
+                memset(block, (int) b, BLOCK);
+            }
+        }
+        for (int f = 0; f < BATCH; f++) {
+            for (int b = 0; b < blocks_per_file; b++) {
+                uint32_t blk = files[f].blocks[b];
+                group_free_blocks(&groups[blk / blocks_per_group], blk, 1);
+            }
+            group_free_inode(&groups[files[f].ino / inodes_per_group], files[f].ino, false);
+        }
+    }
+    free(block);
+    free(files);
+    return NULL;
+}
+
+static double run(int threads) {
+    pthread_t tid[256];
+    double start = now_s();
+    for (int t = 0; t < threads; t++) {
+        pthread_create(&tid[t], NULL, worker, (void *) (uintptr_t) t);
+    }
+    for (int t = 0; t < threads; t++) {
+        pthread_join(tid[t], NULL);
+    }
+    return (double) threads * files_per_thread / (now_s() - start);
+}
+
+int main(int argc, char *argv[]) {
+    int max_threads = argc > 1 ? atoi(argv[1]) : 8;
+    files_per_thread = argc > 2 ? atoi(argv[2]) : 20480;
+    blocks_per_file = argc > 3 ? atoi(argv[3]) : 16;
+    if (max_threads < 1 || max_threads > 256 || blocks_per_file < 1 || blocks_per_file > 64) {
+        fprintf(stderr, "Usage: %s [max threads (1-256)] [files per thread] [blocks per file (1-64)]\n", argv[0]);
+        return 1;
+    }
+    inode_bits = malloc(NUM_INODES / 8);
+    data_bits = malloc(NUM_BLOCKS / 8);
+    if (inode_bits == NULL || data_bits == NULL) {
+        perror("malloc");
+        return 1;
+    }
+
+    printf("threads  1 group files/s  64 groups files/s\n");
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        setup(1);
+        double one = run(threads);
+        teardown();
+        setup(NUM_BLOCKS / 32768);
+        double many = run(threads);
+        teardown();
+        printf("%7d  %15.0f  %17.0f\n", threads, one, many);
+    }
+    free(inode_bits);
+    free(data_bits);
+    return 0;
+}
@@ -0,0 +1,203 @@
+//
+// Pages of the image touched by a traversal of a subtree, after aging.
+//
+// Usage: gcc -O2 $(pkg-config fuse --cflags) bench_locality.c fs_ctx.c dir_index.c vardir.c
+//            extent_tree.c handle.c dcache.c delalloc.c prealloc.c bitmap.c free_extents.c
+//            group.c discard.c -pthread -o bench_locality
+//        ./bench_locality <directory> <image> [trees] [dirs per tree] [files per dir]
+//
+// Builds the given number of top-level trees of directories and small files
+// (1 to 16 blocks) one file at a time in each tree in turn, as if they were
+// unpacked at the same time, then ages them: three times over, deletes every
+// third file of every tree and creates new ones in their place, again
+// interleaved. Then maps the image (the mounted file system keeps it mapped
+// shared, so this sees the current contents; mount without -o delalloc) and
+// walks each tree as find/tar would, collecting the blocks of the image it
+// reads: the inode table blocks of its inodes, its directory blocks and the
+// data blocks of its files. Reports the distinct pages and the number of
+// contiguous runs they form (about the number of seeks), averaged over the
+// trees.
+//
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fs_ctx.h"
+#include "extent_tree.h"
+
+#define BLOCK 4096
+
+static int trees, dirs, files;
+
+static void make_file(const char *dir, int t, int d, int f, int gen) {
+    char path[4096 + 64], buf[BLOCK];
+    snprintf(path, sizeof(path), "%s/t%d/d%d/f%d", dir, t, d, f);
+    int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd == -1) {
+        perror(path);
+        exit(1);
+    }
+    memset(buf, 'a' + t % 26, BLOCK);
+    int blocks = 1 + (t * 7 + d * 5 + f * 3 + gen) % 16;
+    for (int b = 0; b < blocks; b++) {
+        if (write(fd, buf, BLOCK) != BLOCK) {
+            perror(path);
+            exit(1);
+        }
+    }
+    close(fd);
+}
+
+static void age(const char *dir) {
+    char path[4096 + 64];
+    for (int t = 0; t < trees; t++) {
+        snprintf(path, sizeof(path), "%s/t%d", dir, t);
+        mkdir(path, 0755);
+    }
+    for (int d = 0; d < dirs; d++) {
+        for (int t = 0; t < trees; t++) {
+            snprintf(path, sizeof(path), "%s/t%d/d%d", dir, t, d);
+            mkdir(path, 0755);
+        }
+        for (int f = 0; f < files; f++) {
+            for (int t = 0; t < trees; t++) {
+                make_file(dir, t, d, f, 0);
+            }
+        }
+    }
+    for (int gen = 1; gen <= 3; gen++) {
+        for (int d = 0; d < dirs; d++) {
+            for (int f = gen % 3; f < files; f += 3) {
+                for (int t = 0; t < trees; t++) {
+                    snprintf(path, sizeof(path), "%s/t%d/d%d/f%d", dir, t, d, f);
+                    unlink(path);
+                }
+            }
+        }
+        for (int d = 0; d < dirs; d++) {
+            for (int f = gen % 3; f < files; f += 3) {
+                for (int t = 0; t < trees; t++) {
+                    make_file(dir, t, d, f, gen);
+                }
+            }
+        }
+    }
+}
+
+/** The image pages read by a walk. */
+typedef struct page_set {
+    uint64_t *pages;
+    size_t count;
+    size_t capacity;
+} page_set;
+
+static void add_page(page_set *ps, uint64_t page) {
+    if (ps->count == ps->capacity) {
+        ps->capacity = ps->capacity ? ps->capacity * 2 : 1024;
+        ps->pages = realloc(ps->pages, ps->capacity * sizeof(*ps->pages));
+        if (ps->pages == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    ps->pages[ps->count++] = page;
+}
+
+static fs_ctx fs;
+static page_set walked;
+
+static void add_inode(uint32_t ino) {
+    a1fs_inode *inode = &fs.inode_table[ino];
+    add_page(&walked, (uint64_t) ((char *) inode - (char *) fs.image) / BLOCK);
+    a1fs_extent extent;
+    for (uint32_t block = 0; inode->extent_num > 0 && extent_find(&fs, inode, block, &extent);
+         block = extent.logical + extent.count) {
+        for (uint32_t i = 0; i < extent.count; i++) {
+            add_page(&walked, (get_addr_of_block(&fs, extent.start + i) - (uint64_t) fs.image) / BLOCK);
+        }
+    }
+}
+
+static int walk_entry(void *arg, a1fs_ino_t ino, const char *name, uint32_t slot, uint32_t next);
+
+static void walk(uint32_t ino) {
+    add_inode(ino);
+    if (S_ISDIR(fs.inode_table[ino].mode)) {
+        iterate_dentries(&fs, ino, 0, walk_entry, NULL);
+    }
+}
+
+static int walk_entry(void *arg, a1fs_ino_t ino, const char *name, uint32_t slot, uint32_t next) {
+    (void) arg;
+    (void) name;
+    (void) slot;
+    (void) next;
+    walk(ino);
+    return 0;
+}
+
+static int cmp_page(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <directory> <image> [trees] [dirs per tree] [files per dir]\n", argv[0]);
+        return 1;
+    }
+    trees = argc > 3 ? atoi(argv[3]) : 8;
+    dirs = argc > 4 ? atoi(argv[4]) : 8;
+    files = argc > 5 ? atoi(argv[5]) : 32;
+    age(argv[1]);
+
+    int fd = open(argv[2], O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        perror(argv[2]);
+        return 1;
+    }
+    void *image = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (image == MAP_FAILED || !fs_ctx_init(&fs, image, (size_t) st.st_size)) {
+        fprintf(stderr, "%s: can't map the image\n", argv[2]);
+        return 1;
+    }
+
+    double pages = 0, runs = 0;
+    for (int t = 0; t < trees; t++) {
+        char name[32];
+        snprintf(name, sizeof(name), "t%d", t);
+        int ino = find_dentry(&fs, ROOT_INODE, name);
+        if (ino < 0) {
+            fprintf(stderr, "%s: not found in the image\n", name);
+            return 1;
+        }
+        walked.count = 0;
+        walk((uint32_t) ino);
+        qsort(walked.pages, walked.count, sizeof(uint64_t), cmp_page);
+        size_t distinct = 0, contiguous = 0;
+        for (size_t i = 0; i < walked.count; i++) {
+            if (i > 0 && walked.pages[i] == walked.pages[i - 1]) {
+                continue;
+            }
+            if (distinct == 0 || walked.pages[i] != walked.pages[i - 1] + 1) {
+                contiguous++;
+            }
+            distinct++;
+        }
+        pages += distinct;
+        runs += contiguous;
+    }
+    printf("%d trees of %d files: %.0f pages per tree, in %.0f runs\n",
+           trees, dirs * files, pages / trees, runs / trees);
+    free(walked.pages);
+    fs_ctx_destroy(&fs);
+    munmap(image, (size_t) st.st_size);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,100 @@
+//
+// Lookup latency against directory depth and width.
+//
+// Usage: ./bench_lookup <mountpoint> [iterations]
+//
+// Mount with "-o entry_timeout=0,negative_timeout=0,attr_timeout=0" so that
+// every stat() reaches a1fs_getattr() instead of the kernel's own caches.
+// The dentry cache hit/miss counters are printed by a1fs when unmounted.
+//
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Build <root>/d0/d1/.../d{depth-1}, with width files in every directory.
+static void build(const char *root, int depth, int width, char *deepest) {
+    char path[2048];
+    strcpy(path, root);
+    for (int d = 0; d < depth; d++) {
+        sprintf(path + strlen(path), "/d%d", d);
+        if (mkdir(path, 0755) == -1) {
+            perror(path);
+            exit(1);
+        }
+        for (int w = 0; w < width; w++) {
+            char file[4096];
+            snprintf(file, sizeof(file), "%s/f%d", path, w);
+            int fd = open(file, O_CREAT | O_WRONLY, 0644);
+            if (fd == -1) {
+                perror(file);
+                exit(1);
+            }
+            close(fd);
+        }
+    }
+    strcpy(deepest, path);
+}
+
+static void destroy(const char *root, int depth, int width) {
+    char path[2048];
+    for (int d = depth; d > 0; d--) {
+        strcpy(path, root);
+        for (int i = 0; i < d; i++) {
+            sprintf(path + strlen(path), "/d%d", i);
+        }
+        for (int w = 0; w < width; w++) {
+            char file[4096];
+            snprintf(file, sizeof(file), "%s/f%d", path, w);
+            unlink(file);
+        }
+        rmdir(path);
+    }
+}
+
+// Average latency of stat() on the given path, in nanoseconds.
+static double time_stat(const char *path, int iterations) {
+    struct stat st;
+    double start = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        stat(path, &st);
+    }
+    return (now_ns() - start) / iterations;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <mountpoint> [iterations]\n", argv[0]);
+        return 1;
+    }
+    const char *root = argv[1];
+    int iterations = argc > 2 ? atoi(argv[2]) : 10000;
+
+    int depths[] = {1, 4, 16};
+    int widths[] = {16, 256, 1024};
+
+    printf("%6s %6s %14s %14s\n", "depth", "width", "hit (ns)", "missing (ns)");
+    for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); i++) {
+        for (size_t j = 0; j < sizeof(widths) / sizeof(widths[0]); j++) {
+            char deepest[2048], target[4096], missing[4096];
+            build(root, depths[i], widths[j], deepest);
+            // the last file in the last directory is the worst case for a scan
+            snprintf(target, sizeof(target), "%s/f%d", deepest, widths[j] - 1);
+            snprintf(missing, sizeof(missing), "%s/nonexistent", deepest);
+            printf("%6d %6d %14.0f %14.0f\n", depths[i], widths[j],
+                   time_stat(target, iterations), time_stat(missing, iterations));
+            destroy(root, depths[i], widths[j]);
+        }
+    }
+    return 0;
+}
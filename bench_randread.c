@@ -0,0 +1,84 @@
+//
+// Random 4 KiB read latency against the number of extents of a file.
+//
+// Usage: ./bench_randread <directory> [reads]
+//
+// For 1, 2, 4, ... 512 extents, writes a 512-block file in that many chunks,
+// alternating with a second file so that (with the first-fit allocator) every
+// chunk becomes an extent of its own, then reads random 4 KiB blocks from it.
+// Mount with "-o direct_io", or every read after the first one of a block is
+// served from the page cache without reaching a1fs.
+//
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BLOCK 4096
+#define FILE_BLOCKS 512
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Write both files in extents chunks each, taking turns.
+static void write_fragmented(int fd, int other, int extents) {
+    char buf[BLOCK];
+    int chunk = FILE_BLOCKS / extents;
+    for (int b = 0; b < FILE_BLOCKS; b++) {
+        memset(buf, b & 0xff, BLOCK);
+        if (pwrite(fd, buf, BLOCK, (off_t) b * BLOCK) != BLOCK) {
+            perror("pwrite");
+            exit(1);
+        }
+        if (b % chunk == chunk - 1 && pwrite(other, buf, BLOCK, (off_t) (b / chunk) * BLOCK) != BLOCK) {
+            perror("pwrite");
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <directory> [reads]\n", argv[0]);
+        return 1;
+    }
+    const char *dir = argv[1];
+    long reads = argc > 2 ? atol(argv[2]) : 100000;
+    char path[4096], other_path[4096], buf[BLOCK];
+    snprintf(path, sizeof(path), "%s/randread", dir);
+    snprintf(other_path, sizeof(other_path), "%s/randread-other", dir);
+
+    printf("%8s %12s\n", "extents", "ns/read");
+    for (int extents = 1; extents <= FILE_BLOCKS; extents *= 2) {
+        int fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+        int other = open(other_path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+        if (fd == -1 || other == -1) {
+            perror("open");
+            return 1;
+        }
+        write_fragmented(fd, other, extents);
+
+        srand(369);
+        double start = now_ns();
+        for (long i = 0; i < reads; i++) {
+            long b = rand() % FILE_BLOCKS;
+            if (pread(fd, buf, BLOCK, b * BLOCK) != BLOCK || buf[0] != (char) (b & 0xff)) {
+                fprintf(stderr, "bad read of block %ld\n", b);
+                return 1;
+            }
+        }
+        printf("%8d %12.0f\n", extents, (now_ns() - start) / reads);
+
+        close(fd);
+        close(other);
+        unlink(path);
+        unlink(other_path);
+    }
+    return 0;
+}
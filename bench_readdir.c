@@ -0,0 +1,90 @@
+//
+// Directory scan cost with typical (10-30 character) names.
+//
+// Usage: ./bench_readdir <directory> [entries] [passes]
+//
+// Run it once on an image formatted with "mkfs.a1fs -V" and once without, and
+// compare the times. To compare cache misses, run the a1fs process itself
+// under "perf stat -e cache-references,cache-misses" for each format. Mount
+// with "-o entry_timeout=0,negative_timeout=0,attr_timeout=0" so that every
+// lookup reaches a1fs.
+//
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// A name of 10 to 30 characters that is unique for each i.
+static void make_name(char *buf, size_t size, const char *dir, int i) {
+    int pad = 10 + (i * 7) % 21;
+    snprintf(buf, size, "%s/%0*d", dir, pad, i);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <directory> [entries] [passes]\n", argv[0]);
+        return 1;
+    }
+    const char *dir = argv[1];
+    // stay below A1FS_DX_THRESHOLD by default, so that lookups scan the entries
+    int n = argc > 2 ? atoi(argv[2]) : 120;
+    int passes = argc > 3 ? atoi(argv[3]) : 1000;
+    char path[4096];
+    struct stat st;
+
+    for (int i = 0; i < n; i++) {
+        make_name(path, sizeof(path), dir, i);
+        int fd = open(path, O_CREAT | O_EXCL | O_WRONLY, 0644);
+        if (fd == -1) {
+            perror(path);
+            return 1;
+        }
+        close(fd);
+    }
+    if (stat(dir, &st) == 0) {
+        printf("directory size: %lld bytes for %d entries\n", (long long) st.st_size, n);
+    }
+
+    double start = now_s();
+    long entries = 0;
+    for (int p = 0; p < passes; p++) {
+        DIR *d = opendir(dir);
+        if (d == NULL) {
+            perror(dir);
+            return 1;
+        }
+        while (readdir(d) != NULL) {
+            entries++;
+        }
+        closedir(d);
+    }
+    double elapsed = now_s() - start;
+    printf("readdir: %ld entries in %.3f s, %.0f ns/entry\n", entries, elapsed, elapsed * 1e9 / entries);
+
+    // names that don't exist make every lookup scan the whole directory
+    start = now_s();
+    for (int p = 0; p < passes; p++) {
+        for (int i = 0; i < 100; i++) {
+            make_name(path, sizeof(path), dir, n + i);
+            stat(path, &st);
+        }
+    }
+    elapsed = now_s() - start;
+    printf("lookup:  %d misses in %.3f s, %.0f ns/lookup\n", passes * 100, elapsed, elapsed * 1e9 / (passes * 100));
+
+    for (int i = 0; i < n; i++) {
+        make_name(path, sizeof(path), dir, i);
+        unlink(path);
+    }
+    return 0;
+}
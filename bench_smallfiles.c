@@ -0,0 +1,102 @@
+//
+// Space and latency of many small files.
+//
+// Usage: ./bench_smallfiles <directory> [files] [bytes]
+//
+// Creates the files (20 bytes each by default) spread over directories of 16
+// files, reads them back and deletes them. The blocks used are taken from
+// statvfs() before and after, so the image should be otherwise idle. Files of
+// up to A1FS_INLINE_DATA_SIZE bytes, and directories small enough on an image
+// formatted with "mkfs.a1fs -V", use no data blocks at all.
+//
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FILES_PER_DIR 16
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long free_blocks(const char *dir) {
+    struct statvfs sv;
+    if (statvfs(dir, &sv) == -1) {
+        perror(dir);
+        exit(1);
+    }
+    return sv.f_bfree;
+}
+
+static void report(const char *phase, int n, double elapsed) {
+    printf("%-8s %8d files %9.3f s %9.1f us/file\n", phase, n, elapsed, elapsed * 1e6 / n);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <directory> [files] [bytes]\n", argv[0]);
+        return 1;
+    }
+    const char *dir = argv[1];
+    int n = argc > 2 ? atoi(argv[2]) : 10000;
+    int bytes = argc > 3 ? atoi(argv[3]) : 20;
+    char path[4096], data[4096], out[4096];
+    if (bytes > (int) sizeof(data)) {
+        bytes = sizeof(data);
+    }
+    memset(data, 'x', bytes);
+
+    unsigned long free_before = free_blocks(dir);
+    double start = now_s();
+    for (int i = 0; i < n; i++) {
+        if (i % FILES_PER_DIR == 0) {
+            snprintf(path, sizeof(path), "%s/d%d", dir, i / FILES_PER_DIR);
+            if (mkdir(path, 0755) == -1) {
+                perror(path);
+                return 1;
+            }
+        }
+        snprintf(path, sizeof(path), "%s/d%d/f%d", dir, i / FILES_PER_DIR, i);
+        int fd = open(path, O_CREAT | O_EXCL | O_WRONLY, 0644);
+        if (fd == -1 || write(fd, data, bytes) != bytes) {
+            perror(path);
+            return 1;
+        }
+        close(fd);
+    }
+    report("create", n, now_s() - start);
+    unsigned long used = free_before - free_blocks(dir);
+    printf("space    %8lu blocks, %.2f KiB/file\n", used, used * 4.0 / n);
+
+    start = now_s();
+    for (int i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "%s/d%d/f%d", dir, i / FILES_PER_DIR, i);
+        int fd = open(path, O_RDONLY);
+        if (fd == -1 || read(fd, out, sizeof(out)) != bytes) {
+            perror(path);
+            return 1;
+        }
+        close(fd);
+    }
+    report("read", n, now_s() - start);
+
+    start = now_s();
+    for (int i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "%s/d%d/f%d", dir, i / FILES_PER_DIR, i);
+        unlink(path);
+        if (i % FILES_PER_DIR == FILES_PER_DIR - 1 || i == n - 1) {
+            snprintf(path, sizeof(path), "%s/d%d", dir, i / FILES_PER_DIR);
+            rmdir(path);
+        }
+    }
+    report("delete", n, now_s() - start);
+    return 0;
+}
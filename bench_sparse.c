@@ -0,0 +1,129 @@
+//
+// A sparse virtual machine disk image: a large file extended with truncate()
+// that only has the blocks the guest writes.
+//
+// Usage: ./bench_sparse <directory> [GiB] [MiB written]
+//
+// Extends an empty file to the given size (100 GiB by default) with a single
+// ftruncate(), like `truncate -s 100G disk.img` or `qemu-img create`, then
+// writes it the way a guest file system would: a block at the start and one
+// every 128 MiB (the headers of its block groups), then the given amount of
+// data (64 MiB by default) 4 KiB at a time, in runs of 1 to 64 blocks at
+// random offsets. Reads the same number of blocks back at random offsets,
+// mostly from the holes, and checks that they are zeros or what was written.
+// Reports the times and how much space the file takes (st_blocks) against its
+// size.
+//
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BLOCK 4096
+#define GROUP (128 << 20)
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The contents of a written block, from its offset, so that reads can check it.
+static void fill(char *buf, off_t off) {
+    for (int i = 0; i < BLOCK; i += 8) {
+        memcpy(buf + i, &off, sizeof(off));
+    }
+}
+
+static off_t random_block(off_t blocks) {
+    return (off_t) (((uint64_t) rand() << 31 | (uint64_t) rand()) % (uint64_t) blocks);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <directory> [GiB] [MiB written]\n", argv[0]);
+        return 1;
+    }
+    const char *dir = argv[1];
+    off_t size = (off_t) (argc > 2 ? atol(argv[2]) : 100) << 30;
+    long written = (argc > 3 ? atol(argv[3]) : 64) << 20;
+    off_t blocks = size / BLOCK;
+    if (blocks < 64 || written < BLOCK) {
+        fprintf(stderr, "Usage: %s <directory> [GiB (at least 1)] [MiB written (at least 1)]\n", argv[0]);
+        return 1;
+    }
+    char path[4096 + 32];
+    snprintf(path, sizeof(path), "%s/disk.img", dir);
+    int fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if (fd == -1) {
+        perror(path);
+        return 1;
+    }
+    srand(369);
+
+    double start = now_s();
+    if (ftruncate(fd, size) == -1) {
+        perror("ftruncate");
+        return 1;
+    }
+    double extended = now_s();
+
+    char buf[BLOCK], check[BLOCK];
+    long writes = 0;
+    for (off_t off = 0; off < size; off += GROUP, writes++) {
+        fill(buf, off);
+        if (pwrite(fd, buf, BLOCK, off) != BLOCK) {
+            perror("pwrite");
+            return 1;
+        }
+    }
+    for (long done = 0; done < written;) {
+        off_t first = random_block(blocks - 64);
+        int run = 1 + rand() % 64;
+        for (off_t b = first; b < first + run && done < written; b++, done += BLOCK, writes++) {
+            fill(buf, b * BLOCK);
+            if (pwrite(fd, buf, BLOCK, b * BLOCK) != BLOCK) {
+                perror("pwrite");
+                return 1;
+            }
+        }
+    }
+    fsync(fd);
+    double wrote = now_s();
+
+    long holes = 0;
+    for (long r = 0; r < writes; r++) {
+        off_t off = random_block(blocks) * BLOCK;
+        if (pread(fd, buf, BLOCK, off) != BLOCK) {
+            perror("pread");
+            return 1;
+        }
+        memset(check, 0, BLOCK);
+        if (memcmp(buf, check, BLOCK) == 0) {
+            holes++;
+            continue;
+        }
+        fill(check, off);
+        if (memcmp(buf, check, BLOCK) != 0) {
+            fprintf(stderr, "block at %lld is neither zeros nor what was written\n", (long long) off);
+            return 1;
+        }
+    }
+    double read = now_s();
+
+    struct stat st;
+    fstat(fd, &st);
+    printf("%lld GiB image: truncate %.1f ms; %ld writes %.1f ms (%.1f MiB/s); %ld reads (%ld holes) %.1f ms\n",
+           (long long) (size >> 30), (extended - start) * 1e3, writes, (wrote - extended) * 1e3,
+           writes * (double) BLOCK / (1 << 20) / (wrote - extended), writes, holes, (read - wrote) * 1e3);
+    printf("size %lld MiB, %lld MiB allocated\n", (long long) (st.st_size >> 20),
+           (long long) st.st_blocks * 512 >> 20);
+    close(fd);
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,106 @@
+//
+// Time to first entry and memory use when listing a huge directory.
+//
+// Usage: ./bench_stream <directory> [entries] [a1fs pid]
+//
+// Fills a subdirectory with empty files (1000000 by default, so format the
+// image with enough inodes, e.g. "mkfs.a1fs -i 1100000" on a 2 GiB image),
+// then lists it, timing the first readdir() and the whole listing. Given the
+// pid of the a1fs process, also reports its peak resident set size (VmHWM)
+// before and after the listing, since a directory that can't be read a
+// buffer at a time is held in memory whole by libfuse.
+//
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Peak resident set size of a process in KiB, or -1 if unknown.
+static long peak_rss(const char *pid) {
+    char path[64], line[256];
+    long kib = -1;
+    if (pid == NULL) {
+        return -1;
+    }
+    snprintf(path, sizeof(path), "/proc/%s/status", pid);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (strncmp(line, "VmHWM:", 6) == 0) {
+            kib = atol(line + 6);
+        }
+    }
+    fclose(f);
+    return kib;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <directory> [entries] [a1fs pid]\n", argv[0]);
+        return 1;
+    }
+    int n = argc > 2 ? atoi(argv[2]) : 1000000;
+    const char *pid = argc > 3 ? argv[3] : NULL;
+    char dir[4096], path[4096 + 32];
+    snprintf(dir, sizeof(dir), "%s/stream", argv[1]);
+    if (mkdir(dir, 0755) == -1) {
+        perror(dir);
+        return 1;
+    }
+
+    double start = now_s();
+    for (int i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "%s/f%07d", dir, i);
+        int fd = open(path, O_CREAT | O_EXCL | O_WRONLY, 0644);
+        if (fd == -1) {
+            perror(path);
+            return 1;
+        }
+        close(fd);
+    }
+    printf("create %d entries: %.3f s\n", n, now_s() - start);
+
+    long rss_before = peak_rss(pid);
+    start = now_s();
+    DIR *d = opendir(dir);
+    if (d == NULL || readdir(d) == NULL) {
+        perror(dir);
+        return 1;
+    }
+    double first = now_s() - start;
+    long entries = 1;
+    while (readdir(d) != NULL) {
+        entries++;
+    }
+    double total = now_s() - start;
+    closedir(d);
+    long rss_after = peak_rss(pid);
+
+    printf("first entry %.3f ms, %ld entries in %.3f s\n", first * 1e3, entries, total);
+    if (rss_before >= 0) {
+        printf("a1fs peak RSS %ld KiB before the listing, %ld KiB after\n", rss_before, rss_after);
+    }
+
+    for (int i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "%s/f%07d", dir, i);
+        if (unlink(path) == -1) {
+            perror(path);
+            return 1;
+        }
+    }
+    rmdir(dir);
+    return 0;
+}
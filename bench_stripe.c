@@ -0,0 +1,143 @@
+//
+// Extents of large files that are not aligned to the stripe of the device.
+//
+// Usage: gcc -O2 $(pkg-config fuse --cflags) bench_stripe.c fs_ctx.c dir_index.c vardir.c
+//            extent_tree.c handle.c dcache.c delalloc.c prealloc.c bitmap.c free_extents.c
+//            group.c discard.c -pthread -o bench_stripe
+//        ./bench_stripe <directory> <image> [large files] [MiB per file]
+//
+// Appends 64 KiB to each of the large files in turn, a block at a time, with
+// a small file (1 to 8 blocks) created after each append and every other one
+// deleted again, so that the large files get many extents. Then maps the
+// image (the mounted file system keeps it mapped shared, so this sees the
+// current contents; mount without -o delalloc) and goes through the extents
+// of the large files. Reports how many of them don't start on a stripe unit,
+// and how many full stripes they only cover part of: each of those is a
+// read-modify-write on a RAID device when the file is written out in full.
+// For an image made without -u, the stripe is taken to be 64 KiB.
+//
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fs_ctx.h"
+#include "extent_tree.h"
+
+#define BLOCK 4096
+#define CHUNK 16
+
+static char buf[BLOCK];
+
+static void append(int fd, const char *path, int blocks) {
+    for (int b = 0; b < blocks; b++) {
+        if (write(fd, buf, BLOCK) != BLOCK) {
+            perror(path);
+            exit(1);
+        }
+    }
+}
+
+static int create(const char *path) {
+    int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd == -1) {
+        perror(path);
+        exit(1);
+    }
+    return fd;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <directory> <image> [large files] [MiB per file]\n", argv[0]);
+        return 1;
+    }
+    const char *dir = argv[1];
+    int large = argc > 3 ? atoi(argv[3]) : 4;
+    int mib = argc > 4 ? atoi(argv[4]) : 16;
+    if (large < 1 || large > 64 || mib < 1) {
+        fprintf(stderr, "Usage: %s <directory> <image> [large files (1-64)] [MiB per file]\n", argv[0]);
+        return 1;
+    }
+    memset(buf, 's', BLOCK);
+    srand(369);
+
+    char path[4096 + 64];
+    int fds[64];
+    for (int l = 0; l < large; l++) {
+        snprintf(path, sizeof(path), "%s/large%d", dir, l);
+        fds[l] = create(path);
+    }
+    int rounds = mib * (1 << 20) / (CHUNK * BLOCK);
+    for (int r = 0; r < rounds; r++) {
+        for (int l = 0; l < large; l++) {
+            append(fds[l], "large file", CHUNK);
+            snprintf(path, sizeof(path), "%s/small%d-%d", dir, r, l);
+            int fd = create(path);
+            append(fd, path, 1 + rand() % 8);
+            close(fd);
+            if (l % 2 == 1) {
+                unlink(path);
+            }
+        }
+    }
+    for (int l = 0; l < large; l++) {
+        close(fds[l]);
+    }
+
+    int fd = open(argv[2], O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        perror(argv[2]);
+        return 1;
+    }
+    void *image = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    fs_ctx fs;
+    if (image == MAP_FAILED || !fs_ctx_init(&fs, image, (size_t) st.st_size)) {
+        fprintf(stderr, "%s: can't map the image\n", argv[2]);
+        return 1;
+    }
+    const a1fs_superblock *sb = image;
+    uint64_t unit = CHUNK, width = CHUNK;
+    if (sb->features & A1FS_FEATURE_STRIPE) {
+        unit = sb->stripe_unit;
+        width = sb->stripe_width;
+    }
+
+    long extents = 0, unaligned = 0, partial = 0;
+    for (int l = 0; l < large; l++) {
+        char name[32];
+        snprintf(name, sizeof(name), "large%d", l);
+        int ino = find_dentry(&fs, ROOT_INODE, name);
+        if (ino < 0) {
+            fprintf(stderr, "%s: not found in the image\n", name);
+            return 1;
+        }
+        a1fs_inode *inode = &fs.inode_table[ino];
+        a1fs_extent extent;
+        for (uint32_t block = 0; inode->extent_num > 0 && extent_find(&fs, inode, block, &extent);
+             block = extent.logical + extent.count) {
+            // the block of the device, counted from the start of the image
+            uint64_t start = (get_addr_of_block(&fs, extent.start) - (uint64_t) image) / BLOCK;
+            uint64_t end = start + extent.count;
+            extents++;
+            unaligned += start % unit != 0;
+            if (start / width == (end - 1) / width) {
+                partial += extent.count < width;
+            } else {
+                partial += (start % width != 0) + (end % width != 0);
+            }
+        }
+    }
+    printf("%d files of %d MiB, stripe unit %lu KiB and width %lu KiB: %ld extents, %ld unaligned, "
+           "%ld partial stripes\n", large, mib, (unsigned long) (unit * BLOCK / 1024),
+           (unsigned long) (width * BLOCK / 1024), extents, unaligned, partial);
+    fs_ctx_destroy(&fs);
+    munmap(image, (size_t) st.st_size);
+    close(fd);
+    return 0;
+}
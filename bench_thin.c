@@ -0,0 +1,104 @@
+//
+// Time and host space to provision many images, made full size or thin.
+//
+// Usage: ./bench_thin <mkfs.a1fs> <directory> [images] [GiB]
+//
+// Makes the given number of images (1000 by default) of the given size (1 GiB
+// by default) in the directory twice: first the way a full image is made,
+// extended to its size with truncate() and formatted with mkfs.a1fs, then as
+// thin images with mkfs.a1fs -T, which only have the metadata and the first
+// chunk of data blocks. Reports the time each took, and the size of the
+// image files (what `ls -l` shows) and the space they take on the host (what
+// `du` shows, from st_blocks) in total. The images are deleted again.
+//
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Run mkfs.a1fs with the given size option (NULL for none) on an image.
+static int run_mkfs(const char *mkfs, const char *size_opt, const char *size, const char *image) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        if (size_opt != NULL) {
+            execl(mkfs, mkfs, "-f", "-i", "4096", size_opt, size, image, (char *) NULL);
+        } else {
+            execl(mkfs, mkfs, "-f", "-i", "4096", image, (char *) NULL);
+        }
+        perror(mkfs);
+        _exit(127);
+    }
+    int status;
+    if (pid == -1 || waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s failed on %s\n", mkfs, image);
+        return -1;
+    }
+    return 0;
+}
+
+static int provision(const char *mkfs, const char *dir, int images, long gib, int thin) {
+    char path[4096 + 32], size[32];
+    snprintf(size, sizeof(size), "%ldg", gib);
+    double start = now_s();
+    for (int i = 0; i < images; i++) {
+        snprintf(path, sizeof(path), "%s/image%d", dir, i);
+        if (!thin) {
+            int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+            if (fd == -1 || ftruncate(fd, gib << 30) != 0) {
+                perror(path);
+                return -1;
+            }
+            close(fd);
+        }
+        if (run_mkfs(mkfs, thin ? "-T" : NULL, size, path) != 0) {
+            return -1;
+        }
+    }
+    double end = now_s();
+
+    long long apparent = 0, host = 0;
+    for (int i = 0; i < images; i++) {
+        snprintf(path, sizeof(path), "%s/image%d", dir, i);
+        struct stat st;
+        if (stat(path, &st) == -1) {
+            perror(path);
+            return -1;
+        }
+        apparent += st.st_size;
+        host += (long long) st.st_blocks * 512;
+        unlink(path);
+    }
+    printf("%-5s %d images of %ld GiB: %.1f ms (%.2f ms each); %lld MiB in size, %lld KiB on the host\n",
+           thin ? "thin" : "full", images, gib, (end - start) * 1e3, (end - start) * 1e3 / images,
+           apparent >> 20, host >> 10);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <mkfs.a1fs> <directory> [images] [GiB]\n", argv[0]);
+        return 1;
+    }
+    int images = argc > 3 ? atoi(argv[3]) : 1000;
+    long gib = argc > 4 ? atol(argv[4]) : 1;
+    if (images < 1 || gib < 1) {
+        fprintf(stderr, "Usage: %s <mkfs.a1fs> <directory> [images (at least 1)] [GiB (at least 1)]\n", argv[0]);
+        return 1;
+    }
+    if (provision(argv[1], argv[2], images, gib, 0) != 0 || provision(argv[1], argv[2], images, gib, 1) != 0) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+//
+// Time to extend a file with truncate(), at once and in steps.
+//
+// Usage: ./bench_truncate <directory> [MiB] [step MiB]
+//
+// Extends an empty file to the given size (1 GiB by default) with a single
+// ftruncate(), like `truncate -s 1G`, then truncates it back to 0 and extends
+// it again in steps, like a program that extends its file ahead of its writes.
+// a1fs leaves the new range a hole, which takes no blocks until it is
+// written to; see bench_zeroing for what writing into it costs.
+//
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <directory> [MiB] [step MiB]\n", argv[0]);
+        return 1;
+    }
+    const char *dir = argv[1];
+    off_t size = (off_t) (argc > 2 ? atol(argv[2]) : 1024) << 20;
+    off_t step = (off_t) (argc > 3 ? atol(argv[3]) : 1) << 20;
+    char path[4096 + 32];
+    snprintf(path, sizeof(path), "%s/truncate", dir);
+
+    int fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if (fd == -1) {
+        perror(path);
+        return 1;
+    }
+    double start = now_s();
+    if (ftruncate(fd, size) == -1) {
+        perror("ftruncate");
+        return 1;
+    }
+    double once = now_s() - start;
+
+    if (ftruncate(fd, 0) == -1) {
+        perror("ftruncate");
+        return 1;
+    }
+    start = now_s();
+    for (off_t s = step; s <= size; s += step) {
+        if (ftruncate(fd, s) == -1) {
+            perror("ftruncate");
+            return 1;
+        }
+    }
+    double steps = now_s() - start;
+
+    struct stat st;
+    fstat(fd, &st);
+    printf("%lld MiB at once: %.1f ms; in %lld MiB steps: %.1f ms; %lld blocks\n",
+           (long long) (size >> 20), once * 1e3, (long long) (step >> 20), steps * 1e3, (long long) st.st_blocks);
+    close(fd);
+    unlink(path);
+    return 0;
+}
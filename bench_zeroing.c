@@ -0,0 +1,102 @@
+//
+// Bytes written to the data blocks per byte written by the user, for writes
+// into blocks that were not written before.
+//
+// Usage: ./bench_zeroing <directory> [MiB]
+//
+// Writes three files of the given size (16 MiB by default): one extended with
+// ftruncate() and then overwritten 4 KiB at a time, one appended to 100 bytes
+// at a time, and one extended with ftruncate() and then given as many writes
+// of 1 to 3000 bytes at random offsets as it has blocks. Reports the time
+// and the bytes written of each. The bytes of data blocks that a1fs zeroed
+// rather than wrote with data are in the "zeroed:" line it prints at unmount
+// (run it in the foreground with -f). The range truncate() extends a file by
+// is a hole, and only the part of a block around a write into it is zeroed,
+// none of it past the end of the file.
+//
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BLOCK 4096
+
+static char buf[BLOCK];
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int write_at(int fd, size_t n, off_t off) {
+    if (pwrite(fd, buf, n, off) != (ssize_t) n) {
+        perror("pwrite");
+        return -1;
+    }
+    return 0;
+}
+
+static int run(const char *dir, const char *name, off_t size) {
+    char path[4096 + 32];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    int fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if (fd == -1) {
+        perror(path);
+        return -1;
+    }
+
+    double start = now_s();
+    long long user = 0;
+    if (strcmp(name, "append") == 0) {
+        for (off_t off = 0; off < size; off += 100, user += 100) {
+            if (write_at(fd, 100, off) != 0) {
+                return -1;
+            }
+        }
+    } else {
+        if (ftruncate(fd, size) != 0) {
+            perror("ftruncate");
+            return -1;
+        }
+        for (off_t off = 0; off < size; off += BLOCK) {
+            // a write within one block, like the ones FUSE passes on
+            size_t n = BLOCK;
+            off_t at = off;
+            if (strcmp(name, "partial") == 0) {
+                n = 1 + (size_t) (rand() % 3000);
+                at = rand() % (size - BLOCK) / BLOCK * BLOCK + rand() % (BLOCK - n + 1);
+            }
+            if (write_at(fd, n, at) != 0) {
+                return -1;
+            }
+            user += (long long) n;
+        }
+    }
+    fsync(fd);
+    double end = now_s();
+    printf("%-10s %8.1f ms, %lld bytes written\n", name, (end - start) * 1e3, user);
+
+    close(fd);
+    unlink(path);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <directory> [MiB]\n", argv[0]);
+        return 1;
+    }
+    const char *dir = argv[1];
+    off_t size = (off_t) (argc > 2 ? atol(argv[2]) : 16) << 20;
+    memset(buf, 'z', BLOCK);
+    srand(369);
+
+    if (run(dir, "overwrite", size) != 0 || run(dir, "append", size) != 0 || run(dir, "partial", size) != 0) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,496 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Bitmap with a free space summary implementation.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitmap.h"
+
+
+/** Number of words summarized by a block_free counter. */
+#define WORDS_PER_BLOCK (BITMAP_BLOCK_BITS / BITMAP_WORD_BITS)
+
+/** Return the number of words in the bitmap. */
+static uint32_t num_words(bitmap *bm)
+{
+	return (bm->size + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS;
+}
+
+/**
+ * Return a 64-bit word of the bitmap. Bit i of the bitmap is bit i % 8 of
+ * byte i / 8, which is bit i % 64 of word i / 64 on a little-endian host.
+ */
+static uint64_t load_word(bitmap *bm, uint32_t word)
+{
+	uint64_t w;
+	memcpy(&w, bm->bits + (size_t) word * sizeof(w), sizeof(w));
+	return w;
+}
+
+/** Write back a 64-bit word of the bitmap. */
+static void store_word(bitmap *bm, uint32_t word, uint64_t w)
+{
+	memcpy(bm->bits + (size_t) word * sizeof(w), &w, sizeof(w));
+}
+
+/** Return a word of the bitmap with the bits past the end of the bitmap set. */
+static uint64_t load_used(bitmap *bm, uint32_t word)
+{
+	uint64_t used = load_word(bm, word);
+	if (bm->size - word * BITMAP_WORD_BITS < BITMAP_WORD_BITS) {
+		used |= ~0ull << (bm->size - word * BITMAP_WORD_BITS);
+	}
+	return used;
+}
+
+/** Return the mask of the bits below bit n of a word, n < 64. */
+static uint64_t low_bits(uint32_t n)
+{
+	return (1ull << n) - 1;
+}
+
+/** Return the mask of the bits [from, to) of a word, 0 <= from < to <= 64. */
+static uint64_t bit_mask(uint32_t from, uint32_t to)
+{
+	uint64_t mask = to == BITMAP_WORD_BITS ? ~0ull : (1ull << to) - 1;
+	return mask & ~((1ull << from) - 1);
+}
+
+
+/*
+ * Scans of the word_free summary (one byte per word of the bitmap), which is
+ * how the range operations cover whole words: a word is all free when its
+ * byte is 64 and all used when it is 0. The plain versions go 8 bytes at a
+ * time, the AVX2 ones 32.
+ */
+
+/** Return the sum of n bytes. */
+static uint32_t sum_bytes_word(const uint8_t *p, uint32_t n)
+{
+	uint32_t sum = 0;
+	uint32_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		uint64_t v;
+		memcpy(&v, p + i, sizeof(v));
+		// add pairs of bytes into 16-bit lanes, then the lanes with a multiply
+		v = (v & 0x00ff00ff00ff00ffull) + ((v >> 8) & 0x00ff00ff00ff00ffull);
+		sum += (uint32_t) ((v * 0x0001000100010001ull) >> 48);
+	}
+	for (; i < n; i++) {
+		sum += p[i];
+	}
+	return sum;
+}
+
+/** Return the index of the first of n bytes that is not value, or n. */
+static uint32_t find_byte_ne_word(const uint8_t *p, uint32_t n, uint8_t value)
+{
+	uint64_t pattern = value * 0x0101010101010101ull;
+	uint32_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		uint64_t v;
+		memcpy(&v, p + i, sizeof(v));
+		if (v != pattern) {
+			return i + (uint32_t) __builtin_ctzll(v ^ pattern) / 8;
+		}
+	}
+	for (; i < n && p[i] == value; i++);
+	return i;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+__attribute__((target("avx2")))
+static uint32_t sum_bytes_avx2(const uint8_t *p, uint32_t n)
+{
+	__m256i acc = _mm256_setzero_si256();
+	uint32_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *) (p + i));
+		acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, _mm256_setzero_si256()));
+	}
+	uint64_t lanes[4];
+	_mm256_storeu_si256((__m256i *) lanes, acc);
+	return (uint32_t) (lanes[0] + lanes[1] + lanes[2] + lanes[3]) + sum_bytes_word(p + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static uint32_t find_byte_ne_avx2(const uint8_t *p, uint32_t n, uint8_t value)
+{
+	__m256i pattern = _mm256_set1_epi8((char) value);
+	uint32_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *) (p + i));
+		uint32_t eq = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, pattern));
+		if (eq != UINT32_MAX) {
+			return i + (uint32_t) __builtin_ctz(~eq);
+		}
+	}
+	return i + find_byte_ne_word(p + i, n - i, value);
+}
+#endif
+
+/** The summary scans in use. */
+static struct {
+	bool selected;
+	uint32_t (*sum_bytes)(const uint8_t *p, uint32_t n);
+	uint32_t (*find_byte_ne)(const uint8_t *p, uint32_t n, uint8_t value);
+} scan = { false, sum_bytes_word, find_byte_ne_word };
+
+bool bitmap_use_avx2(bool enable)
+{
+	scan.selected = true;
+#if defined(__x86_64__) || defined(__i386__)
+	if (enable && __builtin_cpu_supports("avx2")) {
+		scan.sum_bytes = sum_bytes_avx2;
+		scan.find_byte_ne = find_byte_ne_avx2;
+		return true;
+	}
+#else
+	(void) enable;
+#endif
+	scan.sum_bytes = sum_bytes_word;
+	scan.find_byte_ne = find_byte_ne_word;
+	return false;
+}
+
+bool bitmap_init(bitmap *bm, unsigned char *bits, uint32_t size, uint32_t *available)
+{
+	bm->bits = bits;
+	bm->size = size;
+	bm->available = available;
+	bm->hint = 0;
+	if (!scan.selected) {
+		bitmap_use_avx2(true);
+	}
+
+	uint32_t words = num_words(bm);
+	uint32_t blocks = (words + WORDS_PER_BLOCK - 1) / WORDS_PER_BLOCK;
+	bm->word_free = malloc(words * sizeof(uint8_t));
+	bm->block_free = calloc(blocks, sizeof(uint16_t));
+	if (bm->word_free == NULL || bm->block_free == NULL) {
+		bitmap_destroy(bm);
+		return false;
+	}
+
+	for (uint32_t i = 0; i < words; i++) {
+		// the bits past the end of the bitmap are never free
+		uint64_t used = load_used(bm, i);
+		bm->word_free[i] = (uint8_t) (BITMAP_WORD_BITS - __builtin_popcountll(used));
+		bm->block_free[i / WORDS_PER_BLOCK] += bm->word_free[i];
+	}
+	return true;
+}
+
+void bitmap_destroy(bitmap *bm)
+{
+	free(bm->word_free);
+	free(bm->block_free);
+	bm->word_free = NULL;
+	bm->block_free = NULL;
+}
+
+int is_bit_set(uint32_t index, bitmap *bm) {
+	uint32_t byte_index = index / 8;
+	uint32_t bit_index = index % 8;
+	if ((bm->bits[byte_index] & (1 << bit_index)) == 0) {
+		return 0; // unset
+	} else {
+		return 1; // set
+	}
+}
+
+uint32_t get_first_available_position(bitmap *bm) {
+	uint32_t words = num_words(bm);
+	uint32_t word = bm->hint / BITMAP_WORD_BITS;
+
+	// skip the blocks, then the words, that have no free bits
+	while (word < words) {
+		uint32_t block = word / WORDS_PER_BLOCK;
+		if (bm->block_free[block] == 0) {
+			word = (block + 1) * WORDS_PER_BLOCK;
+			continue;
+		}
+		uint32_t block_end = (block + 1) * WORDS_PER_BLOCK < words ? (block + 1) * WORDS_PER_BLOCK : words;
+		for (; word < block_end; word++) {
+			if (bm->word_free[word] != 0) {
+				// the lowest clear bit is free, since the bits past the end
+				// of the bitmap come after any free one
+				uint32_t index = word * BITMAP_WORD_BITS + (uint32_t) __builtin_ctzll(~load_word(bm, word));
+				bm->hint = index;
+				return index;
+			}
+		}
+	}
+	bm->hint = bm->size;
+	return UINT32_MAX;
+}
+
+void set_bitmap(bitmap *bm, uint32_t index) {
+	if (is_bit_set(index, bm)) {
+		return;
+	}
+	bm->bits[index / 8] |= (unsigned char) (1 << (index % 8));
+	bm->word_free[index / BITMAP_WORD_BITS]--;
+	bm->block_free[index / BITMAP_BLOCK_BITS]--;
+	*bm->available -= 1;
+}
+
+void unset_bitmap(bitmap *bm, uint32_t index) {
+	if (!is_bit_set(index, bm)) {
+		return;
+	}
+	bm->bits[index / 8] &= (unsigned char) ~(1 << (index % 8));
+	bm->word_free[index / BITMAP_WORD_BITS]++;
+	bm->block_free[index / BITMAP_BLOCK_BITS]++;
+	*bm->available += 1;
+	if (index < bm->hint) {
+		bm->hint = index;
+	}
+}
+
+/** Return the smaller of two numbers. */
+static uint32_t min_u32(uint32_t a, uint32_t b)
+{
+	return a < b ? a : b;
+}
+
+/**
+ * Set or unset the bits [start, start + count): the partial words at the ends
+ * with a mask, the whole words in between with memset(), counting the bits
+ * that change from the summary.
+ */
+static void change_range(bitmap *bm, uint32_t start, uint32_t count, bool set)
+{
+	uint32_t end = start + count;
+	uint32_t changed = 0;
+	while (start < end) {
+		uint32_t word = start / BITMAP_WORD_BITS;
+		uint32_t block = word / WORDS_PER_BLOCK;
+		uint32_t from = start % BITMAP_WORD_BITS;
+		if (from != 0 || end - start < BITMAP_WORD_BITS) {
+			uint32_t to = min_u32(end - word * BITMAP_WORD_BITS, BITMAP_WORD_BITS);
+			uint64_t mask = bit_mask(from, to);
+			uint64_t old = load_word(bm, word);
+			uint64_t new = set ? old | mask : old & ~mask;
+			uint32_t n = (uint32_t) __builtin_popcountll(old ^ new);
+			store_word(bm, word, new);
+			bm->word_free[word] = (uint8_t) (set ? bm->word_free[word] - n : bm->word_free[word] + n);
+			bm->block_free[block] = (uint16_t) (set ? bm->block_free[block] - n : bm->block_free[block] + n);
+			changed += n;
+			start = word * BITMAP_WORD_BITS + to;
+			continue;
+		}
+
+		// whole words, up to the end of the range or of the block of the bitmap
+		uint32_t words = min_u32((end - start) / BITMAP_WORD_BITS, (block + 1) * WORDS_PER_BLOCK - word);
+		uint32_t free_bits = scan.sum_bytes(&bm->word_free[word], words);
+		uint32_t n = set ? free_bits : words * BITMAP_WORD_BITS - free_bits;
+		memset(bm->bits + (size_t) word * sizeof(uint64_t), set ? 0xff : 0, words * sizeof(uint64_t));
+		memset(&bm->word_free[word], set ? 0 : BITMAP_WORD_BITS, words);
+		bm->block_free[block] = (uint16_t) (set ? bm->block_free[block] - n : bm->block_free[block] + n);
+		changed += n;
+		start += words * BITMAP_WORD_BITS;
+	}
+	if (set) {
+		*bm->available -= changed;
+	} else {
+		*bm->available += changed;
+	}
+}
+
+void bitmap_set_range(bitmap *bm, uint32_t start, uint32_t count)
+{
+	change_range(bm, start, count, true);
+}
+
+void bitmap_clear_range(bitmap *bm, uint32_t start, uint32_t count)
+{
+	change_range(bm, start, count, false);
+	if (count > 0 && start < bm->hint) {
+		bm->hint = start;
+	}
+}
+
+uint32_t bitmap_count_free(bitmap *bm, uint32_t start, uint32_t count)
+{
+	uint32_t end = start + count;
+	uint32_t n = 0;
+	while (start < end) {
+		uint32_t word = start / BITMAP_WORD_BITS;
+		uint32_t block = word / WORDS_PER_BLOCK;
+		uint32_t from = start % BITMAP_WORD_BITS;
+		if (from != 0 || end - start < BITMAP_WORD_BITS) {
+			uint32_t to = min_u32(end - word * BITMAP_WORD_BITS, BITMAP_WORD_BITS);
+			n += (uint32_t) __builtin_popcountll(~load_word(bm, word) & bit_mask(from, to));
+			start = word * BITMAP_WORD_BITS + to;
+		} else if (word % WORDS_PER_BLOCK == 0 && end - start >= BITMAP_BLOCK_BITS) {
+			n += bm->block_free[block];
+			start += BITMAP_BLOCK_BITS;
+		} else {
+			uint32_t words = min_u32((end - start) / BITMAP_WORD_BITS, (block + 1) * WORDS_PER_BLOCK - word);
+			n += scan.sum_bytes(&bm->word_free[word], words);
+			start += words * BITMAP_WORD_BITS;
+		}
+	}
+	return n;
+}
+
+/**
+ * Return the lowest bit at which count consecutive bits of a word are free, or
+ * 64 if there is none. 0 < count < 64.
+ */
+static uint32_t find_run_in_word(uint64_t used, uint32_t count)
+{
+	// bit i of starts stays set while bits i .. i + done - 1 are all free
+	uint64_t starts = ~used;
+	uint32_t done = 1;
+	while (done < count && starts != 0) {
+		uint32_t shift = min_u32(done, count - done);
+		starts &= starts >> shift;
+		done += shift;
+	}
+	return starts == 0 ? BITMAP_WORD_BITS : (uint32_t) __builtin_ctzll(starts);
+}
+
+uint32_t bitmap_find_free_run(bitmap *bm, uint32_t count)
+{
+	if (count == 0 || count > *bm->available) {
+		return UINT32_MAX;
+	}
+	if (count == 1) {
+		return get_first_available_position(bm);
+	}
+
+	uint32_t words = num_words(bm);
+	uint32_t run = 0;   // number of free bits just before the current word
+	uint32_t start = 0; // where they begin
+	uint32_t word = bm->hint / BITMAP_WORD_BITS;
+	while (word < words) {
+		uint32_t block = word / WORDS_PER_BLOCK;
+		uint8_t word_free = bm->word_free[word];
+
+		if (word_free == 0) {
+			// the run is broken; skip the full words, or the whole block
+			run = 0;
+			if (bm->block_free[block] == 0) {
+				word = (block + 1) * WORDS_PER_BLOCK;
+			} else {
+				uint32_t block_end = min_u32((block + 1) * WORDS_PER_BLOCK, words);
+				word += scan.find_byte_ne(&bm->word_free[word], block_end - word, 0);
+			}
+			continue;
+		}
+
+		if (word_free == BITMAP_WORD_BITS) {
+			// free words extend the run, up to as many as it still needs
+			if (run == 0) {
+				start = word * BITMAP_WORD_BITS;
+			}
+			uint32_t need = (count - run + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS;
+			uint32_t n = scan.find_byte_ne(&bm->word_free[word], min_u32(need, words - word), BITMAP_WORD_BITS);
+			run += n * BITMAP_WORD_BITS;
+			word += n;
+			if (run >= count) {
+				return start;
+			}
+			continue;
+		}
+
+		// a partly used word: the run goes on into its low free bits ...
+		uint64_t used = load_used(bm, word);
+		if (run == 0) {
+			start = word * BITMAP_WORD_BITS;
+		}
+		run += (uint32_t) __builtin_ctzll(used);
+		if (run >= count) {
+			return start;
+		}
+		// ... or a shorter one fits between its used bits ...
+		if (count < BITMAP_WORD_BITS) {
+			uint32_t bit = find_run_in_word(used, count);
+			if (bit < BITMAP_WORD_BITS) {
+				return word * BITMAP_WORD_BITS + bit;
+			}
+		}
+		// ... and a new one may start in its high free bits
+		run = (uint32_t) __builtin_clzll(used);
+		word++;
+		start = word * BITMAP_WORD_BITS - run;
+	}
+	return UINT32_MAX;
+}
+
+/** Return the first free bit at or after from, or UINT32_MAX if there is none. */
+static uint32_t next_free_bit(bitmap *bm, uint32_t from)
+{
+	uint32_t words = num_words(bm);
+	uint32_t word = from / BITMAP_WORD_BITS;
+	if (word >= words) {
+		return UINT32_MAX;
+	}
+	uint64_t used = load_used(bm, word) | low_bits(from % BITMAP_WORD_BITS);
+	if (used != ~0ull) {
+		return word * BITMAP_WORD_BITS + (uint32_t) __builtin_ctzll(~used);
+	}
+
+	// then skip the blocks, and the words, that have no free bits
+	word++;
+	while (word < words) {
+		uint32_t block = word / WORDS_PER_BLOCK;
+		if (bm->block_free[block] == 0) {
+			word = (block + 1) * WORDS_PER_BLOCK;
+			continue;
+		}
+		uint32_t block_end = min_u32((block + 1) * WORDS_PER_BLOCK, words);
+		word += scan.find_byte_ne(&bm->word_free[word], block_end - word, 0);
+		if (word < block_end) {
+			return word * BITMAP_WORD_BITS + (uint32_t) __builtin_ctzll(~load_used(bm, word));
+		}
+	}
+	return UINT32_MAX;
+}
+
+/** Return the first used bit at or after from, or the size of the bitmap. */
+static uint32_t next_used_bit(bitmap *bm, uint32_t from)
+{
+	uint32_t words = num_words(bm);
+	uint32_t word = from / BITMAP_WORD_BITS;
+	uint64_t used = load_used(bm, word) & ~low_bits(from % BITMAP_WORD_BITS);
+	if (used == 0) {
+		// then skip the words that are all free
+		word++;
+		word += scan.find_byte_ne(&bm->word_free[word], words - word, BITMAP_WORD_BITS);
+		if (word == words) {
+			return bm->size;
+		}
+		used = load_used(bm, word);
+	}
+	// the bits past the end of the bitmap count as used
+	return min_u32(word * BITMAP_WORD_BITS + (uint32_t) __builtin_ctzll(used), bm->size);
+}
+
+uint32_t bitmap_next_free_run(bitmap *bm, uint32_t from, uint32_t *count)
+{
+	uint32_t start = next_free_bit(bm, from);
+	if (start != UINT32_MAX) {
+		*count = next_used_bit(bm, start) - start;
+	}
+	return start;
+}
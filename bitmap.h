@@ -0,0 +1,127 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Bitmap with a free space summary header file.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "a1fs.h"
+
+
+/** Number of bits summarized by a bitmap_summary.word_free counter. */
+#define BITMAP_WORD_BITS 64
+
+/** Number of bits summarized by a bitmap_summary.block_free counter: one block of the bitmap. */
+#define BITMAP_BLOCK_BITS (A1FS_BLOCK_SIZE * 8)
+
+/**
+ * An on-disk bitmap (a set bit is a used inode or block) with an in-memory
+ * summary of where its free bits are, built at mount. The summary must be kept
+ * up to date, so all changes to the bitmap go through set_bitmap() and
+ * unset_bitmap().
+ */
+typedef struct bitmap {
+	/** The bitmap in the image. */
+	unsigned char *bits;
+	/** Number of bits in the bitmap. */
+	uint32_t size;
+	/** Number of free bits, in the superblock. */
+	uint32_t *available;
+
+	/** Number of free bits in each 64-bit word. */
+	uint8_t *word_free;
+	/** Number of free bits in each block of the bitmap. */
+	uint16_t *block_free;
+	/** No bit before this one is free. */
+	uint32_t hint;
+
+} bitmap;
+
+/**
+ * Build the summary of an on-disk bitmap.
+ *
+ * @param bm         the bitmap to initialize.
+ * @param bits       the bitmap in the image.
+ * @param size       number of bits in the bitmap.
+ * @param available  free bit counter that set_bitmap() and unset_bitmap() update.
+ * @return           true on success; false if out of memory.
+ */
+bool bitmap_init(bitmap *bm, unsigned char *bits, uint32_t size, uint32_t *available);
+
+/** Free all memory used by the summary. */
+void bitmap_destroy(bitmap *bm);
+
+/**
+ * Check if bitmap[index] is available or not
+ */
+int is_bit_set(uint32_t index, bitmap *bm);
+
+/**
+ * Return the number of the first free bit, or UINT32_MAX if there is none.
+ */
+uint32_t get_first_available_position(bitmap *bm);
+
+/**
+ * Set a bit, taking it out of the free count. Setting a set bit does nothing.
+ */
+void set_bitmap(bitmap *bm, uint32_t index);
+
+/**
+ * Unset a bit, adding it to the free count. Unsetting a free bit does nothing.
+ */
+void unset_bitmap(bitmap *bm, uint32_t index);
+
+/**
+ * Set the bits [start, start + count), a 64-bit word at a time. Bits that are
+ * already set are left as they are.
+ */
+void bitmap_set_range(bitmap *bm, uint32_t start, uint32_t count);
+
+/**
+ * Unset the bits [start, start + count), a 64-bit word at a time. Bits that
+ * are already free are left as they are.
+ */
+void bitmap_clear_range(bitmap *bm, uint32_t start, uint32_t count);
+
+/**
+ * Return the number of free bits in [start, start + count).
+ */
+uint32_t bitmap_count_free(bitmap *bm, uint32_t start, uint32_t count);
+
+/**
+ * Return the first bit of the lowest run of count free bits, or UINT32_MAX if
+ * there is none. The bits are not set.
+ */
+uint32_t bitmap_find_free_run(bitmap *bm, uint32_t count);
+
+/**
+ * Return the first bit of the lowest run of free bits at or after from, and its
+ * length in count; UINT32_MAX if there are no free bits from there on.
+ */
+uint32_t bitmap_next_free_run(bitmap *bm, uint32_t from, uint32_t *count);
+
+/**
+ * Choose between the AVX2 and the plain 64-bit versions of the summary scans
+ * used by the range operations. bitmap_init() picks AVX2 when the CPU has it,
+ * unless this was called before.
+ *
+ * @param enable  whether to use AVX2 if the CPU has it.
+ * @return        true if the AVX2 versions are in use.
+ */
+bool bitmap_use_avx2(bool enable);
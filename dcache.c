@@ -0,0 +1,136 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Directory entry cache implementation.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dcache.h"
+
+
+/** FNV-1a hash of the parent inode number and the name; never returns 0. */
+static uint32_t dcache_hash(a1fs_ino_t parent, const char *name)
+{
+	uint32_t h = 2166136261u;
+	for (int i = 0; i < 4; i++) {
+		h ^= (parent >> (i * 8)) & 0xff;
+		h *= 16777619u;
+	}
+	for (const char *c = name; *c != '\0'; c++) {
+		h ^= (unsigned char) *c;
+		h *= 16777619u;
+	}
+	return h == 0 ? 1 : h;
+}
+
+/** Return the first entry of the set that the hash maps to. */
+static dcache_entry *dcache_set(dcache *dc, uint32_t hash)
+{
+	return &dc->entries[(hash & (DCACHE_SETS - 1)) * DCACHE_WAYS];
+}
+
+/** Return the cached entry for (parent, name), or NULL if there is none. */
+static dcache_entry *dcache_find(dcache *dc, uint32_t hash, a1fs_ino_t parent, const char *name)
+{
+	dcache_entry *set = dcache_set(dc, hash);
+	for (int i = 0; i < DCACHE_WAYS; i++) {
+		if (set[i].hash == hash && set[i].parent == parent && strcmp(set[i].name, name) == 0) {
+			return &set[i];
+		}
+	}
+	return NULL;
+}
+
+bool dcache_init(dcache *dc)
+{
+	dc->entries = calloc(DCACHE_SETS * DCACHE_WAYS, sizeof(dcache_entry));
+	dc->next_victim = calloc(DCACHE_SETS, sizeof(uint8_t));
+	dc->hits = 0;
+	dc->misses = 0;
+	if (dc->entries == NULL || dc->next_victim == NULL) {
+		dcache_destroy(dc);
+		return false;
+	}
+	return true;
+}
+
+void dcache_destroy(dcache *dc)
+{
+	free(dc->entries);
+	free(dc->next_victim);
+	dc->entries = NULL;
+	dc->next_victim = NULL;
+}
+
+bool dcache_lookup(dcache *dc, a1fs_ino_t parent, const char *name, int *ino)
+{
+	uint32_t hash = dcache_hash(parent, name);
+	dcache_entry *entry = dcache_find(dc, hash, parent, name);
+	if (entry == NULL) {
+		dc->misses++;
+		return false;
+	}
+	dc->hits++;
+	*ino = entry->ino;
+	return true;
+}
+
+void dcache_insert(dcache *dc, a1fs_ino_t parent, const char *name, int ino)
+{
+	// names that don't fit can't exist in a1fs either, so there is nothing to cache
+	if (strlen(name) >= A1FS_NAME_MAX) {
+		return;
+	}
+
+	uint32_t hash = dcache_hash(parent, name);
+	dcache_entry *entry = dcache_find(dc, hash, parent, name);
+	if (entry == NULL) {
+		// prefer an empty slot, otherwise replace in round-robin order
+		dcache_entry *set = dcache_set(dc, hash);
+		for (int i = 0; i < DCACHE_WAYS && entry == NULL; i++) {
+			if (set[i].hash == 0) {
+				entry = &set[i];
+			}
+		}
+		if (entry == NULL) {
+			uint8_t *victim = &dc->next_victim[hash & (DCACHE_SETS - 1)];
+			entry = &set[*victim];
+			*victim = (*victim + 1) % DCACHE_WAYS;
+		}
+		entry->hash = hash;
+		entry->parent = parent;
+		strcpy(entry->name, name);
+	}
+	entry->ino = ino;
+}
+
+void dcache_invalidate(dcache *dc, a1fs_ino_t parent, const char *name)
+{
+	dcache_entry *entry = dcache_find(dc, dcache_hash(parent, name), parent, name);
+	if (entry != NULL) {
+		entry->hash = 0;
+	}
+}
+
+void dcache_invalidate_dir(dcache *dc, a1fs_ino_t parent)
+{
+	for (uint32_t i = 0; i < DCACHE_SETS * DCACHE_WAYS; i++) {
+		if (dc->entries[i].hash != 0 && dc->entries[i].parent == parent) {
+			dc->entries[i].hash = 0;
+		}
+	}
+}
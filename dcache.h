@@ -0,0 +1,101 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Directory entry cache header file.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "a1fs.h"
+
+/** Number of sets in the cache. Must be a power of 2. */
+#define DCACHE_SETS 1024
+
+/** Number of entries per set. */
+#define DCACHE_WAYS 4
+
+/** Inode number stored in a negative entry (the name does not exist). */
+#define DCACHE_NEGATIVE -1
+
+/** A cached (parent directory, name) -> inode mapping. */
+typedef struct dcache_entry {
+	/** Hash of (parent, name); 0 means the slot is empty. */
+	uint32_t hash;
+	/** Inode number of the parent directory. */
+	a1fs_ino_t parent;
+	/** Inode number of the entry, or DCACHE_NEGATIVE. */
+	int ino;
+	/** Entry name. A null-terminated string. */
+	char name[A1FS_NAME_MAX];
+
+} dcache_entry;
+
+/**
+ * Bounded, set-associative directory entry cache.
+ *
+ * Each (parent, name) pair hashes to one set of DCACHE_WAYS entries; when the
+ * set is full, entries are replaced in round-robin order.
+ */
+typedef struct dcache {
+	/** DCACHE_SETS * DCACHE_WAYS entries. */
+	dcache_entry *entries;
+	/** Next entry to replace in each set. */
+	uint8_t *next_victim;
+
+	/** Number of lookups answered by the cache (including negative ones). */
+	uint64_t hits;
+	/** Number of lookups that had to scan the directory. */
+	uint64_t misses;
+
+} dcache;
+
+/**
+ * Initialize an empty cache.
+ *
+ * @return  true on success; false if out of memory.
+ */
+bool dcache_init(dcache *dc);
+
+/** Free all memory used by the cache. */
+void dcache_destroy(dcache *dc);
+
+/**
+ * Look up a name in a directory.
+ *
+ * @param dc      the cache.
+ * @param parent  inode number of the directory.
+ * @param name    name of the entry.
+ * @param ino     receives the inode number or DCACHE_NEGATIVE on a hit.
+ * @return        true on a hit; false on a miss.
+ */
+bool dcache_lookup(dcache *dc, a1fs_ino_t parent, const char *name, int *ino);
+
+/**
+ * Insert or replace the mapping for a name in a directory. Pass
+ * DCACHE_NEGATIVE as ino to record that the name does not exist.
+ */
+void dcache_insert(dcache *dc, a1fs_ino_t parent, const char *name, int ino);
+
+/** Drop the mapping for a name in a directory, if cached. */
+void dcache_invalidate(dcache *dc, a1fs_ino_t parent, const char *name);
+
+/**
+ * Drop all the mappings whose parent is the given directory. Must be called
+ * when a directory is removed, since its inode number can be reused.
+ */
+void dcache_invalidate_dir(dcache *dc, a1fs_ino_t parent);
@@ -0,0 +1,105 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Delayed allocation buffers implementation.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "delalloc.h"
+
+
+/** Number of entries in a new table. */
+#define DELALLOC_TABLE_INITIAL 16
+
+bool delalloc_init(delalloc_table *dt)
+{
+	dt->files = malloc(DELALLOC_TABLE_INITIAL * sizeof(delalloc_file));
+	dt->num_files = 0;
+	dt->capacity = DELALLOC_TABLE_INITIAL;
+	dt->blocks = 0;
+	return dt->files != NULL;
+}
+
+void delalloc_destroy(delalloc_table *dt)
+{
+	while (dt->num_files > 0) {
+		delalloc_remove(dt, &dt->files[0]);
+	}
+	free(dt->files);
+	dt->files = NULL;
+	dt->capacity = 0;
+}
+
+delalloc_file *delalloc_find(delalloc_table *dt, a1fs_ino_t ino)
+{
+	// only the files being written have entries, so there are few of them
+	for (uint32_t i = 0; i < dt->num_files; i++) {
+		if (dt->files[i].ino == ino) {
+			return &dt->files[i];
+		}
+	}
+	return NULL;
+}
+
+delalloc_file *delalloc_add(delalloc_table *dt, a1fs_ino_t ino, uint32_t first)
+{
+	if (dt->num_files == dt->capacity) {
+		delalloc_file *files = realloc(dt->files, 2 * dt->capacity * sizeof(delalloc_file));
+		if (files == NULL) {
+			return NULL;
+		}
+		dt->files = files;
+		dt->capacity *= 2;
+	}
+	delalloc_file *f = &dt->files[dt->num_files++];
+	f->ino = ino;
+	f->first = first;
+	f->count = 0;
+	f->capacity = 0;
+	f->data = NULL;
+	return f;
+}
+
+bool delalloc_grow(delalloc_table *dt, delalloc_file *f, uint32_t count)
+{
+	if (count <= f->count) {
+		return true;
+	}
+	if (count > f->capacity) {
+		uint32_t capacity = f->capacity == 0 ? 16 : f->capacity;
+		while (capacity < count) {
+			capacity *= 2;
+		}
+		char *data = realloc(f->data, (size_t) capacity * A1FS_BLOCK_SIZE);
+		if (data == NULL) {
+			return false;
+		}
+		f->data = data;
+		f->capacity = capacity;
+	}
+	memset(f->data + (size_t) f->count * A1FS_BLOCK_SIZE, 0, (size_t) (count - f->count) * A1FS_BLOCK_SIZE);
+	dt->blocks += count - f->count;
+	f->count = count;
+	return true;
+}
+
+void delalloc_remove(delalloc_table *dt, delalloc_file *f)
+{
+	dt->blocks -= f->count;
+	free(f->data);
+	*f = dt->files[--dt->num_files];
+}
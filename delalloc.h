@@ -0,0 +1,96 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Delayed allocation buffers header file.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "a1fs.h"
+
+
+/** Most blocks buffered for one file; past that, the file is placed. */
+#define DELALLOC_FILE_MAX 4096
+
+/** Most blocks buffered for all files together; past that, all are placed. */
+#define DELALLOC_TOTAL_MAX 16384
+
+/**
+ * Data written past the last block of a file, that has no blocks yet. The
+ * buffered blocks directly follow the blocks the file has, and end with the
+ * block that holds the end of the file.
+ */
+typedef struct delalloc_file {
+	/** Inode number of the file. */
+	a1fs_ino_t ino;
+	/** Logical block of the first buffered block. */
+	uint32_t first;
+	/** Number of buffered blocks. */
+	uint32_t count;
+	/** Number of blocks data has room for. */
+	uint32_t capacity;
+	/** Contents of the buffered blocks. */
+	char *data;
+
+} delalloc_file;
+
+/** The files that have buffered blocks. */
+typedef struct delalloc_table {
+	delalloc_file *files;
+	uint32_t num_files;
+	uint32_t capacity;
+	/**
+	 * Number of blocks buffered in all files, which are reserved: taken out
+	 * of the free blocks, but not chosen yet.
+	 */
+	uint32_t blocks;
+
+} delalloc_table;
+
+/**
+ * Initialize an empty table.
+ *
+ * @return  true on success; false if out of memory.
+ */
+bool delalloc_init(delalloc_table *dt);
+
+/** Free all memory used by the table, dropping any buffered data. */
+void delalloc_destroy(delalloc_table *dt);
+
+/** Return the buffered blocks of a file, or NULL if it has none. */
+delalloc_file *delalloc_find(delalloc_table *dt, a1fs_ino_t ino);
+
+/**
+ * Start buffering the blocks of a file from logical block first on. The
+ * pointers returned before for other files may no longer be valid.
+ *
+ * @return  the new entry, with no blocks; NULL if out of memory.
+ */
+delalloc_file *delalloc_add(delalloc_table *dt, a1fs_ino_t ino, uint32_t first);
+
+/**
+ * Buffer count blocks of a file instead of fewer, the new ones zero-filled.
+ * Return false if out of memory.
+ */
+bool delalloc_grow(delalloc_table *dt, delalloc_file *f, uint32_t count);
+
+/**
+ * Drop the buffered blocks of a file. The last entry of the table takes the
+ * place of the removed one.
+ */
+void delalloc_remove(delalloc_table *dt, delalloc_file *f);
@@ -0,0 +1,264 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Hashed directory index implementation.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "dir_index.h"
+
+
+/** FNV-1a hash of a name. The index is on disk, so this must never change. */
+static uint32_t dx_hash(const char *name)
+{
+	uint32_t h = 2166136261u;
+	for (const char *c = name; *c != '\0'; c++) {
+		h ^= (unsigned char) *c;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static a1fs_dx_root *dx_root(fs_ctx *fs, a1fs_blk_t root_blk)
+{
+	return (a1fs_dx_root *) get_addr_of_block(fs, root_blk);
+}
+
+/** Return bucket number b. */
+static a1fs_dx_bucket *dx_bucket_at(fs_ctx *fs, a1fs_dx_root *root, uint32_t b)
+{
+	a1fs_blk_t *map = (a1fs_blk_t *) get_addr_of_block(fs, root->map[b / A1FS_DX_MAP_ENTRIES]);
+	return (a1fs_dx_bucket *) get_addr_of_block(fs, map[b % A1FS_DX_MAP_ENTRIES]);
+}
+
+/** Return the bucket that the given hash falls into. */
+static a1fs_dx_bucket *dx_bucket(fs_ctx *fs, a1fs_dx_root *root, uint32_t hash)
+{
+	return dx_bucket_at(fs, root, hash & (root->num_buckets - 1));
+}
+
+/**
+ * Allocate an empty index of a directory with the given number of buckets.
+ * Return false if the index would be too large or there is not enough space.
+ */
+static bool dx_alloc(fs_ctx *fs, uint32_t dir_inode_num, uint32_t num_buckets, a1fs_blk_t *root_blk)
+{
+	uint32_t num_map_blocks = (num_buckets + A1FS_DX_MAP_ENTRIES - 1) / A1FS_DX_MAP_ENTRIES;
+	if (num_map_blocks > A1FS_DX_MAX_MAP_BLOCKS
+	    || get_unreserved_blocks(fs) < 1 + num_map_blocks + num_buckets) {
+		return false;
+	}
+
+	// the check above doesn't promise the blocks (e.g. a thin image may fail
+	// to grow), so an allocation can still fail, and the index goes again
+	if (!allocate_data_block(fs, dir_inode_num, root_blk)) {
+		return false;
+	}
+	a1fs_dx_root *root = dx_root(fs, *root_blk);
+	root->num_buckets = num_buckets;
+	root->num_map_blocks = num_map_blocks;
+
+	uint32_t m = 0;
+	uint32_t b = 0;
+	for (; m < num_map_blocks; m++) {
+		if (!allocate_data_block(fs, dir_inode_num, &root->map[m])) {
+			goto fail;
+		}
+	}
+	for (; b < num_buckets; b++) {
+		a1fs_blk_t *map = (a1fs_blk_t *) get_addr_of_block(fs, root->map[b / A1FS_DX_MAP_ENTRIES]);
+		if (!allocate_data_block(fs, dir_inode_num, &map[b % A1FS_DX_MAP_ENTRIES])) {
+			goto fail;
+		}
+		dx_bucket_at(fs, root, b)->count = 0;
+	}
+	return true;
+
+fail:
+	while (b > 0) {
+		b--;
+		a1fs_blk_t *map = (a1fs_blk_t *) get_addr_of_block(fs, root->map[b / A1FS_DX_MAP_ENTRIES]);
+		free_data_block(fs, map[b % A1FS_DX_MAP_ENTRIES]);
+	}
+	while (m > 0) {
+		free_data_block(fs, root->map[--m]);
+	}
+	free_data_block(fs, *root_blk);
+	return false;
+}
+
+/** Free all the blocks of an index. */
+static void dx_free(fs_ctx *fs, a1fs_blk_t root_blk)
+{
+	a1fs_dx_root *root = dx_root(fs, root_blk);
+	for (uint32_t b = 0; b < root->num_buckets; b++) {
+		a1fs_blk_t *map = (a1fs_blk_t *) get_addr_of_block(fs, root->map[b / A1FS_DX_MAP_ENTRIES]);
+		free_data_block(fs, map[b % A1FS_DX_MAP_ENTRIES]);
+	}
+	for (uint32_t m = 0; m < root->num_map_blocks; m++) {
+		free_data_block(fs, root->map[m]);
+	}
+	free_data_block(fs, root_blk);
+}
+
+/** Append an entry to its bucket. Return false if the bucket is full. */
+static bool dx_add(fs_ctx *fs, a1fs_dx_root *root, uint32_t hash, uint32_t slot)
+{
+	a1fs_dx_bucket *bucket = dx_bucket(fs, root, hash);
+	if (bucket->count == A1FS_DX_BUCKET_ENTRIES) {
+		return false;
+	}
+	bucket->entries[bucket->count].hash = hash;
+	bucket->entries[bucket->count].slot = slot;
+	bucket->count++;
+	return true;
+}
+
+/** Return the index entry for (name, slot), or NULL if there is none. */
+static a1fs_dx_entry *dx_find(fs_ctx *fs, uint32_t dir_inode_num, const char *name,
+                              uint32_t slot, a1fs_dx_bucket **bucket_out)
+{
+	uint32_t hash = dx_hash(name);
+	a1fs_dx_bucket *bucket = dx_bucket(fs, dx_root(fs, fs->inode_table[dir_inode_num].dir_index), hash);
+	for (uint32_t i = 0; i < bucket->count; i++) {
+		if (bucket->entries[i].hash == hash && bucket->entries[i].slot == slot) {
+			*bucket_out = bucket;
+			return &bucket->entries[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Replace the index of a directory with one that has twice as many buckets.
+ * The entries are moved using their stored hashes, so no dentry is read.
+ */
+static bool dx_grow(fs_ctx *fs, uint32_t dir_inode_num)
+{
+	a1fs_inode *dir = &fs->inode_table[dir_inode_num];
+	a1fs_dx_root *old_root = dx_root(fs, dir->dir_index);
+
+	for (uint32_t num_buckets = old_root->num_buckets * 2; ; num_buckets *= 2) {
+		a1fs_blk_t new_root_blk;
+		if (!dx_alloc(fs, dir_inode_num, num_buckets, &new_root_blk)) {
+			return false;
+		}
+
+		a1fs_dx_root *new_root = dx_root(fs, new_root_blk);
+		bool fits = true;
+		for (uint32_t b = 0; b < old_root->num_buckets && fits; b++) {
+			a1fs_dx_bucket *bucket = dx_bucket_at(fs, old_root, b);
+			for (uint32_t i = 0; i < bucket->count && fits; i++) {
+				fits = dx_add(fs, new_root, bucket->entries[i].hash, bucket->entries[i].slot);
+			}
+		}
+
+		if (fits) {
+			dx_free(fs, dir->dir_index);
+			dir->dir_index = new_root_blk;
+			return true;
+		}
+		// too many hashes collide in one bucket; try again with more buckets
+		dx_free(fs, new_root_blk);
+	}
+}
+
+/** Argument of dx_build_entry(). */
+typedef struct dx_build_arg {
+	fs_ctx *fs;
+	uint32_t dir_inode_num;
+} dx_build_arg;
+
+/** iterate_dentries() callback that adds an entry to the index. */
+static int dx_build_entry(void *arg, a1fs_ino_t ino, const char *name, uint32_t slot, uint32_t next)
+{
+	(void) ino;
+	(void) next;
+	dx_build_arg *build = (dx_build_arg *) arg;
+	return dx_insert(build->fs, build->dir_inode_num, name, slot) ? 0 : -ENOSPC;
+}
+
+bool dx_build(fs_ctx *fs, uint32_t dir_inode_num)
+{
+	a1fs_inode *dir = &fs->inode_table[dir_inode_num];
+
+	// start with the buckets about half full
+	uint32_t num_buckets = 1;
+	while (num_buckets * A1FS_DX_BUCKET_ENTRIES / 2 < dir->num_dir_entry) {
+		num_buckets *= 2;
+	}
+
+	a1fs_blk_t root_blk;
+	if (!dx_alloc(fs, dir_inode_num, num_buckets, &root_blk)) {
+		return false;
+	}
+	dir->dir_index = root_blk;
+	dir->flags |= A1FS_INODE_DIR_INDEX;
+
+	dx_build_arg build = {fs, dir_inode_num};
+	if (iterate_dentries(fs, dir_inode_num, 0, dx_build_entry, &build) != 0) {
+		dx_destroy(fs, dir_inode_num);
+		return false;
+	}
+	return true;
+}
+
+void dx_destroy(fs_ctx *fs, uint32_t dir_inode_num)
+{
+	a1fs_inode *dir = &fs->inode_table[dir_inode_num];
+	if (dir->flags & A1FS_INODE_DIR_INDEX) {
+		dx_free(fs, dir->dir_index);
+		dir->flags &= ~A1FS_INODE_DIR_INDEX;
+	}
+}
+
+int64_t dx_lookup(fs_ctx *fs, uint32_t dir_inode_num, const char *name)
+{
+	uint32_t hash = dx_hash(name);
+	a1fs_dx_bucket *bucket = dx_bucket(fs, dx_root(fs, fs->inode_table[dir_inode_num].dir_index), hash);
+	for (uint32_t i = 0; i < bucket->count; i++) {
+		if (bucket->entries[i].hash != hash) {
+			continue;
+		}
+		if (strcmp(get_dentry(fs, dir_inode_num, bucket->entries[i].slot, NULL), name) == 0) {
+			return bucket->entries[i].slot;
+		}
+	}
+	return -1;
+}
+
+bool dx_insert(fs_ctx *fs, uint32_t dir_inode_num, const char *name, uint32_t slot)
+{
+	uint32_t hash = dx_hash(name);
+	if (dx_add(fs, dx_root(fs, fs->inode_table[dir_inode_num].dir_index), hash, slot)) {
+		return true;
+	}
+	if (!dx_grow(fs, dir_inode_num)) {
+		return false;
+	}
+	return dx_add(fs, dx_root(fs, fs->inode_table[dir_inode_num].dir_index), hash, slot);
+}
+
+void dx_remove(fs_ctx *fs, uint32_t dir_inode_num, const char *name, uint32_t slot)
+{
+	a1fs_dx_bucket *bucket;
+	a1fs_dx_entry *entry = dx_find(fs, dir_inode_num, name, slot, &bucket);
+	if (entry != NULL) {
+		*entry = bucket->entries[bucket->count - 1];
+		bucket->count--;
+	}
+}
@@ -0,0 +1,56 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Hashed directory index header file.
+ *
+ * See a1fs_dx_root in a1fs.h for the on-disk layout.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fs_ctx.h"
+
+
+/**
+ * Build an index for all the existing entries of a directory.
+ *
+ * @return  true on success; false if there is not enough free space, in which
+ *          case the directory is left without an index.
+ */
+bool dx_build(fs_ctx *fs, uint32_t dir_inode_num);
+
+/** Free all the blocks of a directory's index and clear its index flag. */
+void dx_destroy(fs_ctx *fs, uint32_t dir_inode_num);
+
+/**
+ * Find an entry through the index.
+ *
+ * @return  the slot of the dentry with the given name, or -1 if there is none.
+ */
+int64_t dx_lookup(fs_ctx *fs, uint32_t dir_inode_num, const char *name);
+
+/**
+ * Add an entry to the index, doubling the number of buckets if needed.
+ *
+ * @return  true on success; false if there is not enough free space, in which
+ *          case the index is left unchanged.
+ */
+bool dx_insert(fs_ctx *fs, uint32_t dir_inode_num, const char *name, uint32_t slot);
+
+/** Remove the entry for the dentry with the given name and slot. */
+void dx_remove(fs_ctx *fs, uint32_t dir_inode_num, const char *name, uint32_t slot);
@@ -0,0 +1,102 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Discard of freed blocks implementation.
+ */
+
+#include <stdlib.h>
+
+#include "discard.h"
+
+
+/** Number of entries in a new list. */
+#define DISCARD_LIST_INITIAL 64
+
+bool discard_init(discard_list *dl)
+{
+	dl->ranges = malloc(DISCARD_LIST_INITIAL * sizeof(discard_range));
+	dl->num_ranges = 0;
+	dl->capacity = DISCARD_LIST_INITIAL;
+	dl->blocks = 0;
+	return dl->ranges != NULL;
+}
+
+void discard_destroy(discard_list *dl)
+{
+	free(dl->ranges);
+	dl->ranges = NULL;
+	dl->num_ranges = 0;
+	dl->capacity = 0;
+	dl->blocks = 0;
+}
+
+bool discard_add(discard_list *dl, uint32_t start, uint32_t count)
+{
+	// a file is freed from its end, extent by extent, so the ranges often
+	// follow each other
+	discard_range *last = dl->num_ranges > 0 ? &dl->ranges[dl->num_ranges - 1] : NULL;
+	if (last != NULL && last->start + last->count == start) {
+		last->count += count;
+		dl->blocks += count;
+		return true;
+	}
+	if (dl->num_ranges == dl->capacity) {
+		discard_range *ranges = realloc(dl->ranges, 2 * dl->capacity * sizeof(discard_range));
+		if (ranges == NULL) {
+			return false;
+		}
+		dl->ranges = ranges;
+		dl->capacity *= 2;
+	}
+	dl->ranges[dl->num_ranges++] = (discard_range) {start, count};
+	dl->blocks += count;
+	return true;
+}
+
+static int compare_ranges(const void *a, const void *b)
+{
+	uint32_t x = ((const discard_range *) a)->start;
+	uint32_t y = ((const discard_range *) b)->start;
+	return (x > y) - (x < y);
+}
+
+void discard_sort(discard_list *dl)
+{
+	if (dl->num_ranges == 0) {
+		return;
+	}
+	qsort(dl->ranges, dl->num_ranges, sizeof(discard_range), compare_ranges);
+	uint32_t n = 0;
+	for (uint32_t i = 1; i < dl->num_ranges; i++) {
+		discard_range *last = &dl->ranges[n];
+		discard_range *r = &dl->ranges[i];
+		if (r->start <= last->start + last->count) {
+			// freed, allocated and freed again, or next to each other
+			uint32_t end = r->start + r->count;
+			if (end > last->start + last->count) {
+				last->count = end - last->start;
+			}
+		} else {
+			dl->ranges[++n] = *r;
+		}
+	}
+	dl->num_ranges = n + 1;
+}
+
+void discard_clear(discard_list *dl)
+{
+	dl->num_ranges = 0;
+	dl->blocks = 0;
+}
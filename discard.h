@@ -0,0 +1,74 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Discard of freed blocks header file.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/** Freed blocks gathered before they are discarded, unless set by a mount option. */
+#define DISCARD_BATCH_DEFAULT 2048
+
+/** A range of freed blocks, numbered from the first data block. */
+typedef struct discard_range {
+	uint32_t start;
+	uint32_t count;
+
+} discard_range;
+
+/**
+ * The blocks freed since the last discard, to be given back to the host file
+ * the image is in. Some of them may have been allocated again since.
+ */
+typedef struct discard_list {
+	discard_range *ranges;
+	uint32_t num_ranges;
+	uint32_t capacity;
+	/** Number of blocks added since the list was last cleared. */
+	uint32_t blocks;
+
+} discard_list;
+
+/**
+ * Initialize an empty list.
+ *
+ * @return  true on success; false if out of memory.
+ */
+bool discard_init(discard_list *dl);
+
+/** Free all memory used by the list. */
+void discard_destroy(discard_list *dl);
+
+/**
+ * Add a range of freed blocks, joining the last range if it ends right before
+ * it.
+ *
+ * @return  true on success; false if out of memory, in which case the blocks
+ *          are not discarded.
+ */
+bool discard_add(discard_list *dl, uint32_t start, uint32_t count);
+
+/**
+ * Sort the ranges by their first block and join the ones that touch or
+ * overlap, so that they can be discarded in as few calls as possible.
+ */
+void discard_sort(discard_list *dl);
+
+/** Remove all ranges. */
+void discard_clear(discard_list *dl);
@@ -0,0 +1,603 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Extent tree implementation.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "extent_tree.h"
+
+
+/** Return the leaf entries of a node. */
+static a1fs_extent *leaf_entries(a1fs_extent_header *node)
+{
+	return (a1fs_extent *) (node + 1);
+}
+
+/** Return the internal node entries of a node. */
+static a1fs_extent_index *index_entries(a1fs_extent_header *node)
+{
+	return (a1fs_extent_index *) (node + 1);
+}
+
+/** Return the size of an entry of a node. */
+static size_t entry_size(a1fs_extent_header *node)
+{
+	return node->depth == 0 ? sizeof(a1fs_extent) : sizeof(a1fs_extent_index);
+}
+
+/** Return the address of an entry of a node. */
+static void *entry_at(a1fs_extent_header *node, uint32_t i)
+{
+	return (char *) (node + 1) + i * entry_size(node);
+}
+
+/** Return the logical block of an entry, which comes first in both kinds. */
+static uint32_t entry_key(a1fs_extent_header *node, uint32_t i)
+{
+	return *(a1fs_blk_t *) entry_at(node, i);
+}
+
+/** Return the child node of an internal node entry. */
+static a1fs_extent_header *node_child(fs_ctx *fs, a1fs_extent_header *node, uint32_t i)
+{
+	return (a1fs_extent_header *) get_addr_of_block(fs, index_entries(node)[i].child);
+}
+
+/**
+ * Return the last entry of a non-empty node whose logical block is not after
+ * the given block, or 0 if there is none.
+ */
+static uint32_t node_search(a1fs_extent_header *node, uint32_t block)
+{
+	uint32_t lo = 0;
+	uint32_t hi = node->count;
+	while (hi - lo > 1) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (entry_key(node, mid) <= block) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/** Allocate an empty node block. */
+static bool node_alloc(fs_ctx *fs, a1fs_inode *inode, uint16_t depth,
+                       a1fs_blk_t *blk, a1fs_extent_header **node)
+{
+	if (!allocate_data_block(fs, (uint32_t) (inode - fs->inode_table), blk)) {
+		return false;
+	}
+	inode->extent_blocks++;
+	*node = (a1fs_extent_header *) get_addr_of_block(fs, *blk);
+	(*node)->count = 0;
+	(*node)->max = depth == 0 ? A1FS_EXTENT_LEAF_MAX : A1FS_EXTENT_INDEX_MAX;
+	(*node)->depth = depth;
+	(*node)->padding = 0;
+	return true;
+}
+
+/** Free a node block. */
+static void node_free(fs_ctx *fs, a1fs_inode *inode, a1fs_blk_t blk)
+{
+	free_data_block(fs, blk);
+	inode->extent_blocks--;
+}
+
+/** Put an entry at the given position of a node that has room for it. */
+static void node_insert_at(a1fs_extent_header *node, uint32_t pos, const void *entry)
+{
+	size_t size = entry_size(node);
+	memmove(entry_at(node, pos + 1), entry_at(node, pos), (node->count - pos) * size);
+	memcpy(entry_at(node, pos), entry, size);
+	node->count++;
+}
+
+/**
+ * Add an entry at the given position of a node. A full node is split into a
+ * new right sibling, whose block and first logical block are returned in
+ * split_blk and split_key (split_blk is 0 if there was no split). The root
+ * can't have a sibling, so the tree grows a level instead.
+ */
+static int node_add(fs_ctx *fs, a1fs_inode *inode, a1fs_extent_header *node, uint32_t pos,
+                    const void *entry, a1fs_blk_t *split_blk, uint32_t *split_key)
+{
+	*split_blk = 0;
+	if (node->count < node->max) {
+		node_insert_at(node, pos, entry);
+		return 0;
+	}
+
+	a1fs_blk_t blk;
+	a1fs_extent_header *new_node;
+	if (!node_alloc(fs, inode, node->depth, &blk, &new_node)) {
+		return -ENOSPC;
+	}
+
+	if (node == &inode->extent_root) {
+		// move the entries of the root to a new node, its only child, which
+		// has room for one more since a block is larger than the inode
+		new_node->count = node->count;
+		memcpy(new_node + 1, node + 1, node->count * entry_size(node));
+		node_insert_at(new_node, pos, entry);
+		node->depth++;
+		node->max = A1FS_INODE_EXTENT_INDEX_MAX;
+		node->count = 1;
+		index_entries(node)[0].logical = entry_key(new_node, 0);
+		index_entries(node)[0].child = blk;
+		return 0;
+	}
+
+	// files mostly grow at the end, so an append leaves the full node as it
+	// is and starts the new one; otherwise the entries are split in half
+	uint32_t keep = pos == node->count ? node->count : node->count / 2u;
+	new_node->count = node->count - keep;
+	memcpy(new_node + 1, entry_at(node, keep), new_node->count * entry_size(node));
+	node->count = keep;
+	if (keep < node->max && pos <= keep) {
+		node_insert_at(node, pos, entry);
+	} else {
+		node_insert_at(new_node, pos - keep, entry);
+	}
+	*split_blk = blk;
+	*split_key = entry_key(new_node, 0);
+	return 0;
+}
+
+/** Insert an extent into a subtree. See node_add() for split_blk and split_key. */
+static int node_insert(fs_ctx *fs, a1fs_inode *inode, a1fs_extent_header *node,
+                       const a1fs_extent *extent, a1fs_blk_t *split_blk, uint32_t *split_key)
+{
+	if (node->depth == 0) {
+		uint32_t pos = 0;
+		if (node->count > 0) {
+			pos = node_search(node, extent->logical);
+			if (entry_key(node, pos) <= extent->logical) {
+				pos++;
+			}
+		}
+		return node_add(fs, inode, node, pos, extent, split_blk, split_key);
+	}
+
+	uint32_t i = node_search(node, extent->logical);
+	if (extent->logical < index_entries(node)[i].logical) {
+		// a new first extent of the file
+		index_entries(node)[i].logical = extent->logical;
+	}
+	a1fs_blk_t child_split_blk;
+	uint32_t child_split_key;
+	int ret = node_insert(fs, inode, node_child(fs, node, i), extent, &child_split_blk, &child_split_key);
+	*split_blk = 0;
+	if (ret != 0 || child_split_blk == 0) {
+		return ret;
+	}
+	a1fs_extent_index index = {child_split_key, child_split_blk};
+	return node_add(fs, inode, node, i + 1, &index, split_blk, split_key);
+}
+
+/** Find an extent in a subtree. See extent_find(). */
+static bool node_find(fs_ctx *fs, a1fs_extent_header *node, uint32_t block, a1fs_extent *extent)
+{
+	if (node->count == 0) {
+		return false;
+	}
+	uint32_t i = node_search(node, block);
+	if (node->depth == 0) {
+		a1fs_extent *extents = leaf_entries(node);
+		for (; i < node->count; i++) {
+			if (extents[i].logical + extents[i].count > block) {
+				*extent = extents[i];
+				return true;
+			}
+		}
+		return false;
+	}
+	// the next child has the next extent if this one has nothing past block
+	for (; i < node->count; i++) {
+		if (node_find(fs, node_child(fs, node, i), block, extent)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Free a subtree, except for the node itself, and all the blocks its extents
+ * map unless free_data is false.
+ */
+static void node_free_all(fs_ctx *fs, a1fs_inode *inode, a1fs_extent_header *node, bool free_data)
+{
+	for (uint32_t i = 0; i < node->count; i++) {
+		if (node->depth == 0) {
+			a1fs_extent *extent = &leaf_entries(node)[i];
+			if (free_data) {
+				free_data_blocks(fs, extent->start, extent->count);
+			}
+			inode->extent_num--;
+		} else {
+			node_free_all(fs, inode, node_child(fs, node, i), free_data);
+			node_free(fs, inode, index_entries(node)[i].child);
+		}
+	}
+	node->count = 0;
+}
+
+/**
+ * Merge the given child of an internal node into its left sibling if they
+ * both fit in one node.
+ */
+static void node_merge(fs_ctx *fs, a1fs_inode *inode, a1fs_extent_header *node, uint32_t i)
+{
+	if (i == 0) {
+		return;
+	}
+	a1fs_extent_header *left = node_child(fs, node, i - 1);
+	a1fs_extent_header *right = node_child(fs, node, i);
+	if (left->count + right->count > left->max) {
+		return;
+	}
+	memcpy(entry_at(left, left->count), right + 1, right->count * entry_size(right));
+	left->count += right->count;
+	node_free(fs, inode, index_entries(node)[i].child);
+	memmove(&index_entries(node)[i], &index_entries(node)[i + 1],
+	        (node->count - i - 1) * sizeof(a1fs_extent_index));
+	node->count--;
+}
+
+/** Remove the mappings from block on in a subtree. See extent_truncate(). */
+static void node_truncate(fs_ctx *fs, a1fs_inode *inode, a1fs_extent_header *node, uint32_t block)
+{
+	if (node->depth == 0) {
+		a1fs_extent *extents = leaf_entries(node);
+		while (node->count > 0) {
+			a1fs_extent *last = &extents[node->count - 1];
+			if (last->logical + last->count <= block) {
+				break;
+			}
+			uint32_t keep = last->logical < block ? block - last->logical : 0;
+			free_data_blocks(fs, last->start + keep, last->count - keep);
+			last->count = keep;
+			if (keep > 0) {
+				break;
+			}
+			node->count--;
+			inode->extent_num--;
+		}
+		return;
+	}
+
+	a1fs_extent_index *children = index_entries(node);
+	while (node->count > 0) {
+		uint32_t i = node->count - 1;
+		a1fs_extent_header *child = node_child(fs, node, i);
+		if (children[i].logical < block) {
+			node_truncate(fs, inode, child, block);
+			if (child->count > 0) {
+				// the last child may now be small enough to join its sibling
+				node_merge(fs, inode, node, i);
+				break;
+			}
+		} else {
+			node_free_all(fs, inode, child, true);
+		}
+		node_free(fs, inode, children[i].child);
+		node->count--;
+	}
+}
+
+bool extent_find(fs_ctx *fs, a1fs_inode *inode, uint32_t block, a1fs_extent *extent)
+{
+	if (inode->extent_num == 0) {
+		return false;
+	}
+	return node_find(fs, &inode->extent_root, block, extent);
+}
+
+a1fs_extent *extent_last(fs_ctx *fs, a1fs_inode *inode)
+{
+	if (inode->extent_num == 0) {
+		return NULL;
+	}
+	a1fs_extent_header *node = &inode->extent_root;
+	while (node->depth > 0) {
+		node = node_child(fs, node, node->count - 1);
+	}
+	return &leaf_entries(node)[node->count - 1];
+}
+
+a1fs_extent *extent_before(fs_ctx *fs, a1fs_inode *inode, uint32_t block)
+{
+	if (inode->extent_num == 0) {
+		return NULL;
+	}
+	a1fs_extent_header *node = &inode->extent_root;
+	while (node->depth > 0) {
+		node = node_child(fs, node, node_search(node, block));
+	}
+	if (node->count == 0) {
+		return NULL;
+	}
+	a1fs_extent *extent = &leaf_entries(node)[node_search(node, block)];
+	return extent->logical <= block ? extent : NULL;
+}
+
+a1fs_extent *extent_lookup(fs_ctx *fs, a1fs_inode *inode, uint32_t block)
+{
+	a1fs_extent *extent = extent_before(fs, inode, block);
+	if (extent == NULL || block - extent->logical >= extent->count) {
+		return NULL;
+	}
+	return extent;
+}
+
+/** Return the number of blocks mapped by the extents of a subtree. */
+static uint32_t node_mapped(fs_ctx *fs, a1fs_extent_header *node)
+{
+	uint32_t total = 0;
+	for (uint32_t i = 0; i < node->count; i++) {
+		if (node->depth == 0) {
+			total += leaf_entries(node)[i].count;
+		} else {
+			total += node_mapped(fs, node_child(fs, node, i));
+		}
+	}
+	return total;
+}
+
+uint32_t extent_mapped(fs_ctx *fs, a1fs_inode *inode)
+{
+	if (inode->extent_num == 0) {
+		return 0;
+	}
+	return node_mapped(fs, &inode->extent_root);
+}
+
+int extent_insert(fs_ctx *fs, a1fs_inode *inode, const a1fs_extent *extent)
+{
+	a1fs_extent_header *root = &inode->extent_root;
+	if (inode->extent_num == 0) {
+		root->count = 0;
+		root->max = A1FS_INODE_EXTENT_LEAF_MAX;
+		root->depth = 0;
+		root->padding = 0;
+	}
+
+	// every full node on the way down may split (the root by growing a
+	// level), so check for space first to never fail halfway through
+	uint32_t full = 0;
+	for (a1fs_extent_header *node = root;; node = node_child(fs, node, node_search(node, extent->logical))) {
+		full += node->count == node->max;
+		if (node->depth == 0 || node->count == 0) {
+			break;
+		}
+	}
+	if (get_unreserved_blocks(fs) < full) {
+		return -ENOSPC;
+	}
+	a1fs_blk_t split_blk;
+	uint32_t split_key;
+	int ret = node_insert(fs, inode, root, extent, &split_blk, &split_key);
+	if (ret == 0) {
+		inode->extent_num++;
+	}
+	return ret;
+}
+
+/**
+ * Bring the tree down a level while the root has a single child that fits in
+ * the inode.
+ */
+static void tree_lower(fs_ctx *fs, a1fs_inode *inode)
+{
+	a1fs_extent_header *root = &inode->extent_root;
+	while (root->depth > 0) {
+		if (root->count == 0) {
+			root->depth = 0;
+			root->max = A1FS_INODE_EXTENT_LEAF_MAX;
+			break;
+		}
+		a1fs_blk_t blk = index_entries(root)[0].child;
+		a1fs_extent_header *child = node_child(fs, root, 0);
+		uint16_t max = child->depth == 0 ? A1FS_INODE_EXTENT_LEAF_MAX : A1FS_INODE_EXTENT_INDEX_MAX;
+		if (root->count > 1 || child->count > max) {
+			break;
+		}
+		root->depth = child->depth;
+		root->max = max;
+		root->count = child->count;
+		memcpy(root + 1, child + 1, child->count * entry_size(child));
+		node_free(fs, inode, blk);
+	}
+}
+
+void extent_truncate(fs_ctx *fs, a1fs_inode *inode, uint32_t block)
+{
+	if (inode->extent_num == 0) {
+		return;
+	}
+	node_truncate(fs, inode, &inode->extent_root, block);
+	tree_lower(fs, inode);
+}
+
+/**
+ * Change the key of the extent that starts at the given block in the internal
+ * nodes above it, before the extent itself is moved to start at new_block.
+ */
+static void tree_rekey(fs_ctx *fs, a1fs_inode *inode, uint32_t block, uint32_t new_block)
+{
+	a1fs_extent_header *node = &inode->extent_root;
+	while (node->depth > 0) {
+		uint32_t i = node_search(node, block);
+		if (index_entries(node)[i].logical == block) {
+			index_entries(node)[i].logical = new_block;
+		}
+		node = node_child(fs, node, i);
+	}
+}
+
+/**
+ * Remove the mappings of the blocks [first, end) in a subtree, and free those
+ * blocks unless free_data is false. An extent that covers the whole range is
+ * only cut at its end. Nodes that are left empty are freed, and the keys of
+ * the rest follow their first entries. Never needs a free block.
+ */
+static void node_unmap(fs_ctx *fs, a1fs_inode *inode, a1fs_extent_header *node,
+                       uint32_t first, uint32_t end, bool free_data)
+{
+	uint32_t i = node->count > 0 ? node_search(node, first) : 0;
+	if (node->depth == 0) {
+		a1fs_extent *extents = leaf_entries(node);
+		while (i < node->count && extents[i].logical < end) {
+			a1fs_extent *extent = &extents[i];
+			uint32_t extent_end = extent->logical + extent->count;
+			if (extent_end <= first) {
+				i++;
+				continue;
+			}
+			uint32_t from = extent->logical < first ? first : extent->logical;
+			uint32_t to = extent_end < end ? extent_end : end;
+			if (free_data) {
+				free_data_blocks(fs, extent->start + (from - extent->logical), to - from);
+			}
+			if (extent->logical < first) {
+				extent->count = first - extent->logical;
+				i++;
+			} else if (extent_end > end) {
+				uint32_t skip = end - extent->logical;
+				extent->logical += skip;
+				extent->start += skip;
+				extent->count -= skip;
+				break;
+			} else {
+				memmove(extent, extent + 1, (node->count - i - 1) * sizeof(a1fs_extent));
+				node->count--;
+				inode->extent_num--;
+			}
+		}
+		return;
+	}
+
+	a1fs_extent_index *children = index_entries(node);
+	while (i < node->count && children[i].logical < end) {
+		a1fs_extent_header *child = node_child(fs, node, i);
+		node_unmap(fs, inode, child, first, end, free_data);
+		if (child->count == 0) {
+			node_free(fs, inode, children[i].child);
+			memmove(&children[i], &children[i + 1], (node->count - i - 1) * sizeof(a1fs_extent_index));
+			node->count--;
+			continue;
+		}
+		children[i].logical = entry_key(child, 0);
+		i++;
+	}
+}
+
+/** Remove the mappings of the blocks [first, end). See node_unmap(). */
+static void tree_unmap(fs_ctx *fs, a1fs_inode *inode, uint32_t first, uint32_t end, bool free_data)
+{
+	node_unmap(fs, inode, &inode->extent_root, first, end, free_data);
+	tree_lower(fs, inode);
+}
+
+int extent_mark_written(fs_ctx *fs, a1fs_inode *inode, uint32_t block)
+{
+	a1fs_extent *extent = extent_lookup(fs, inode, block);
+	if (extent->count == 1) {
+		extent->flags &= ~A1FS_EXTENT_UNWRITTEN;
+		return 0;
+	}
+	a1fs_extent written = {block, extent->start + (block - extent->logical), 1, 0};
+
+	if (block == extent->logical) {
+		// written in order, the blocks go to the end of the extent before
+		a1fs_extent *prev = block > 0 ? extent_lookup(fs, inode, block - 1) : NULL;
+		tree_rekey(fs, inode, block, block + 1);
+		extent->logical++;
+		extent->start++;
+		extent->count--;
+		if (prev != NULL && !(prev->flags & A1FS_EXTENT_UNWRITTEN)
+		    && prev->start + prev->count == written.start) {
+			prev->count++;
+			return 0;
+		}
+		int ret = extent_insert(fs, inode, &written);
+		if (ret != 0) {
+			tree_rekey(fs, inode, block + 1, block);
+			extent->logical--;
+			extent->start--;
+			extent->count++;
+		}
+		return ret;
+	}
+
+	if (block == extent->logical + extent->count - 1) {
+		extent->count--;
+		int ret = extent_insert(fs, inode, &written);
+		if (ret != 0) {
+			extent->count++;
+		}
+		return ret;
+	}
+
+	// in the middle, the extent is split in three: the rest after the block
+	// goes in first, while the extent still maps all of it, and the extent
+	// is only cut once the block has its own; a node split may move the
+	// extent, so it is looked up again each time
+	uint32_t logical = extent->logical;
+	a1fs_extent rest = {block + 1, written.start + 1, extent->logical + extent->count - block - 1,
+	                    extent->flags};
+	int ret = extent_insert(fs, inode, &rest);
+	if (ret != 0) {
+		return ret;
+	}
+	extent = extent_lookup(fs, inode, block);
+	extent->count = block - logical;
+	ret = extent_insert(fs, inode, &written);
+	if (ret != 0) {
+		// take the rest out again and give the extent back its blocks
+		tree_unmap(fs, inode, block + 1, rest.logical + rest.count, false);
+		extent = extent_lookup(fs, inode, logical);
+		extent->count += 1 + rest.count;
+	}
+	return ret;
+}
+
+int extent_punch(fs_ctx *fs, a1fs_inode *inode, uint32_t first, uint32_t count)
+{
+	uint32_t end = first + count;
+	a1fs_extent *extent = extent_lookup(fs, inode, first);
+	if (extent != NULL && extent->logical < first && extent->logical + extent->count > end) {
+		// the range is inside one extent, which is split in two: the part
+		// after the range goes in first, so that nothing has changed if
+		// there is no room for it, and the extent is then cut below
+		a1fs_extent rest = *extent;
+		uint32_t skip = end - extent->logical;
+		rest.logical += skip;
+		rest.start += skip;
+		rest.count -= skip;
+		int ret = extent_insert(fs, inode, &rest);
+		if (ret != 0) {
+			return ret;
+		}
+	}
+	if (inode->extent_num > 0) {
+		tree_unmap(fs, inode, first, end, true);
+	}
+	return 0;
+}
@@ -0,0 +1,91 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Extent tree header file.
+ *
+ * See a1fs_extent_header in a1fs.h for the on-disk layout. The tree of a file
+ * is only valid while its extent_num is not 0; an empty tree has no blocks.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fs_ctx.h"
+
+
+/**
+ * Find the extent holding the given block of a file, or the first one after
+ * it if the block is not mapped.
+ *
+ * @return  true if there is such an extent; false otherwise.
+ */
+bool extent_find(fs_ctx *fs, a1fs_inode *inode, uint32_t block, a1fs_extent *extent);
+
+/** Return the extent that maps the last block of a file, or NULL if there is none. */
+a1fs_extent *extent_last(fs_ctx *fs, a1fs_inode *inode);
+
+/**
+ * Return the extent that maps the given block of a file, in the tree itself,
+ * or NULL if the block is not mapped.
+ */
+a1fs_extent *extent_lookup(fs_ctx *fs, a1fs_inode *inode, uint32_t block);
+
+/**
+ * Return the last extent of a file that starts at or before the given block,
+ * in the tree itself, or NULL if there is none.
+ */
+a1fs_extent *extent_before(fs_ctx *fs, a1fs_inode *inode, uint32_t block);
+
+/**
+ * Return the number of blocks that the extents of a file map, which is less
+ * than its last block if it has holes.
+ */
+uint32_t extent_mapped(fs_ctx *fs, a1fs_inode *inode);
+
+/**
+ * Add an extent to a file. It must not overlap any existing one.
+ *
+ * @return  0 on success; -ENOSPC if there are no free blocks for the tree, in
+ *          which case the tree is left unchanged.
+ */
+int extent_insert(fs_ctx *fs, a1fs_inode *inode, const a1fs_extent *extent);
+
+/**
+ * Remove the mappings of all the blocks of a file from the given one on, and
+ * free those blocks and the tree nodes that are no longer needed.
+ */
+void extent_truncate(fs_ctx *fs, a1fs_inode *inode, uint32_t block);
+
+/**
+ * Take the given block of a file, which is in an unwritten extent, out of it
+ * into a written extent, joining the written extent before it if that one
+ * ends right before the block.
+ *
+ * @return  0 on success; -ENOSPC if there are no free blocks for the tree, in
+ *          which case the tree is left unchanged.
+ */
+int extent_mark_written(fs_ctx *fs, a1fs_inode *inode, uint32_t block);
+
+/**
+ * Remove the mappings of the blocks [first, first + count) of a file, and free
+ * those blocks. The extents around the range are cut or split as needed.
+ *
+ * @return  0 on success; -ENOSPC if there are no free blocks for the tree
+ *          (only needed when the range is inside one extent), in which case
+ *          the tree is left unchanged.
+ */
+int extent_punch(fs_ctx *fs, a1fs_inode *inode, uint32_t first, uint32_t count);
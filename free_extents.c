@@ -0,0 +1,345 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Free extent index implementation.
+ */
+
+#include <stdlib.h>
+
+#include "free_extents.h"
+
+
+/** The two trees a free extent is in. */
+enum { BY_START, BY_COUNT };
+
+/** Return the height of a subtree. */
+static int height(free_extent *n, int tree)
+{
+	return n == NULL ? 0 : n->link[tree].height;
+}
+
+/** Return the max_count of a subtree of the tree by start. */
+static uint32_t max_count(free_extent *n)
+{
+	return n == NULL ? 0 : n->max_count;
+}
+
+/** Return true if a comes before b in the given tree. */
+static bool before(free_extent *a, free_extent *b, int tree)
+{
+	if (tree == BY_COUNT && a->count != b->count) {
+		return a->count < b->count;
+	}
+	return a->start < b->start;
+}
+
+/** Recompute the height (and max_count) of a node from its children. */
+static void update(free_extent *n, int tree)
+{
+	free_extent *l = n->link[tree].child[0];
+	free_extent *r = n->link[tree].child[1];
+	int hl = height(l, tree), hr = height(r, tree);
+	n->link[tree].height = 1 + (hl > hr ? hl : hr);
+	if (tree == BY_START) {
+		uint32_t m = n->count;
+		m = max_count(l) > m ? max_count(l) : m;
+		n->max_count = max_count(r) > m ? max_count(r) : m;
+	}
+}
+
+/** Rotate a subtree so that its child on the given side becomes its root. */
+static free_extent *rotate(free_extent *n, int tree, int side)
+{
+	free_extent *c = n->link[tree].child[side];
+	n->link[tree].child[side] = c->link[tree].child[!side];
+	c->link[tree].child[!side] = n;
+	update(n, tree);
+	update(c, tree);
+	return c;
+}
+
+/** Restore the AVL balance of a subtree whose children are balanced. */
+static free_extent *rebalance(free_extent *n, int tree)
+{
+	update(n, tree);
+	int diff = height(n->link[tree].child[1], tree) - height(n->link[tree].child[0], tree);
+	if (diff < -1 || diff > 1) {
+		int side = diff > 0;
+		free_extent *c = n->link[tree].child[side];
+		if (height(c->link[tree].child[!side], tree) > height(c->link[tree].child[side], tree)) {
+			n->link[tree].child[side] = rotate(c, tree, !side);
+		}
+		return rotate(n, tree, side);
+	}
+	return n;
+}
+
+/** Insert a node into a subtree, returning its new root. */
+static free_extent *insert(free_extent *root, free_extent *n, int tree)
+{
+	if (root == NULL) {
+		n->link[tree].child[0] = n->link[tree].child[1] = NULL;
+		update(n, tree);
+		return n;
+	}
+	int side = !before(n, root, tree);
+	root->link[tree].child[side] = insert(root->link[tree].child[side], n, tree);
+	return rebalance(root, tree);
+}
+
+/** Unlink the first node of a non-empty subtree into *min, returning the new root. */
+static free_extent *remove_min(free_extent *root, int tree, free_extent **min)
+{
+	if (root->link[tree].child[0] == NULL) {
+		*min = root;
+		return root->link[tree].child[1];
+	}
+	root->link[tree].child[0] = remove_min(root->link[tree].child[0], tree, min);
+	return rebalance(root, tree);
+}
+
+/** Remove a node from a subtree that contains it, returning the new root. */
+static free_extent *remove_node(free_extent *root, free_extent *n, int tree)
+{
+	if (root != n) {
+		int side = !before(n, root, tree);
+		root->link[tree].child[side] = remove_node(root->link[tree].child[side], n, tree);
+		return rebalance(root, tree);
+	}
+	free_extent *l = n->link[tree].child[0];
+	free_extent *r = n->link[tree].child[1];
+	if (r == NULL) {
+		return l;
+	}
+	// the next node takes the place of the removed one
+	free_extent *next;
+	r = remove_min(r, tree, &next);
+	next->link[tree].child[0] = l;
+	next->link[tree].child[1] = r;
+	return rebalance(next, tree);
+}
+
+/** Add a node to both trees. */
+static void link_extent(free_extents *fe, free_extent *n)
+{
+	fe->root[BY_START] = insert(fe->root[BY_START], n, BY_START);
+	fe->root[BY_COUNT] = insert(fe->root[BY_COUNT], n, BY_COUNT);
+	fe->count++;
+}
+
+/** Remove a node from both trees. */
+static void unlink_extent(free_extents *fe, free_extent *n)
+{
+	fe->root[BY_START] = remove_node(fe->root[BY_START], n, BY_START);
+	fe->root[BY_COUNT] = remove_node(fe->root[BY_COUNT], n, BY_COUNT);
+	fe->count--;
+}
+
+/** Allocate a node for the blocks [start, start + count). */
+static free_extent *new_extent(uint32_t start, uint32_t count)
+{
+	free_extent *n = malloc(sizeof(*n));
+	if (n != NULL) {
+		n->start = start;
+		n->count = count;
+	}
+	return n;
+}
+
+/** Return the last extent that starts at or before block, or NULL if there is none. */
+static free_extent *floor_extent(free_extents *fe, uint32_t block)
+{
+	free_extent *found = NULL;
+	for (free_extent *n = fe->root[BY_START]; n != NULL;) {
+		if (n->start <= block) {
+			found = n;
+			n = n->link[BY_START].child[1];
+		} else {
+			n = n->link[BY_START].child[0];
+		}
+	}
+	return found;
+}
+
+/** Return the first extent that starts after block, or NULL if there is none. */
+static free_extent *next_extent(free_extents *fe, uint32_t block)
+{
+	free_extent *found = NULL;
+	for (free_extent *n = fe->root[BY_START]; n != NULL;) {
+		if (n->start > block) {
+			found = n;
+			n = n->link[BY_START].child[0];
+		} else {
+			n = n->link[BY_START].child[1];
+		}
+	}
+	return found;
+}
+
+/** Return the first extent in a subtree that starts at or after from and has at least count blocks. */
+static free_extent *first_fit(free_extent *n, uint32_t from, uint32_t count)
+{
+	while (n != NULL && n->max_count >= count) {
+		if (n->start < from) {
+			n = n->link[BY_START].child[1];
+			continue;
+		}
+		free_extent *l = first_fit(n->link[BY_START].child[0], from, count);
+		if (l != NULL) {
+			return l;
+		}
+		if (n->count >= count) {
+			return n;
+		}
+		n = n->link[BY_START].child[1];
+	}
+	return NULL;
+}
+
+bool free_extents_init(free_extents *fe, bitmap *bm)
+{
+	fe->root[BY_START] = fe->root[BY_COUNT] = NULL;
+	fe->count = 0;
+	uint32_t count;
+	for (uint32_t start = bitmap_next_free_run(bm, 0, &count); start != UINT32_MAX;
+	     start = bitmap_next_free_run(bm, start + count, &count)) {
+		free_extent *n = new_extent(start, count);
+		if (n == NULL) {
+			free_extents_destroy(fe);
+			return false;
+		}
+		link_extent(fe, n);
+	}
+	return true;
+}
+
+/** Free all the nodes of a subtree of the tree by start. */
+static void free_subtree(free_extent *n)
+{
+	if (n != NULL) {
+		free_subtree(n->link[BY_START].child[0]);
+		free_subtree(n->link[BY_START].child[1]);
+		free(n);
+	}
+}
+
+void free_extents_destroy(free_extents *fe)
+{
+	free_subtree(fe->root[BY_START]);
+	fe->root[BY_START] = fe->root[BY_COUNT] = NULL;
+	fe->count = 0;
+}
+
+bool free_extents_add(free_extents *fe, uint32_t start, uint32_t count)
+{
+	free_extent *prev = floor_extent(fe, start);
+	free_extent *next = next_extent(fe, start);
+	bool join_prev = prev != NULL && prev->start + prev->count == start;
+	bool join_next = next != NULL && start + count == next->start;
+
+	// reuse a neighbour's node for the joined extent
+	free_extent *n;
+	if (join_prev) {
+		n = prev;
+		unlink_extent(fe, prev);
+		n->count += count;
+	} else if (join_next) {
+		n = next;
+		unlink_extent(fe, next);
+		n->start = start;
+		n->count += count;
+		join_next = false;
+	} else {
+		n = new_extent(start, count);
+		if (n == NULL) {
+			return false;
+		}
+	}
+	if (join_next) {
+		unlink_extent(fe, next);
+		n->count += next->count;
+		free(next);
+	}
+	link_extent(fe, n);
+	return true;
+}
+
+bool free_extents_remove(free_extents *fe, uint32_t start, uint32_t count)
+{
+	free_extent *n = free_extents_lookup(fe, start);
+	uint32_t end = start + count;
+	uint32_t n_end = n->start + n->count;
+
+	// the blocks after the removed ones need a node of their own if there
+	// are blocks left before them too
+	free_extent *after = NULL;
+	if (end < n_end && n->start < start) {
+		after = new_extent(end, n_end - end);
+		if (after == NULL) {
+			return false;
+		}
+	}
+
+	unlink_extent(fe, n);
+	if (n->start < start) {
+		n->count = start - n->start;
+		link_extent(fe, n);
+	} else if (end < n_end) {
+		n->start = end;
+		n->count = n_end - end;
+		link_extent(fe, n);
+	} else {
+		free(n);
+	}
+	if (after != NULL) {
+		link_extent(fe, after);
+	}
+	return true;
+}
+
+free_extent *free_extents_lookup(free_extents *fe, uint32_t block)
+{
+	free_extent *n = floor_extent(fe, block);
+	return n != NULL && block - n->start < n->count ? n : NULL;
+}
+
+free_extent *free_extents_largest(free_extents *fe)
+{
+	free_extent *n = fe->root[BY_COUNT];
+	while (n != NULL && n->link[BY_COUNT].child[1] != NULL) {
+		n = n->link[BY_COUNT].child[1];
+	}
+	return n;
+}
+
+free_extent *free_extents_find(free_extents *fe, uint32_t count, uint32_t goal, alloc_policy policy)
+{
+	if (policy == ALLOC_BEST_FIT) {
+		// the first extent in the tree by (count, start) with enough blocks
+		free_extent *found = NULL;
+		for (free_extent *n = fe->root[BY_COUNT]; n != NULL;) {
+			if (n->count >= count) {
+				found = n;
+				n = n->link[BY_COUNT].child[0];
+			} else {
+				n = n->link[BY_COUNT].child[1];
+			}
+		}
+		return found;
+	}
+
+	free_extent *found = first_fit(fe->root[BY_START], goal, count);
+	return found != NULL ? found : first_fit(fe->root[BY_START], 0, count);
+}
@@ -0,0 +1,105 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Free extent index header file.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bitmap.h"
+
+
+/** How free_extents_find() picks a free extent. */
+typedef enum alloc_policy {
+	/** The first large enough free extent at or after the goal, wrapping around. */
+	ALLOC_NEXT_FIT,
+	/** The smallest large enough free extent, the lowest one of those of its size. */
+	ALLOC_BEST_FIT,
+} alloc_policy;
+
+/** Links of a free extent in one of the two trees. */
+typedef struct free_link {
+	struct free_extent *child[2];
+	int height;
+} free_link;
+
+/** A maximal run of free blocks. */
+typedef struct free_extent {
+	uint32_t start;
+	uint32_t count;
+	/** Largest count in the subtree of this extent in the tree by start. */
+	uint32_t max_count;
+	/** Links in the tree by start and in the tree by (count, start). */
+	free_link link[2];
+
+} free_extent;
+
+/**
+ * The free runs of the data bitmap, in two AVL trees: by start, to find the
+ * extent around a block and the first large enough one after it, and by
+ * length, to find the smallest large enough one. Built from the bitmap at
+ * mount and kept in step with it by free_extents_add() and
+ * free_extents_remove().
+ */
+typedef struct free_extents {
+	free_extent *root[2];
+	/** Number of free extents. */
+	uint32_t count;
+
+} free_extents;
+
+/**
+ * Build the index of the free runs of a bitmap.
+ *
+ * @param fe  the index to initialize.
+ * @param bm  the bitmap.
+ * @return    true on success; false if out of memory.
+ */
+bool free_extents_init(free_extents *fe, bitmap *bm);
+
+/** Free all memory used by the index. */
+void free_extents_destroy(free_extents *fe);
+
+/**
+ * Add the blocks [start, start + count), which must not be in the index yet,
+ * joining them with the free extents right before and after them.
+ * Return false if out of memory.
+ */
+bool free_extents_add(free_extents *fe, uint32_t start, uint32_t count);
+
+/**
+ * Remove the blocks [start, start + count), which must all be in one free
+ * extent, splitting it if they are in the middle of it.
+ * Return false if out of memory.
+ */
+bool free_extents_remove(free_extents *fe, uint32_t start, uint32_t count);
+
+/**
+ * Return the free extent that contains the given block, or NULL if the block
+ * is not free.
+ */
+free_extent *free_extents_lookup(free_extents *fe, uint32_t block);
+
+/** Return the largest free extent, or NULL if there are no free blocks. */
+free_extent *free_extents_largest(free_extents *fe);
+
+/**
+ * Return a free extent of at least count blocks chosen by the given policy
+ * (next-fit starts from goal), or NULL if there is none.
+ */
+free_extent *free_extents_find(free_extents *fe, uint32_t count, uint32_t goal, alloc_policy policy);
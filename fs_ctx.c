@@ -16,15 +16,77 @@
  * CSC369 Assignment 1 - File system runtime context implementation.
  */
 
+#include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "fs_ctx.h"
 #include "a1fs.h"
+#include "dir_index.h"
+#include "extent_tree.h"
+#include "vardir.h"
 
 
+/**
+ * Set up the allocation groups: the ones in the group table, or a single group
+ * of all the inodes and blocks, counted in the superblock.
+ */
+static bool init_groups(fs_ctx *fs, a1fs_superblock *superblock, unsigned char *inode_bitmap,
+                        unsigned char *data_bitmap) {
+    a1fs_group_desc *descs = NULL;
+    if (fs->features & A1FS_FEATURE_GROUPS) {
+        descs = (a1fs_group_desc *) ((char *) fs->image + A1FS_BLOCK_SIZE);
+        fs->num_groups = superblock->num_groups;
+        fs->blocks_per_group = superblock->blocks_per_group;
+        fs->inodes_per_group = superblock->inodes_per_group;
+    } else {
+        fs->num_groups = 1;
+        fs->blocks_per_group = fs->num_of_data_blocks;
+        fs->inodes_per_group = fs->num_inodes;
+    }
+    fs->groups = calloc(fs->num_groups, sizeof(alloc_group));
+    if (fs->groups == NULL) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < fs->num_groups; i++) {
+        uint32_t first_inode = i * fs->inodes_per_group;
+        uint32_t first_block = i * fs->blocks_per_group;
+        uint32_t num_inodes = first_inode >= fs->num_inodes ? 0
+                : fs->num_inodes - first_inode < fs->inodes_per_group ? fs->num_inodes - first_inode
+                : fs->inodes_per_group;
+        uint32_t num_blocks = fs->num_of_data_blocks - first_block < fs->blocks_per_group
+                ? fs->num_of_data_blocks - first_block : fs->blocks_per_group;
+        alloc_group *g = &fs->groups[i];
+        if (!group_init(g, inode_bitmap, first_inode, num_inodes,
+                        descs != NULL ? &descs[i].free_inodes : fs->available_inodes,
+                        data_bitmap, first_block, num_blocks,
+                        descs != NULL ? &descs[i].free_blocks : fs->available_blocks)) {
+            while (i > 0) {
+                group_destroy(&fs->groups[--i]);
+            }
+            free(fs->groups);
+            fs->groups = NULL;
+            return false;
+        }
+        if (descs != NULL) {
+            g->used_dirs = &descs[i].used_dirs;
+            g->total_free_inodes = fs->available_inodes;
+            g->total_free_blocks = fs->available_blocks;
+        }
+        if (fs->features & A1FS_FEATURE_STRIPE) {
+            g->stripe_unit = superblock->stripe_unit;
+            g->stripe_width = superblock->stripe_width;
+        }
+        g->low_first = (fs->features & A1FS_FEATURE_THIN) != 0;
+    }
+    return true;
+}
+
 bool fs_ctx_init(fs_ctx *fs, void *image, size_t size) {
     fs->image = image;
     fs->size = size;
@@ -35,27 +97,81 @@ bool fs_ctx_init(fs_ctx *fs, void *image, size_t size) {
         return false;
     }
 
-    // and initialize its runtime state
-    fs->inode_bitmap = (unsigned char *) (uint64_t) image + A1FS_BLOCK_SIZE;
-    fs->data_bitmap = (unsigned char *) (uint64_t) image + A1FS_BLOCK_SIZE
-                      + superblock->inode_bitmap_length * A1FS_BLOCK_SIZE;
-    fs->inode_table = (a1fs_inode *) (uint64_t) (image + A1FS_BLOCK_SIZE
+    // and initialize its runtime state; the group table, if any, comes first
+    uint64_t metadata_start = A1FS_BLOCK_SIZE;
+    if (superblock->features & A1FS_FEATURE_GROUPS) {
+        metadata_start += (uint64_t) superblock->group_table_length * A1FS_BLOCK_SIZE;
+    }
+    unsigned char *inode_bitmap = (unsigned char *) (uint64_t) image + metadata_start;
+    unsigned char *data_bitmap = (unsigned char *) (uint64_t) image + metadata_start
+                                 + superblock->inode_bitmap_length * A1FS_BLOCK_SIZE;
+    fs->inode_table = (a1fs_inode *) (uint64_t) (image + metadata_start
             + superblock->inode_bitmap_length * A1FS_BLOCK_SIZE
             + superblock->data_bitmap_length * A1FS_BLOCK_SIZE);
-    fs->data_block = (uint64_t) (image + A1FS_BLOCK_SIZE
+    fs->data_block = (uint64_t) (image + metadata_start
                            + superblock->inode_bitmap_length * A1FS_BLOCK_SIZE
                            + superblock->data_bitmap_length * A1FS_BLOCK_SIZE
                            + superblock->inode_table_length * A1FS_BLOCK_SIZE);
     fs->available_blocks = &(superblock->available_blocks);
     fs->num_inodes = superblock->num_inodes;
     fs->available_inodes = &(superblock->available_inodes);
-    fs->num_of_data_blocks = superblock->available_blocks;
-    return true;
+    // all the blocks after the inode table, whether they are free or not
+    fs->num_of_data_blocks = (uint32_t) (superblock->size / A1FS_BLOCK_SIZE
+                                         - (fs->data_block - (uint64_t) image) / A1FS_BLOCK_SIZE);
+    fs->features = superblock->features;
+    fs->extent_generation = 0;
+    fs->alloc_policy = ALLOC_NEXT_FIT;
+    fs->delayed_alloc = false;
+    fs->prealloc_min = PREALLOC_MIN_DEFAULT;
+    fs->prealloc_max = PREALLOC_MAX_DEFAULT;
+    fs->zeroed_bytes = 0;
+    fs->discard = false;
+    fs->discard_batch = DISCARD_BATCH_DEFAULT;
+    fs->discarded_blocks = 0;
+    fs->discard_calls = 0;
+    fs->image_fd = -1;
+    fs->thin_chunk = superblock->features & A1FS_FEATURE_THIN ? superblock->thin_chunk : 0;
+    fs->thin_grows = 0;
+    set_image_file(fs, -1, size);
+    return init_groups(fs, superblock, inode_bitmap, data_bitmap)
+            && dcache_init(&fs->dcache) && handle_table_init(&fs->handles)
+            && delalloc_init(&fs->delalloc) && prealloc_init(&fs->prealloc)
+            && discard_init(&fs->discards);
 }
 
 void fs_ctx_destroy(fs_ctx *fs) {
     // ADDED: cleanup any resources allocated in fs_ctx_init()
-    (void) fs;
+    fprintf(stderr, "dcache: %lu hits, %lu misses\n",
+            (unsigned long) fs->dcache.hits, (unsigned long) fs->dcache.misses);
+    fprintf(stderr, "zeroed: %lu bytes\n", (unsigned long) fs->zeroed_bytes);
+    if (fs->discarded_blocks > 0) {
+        fprintf(stderr, "discard: %lu blocks in %lu holes\n",
+                (unsigned long) fs->discarded_blocks, (unsigned long) fs->discard_calls);
+    }
+    if (fs->thin_grows > 0) {
+        fprintf(stderr, "thin: grew %u times, %u of %u data blocks backed\n",
+                fs->thin_grows, fs->backed_blocks, fs->num_of_data_blocks);
+    }
+    if (fs->image_fd >= 0) {
+        close(fs->image_fd);
+    }
+    for (uint32_t i = 0; i < fs->num_groups; i++) {
+        group_destroy(&fs->groups[i]);
+    }
+    free(fs->groups);
+    dcache_destroy(&fs->dcache);
+    handle_table_destroy(&fs->handles);
+    delalloc_destroy(&fs->delalloc);
+    prealloc_destroy(&fs->prealloc);
+    discard_destroy(&fs->discards);
+}
+
+void set_image_file(fs_ctx *fs, int fd, size_t file_size) {
+    fs->image_fd = fd;
+    // the data blocks that are (at least partly) in the file
+    uint64_t data_offset = fs->data_block - (uint64_t) fs->image;
+    uint64_t backed = file_size > data_offset ? (file_size - data_offset) / A1FS_BLOCK_SIZE : 0;
+    fs->backed_blocks = backed < fs->num_of_data_blocks ? (uint32_t) backed : fs->num_of_data_blocks;
 }
 
 /* ==========================
@@ -71,143 +187,568 @@ int roundup(double n) {
     }
 }
 
-int path_lookup(fs_ctx *fs, const char *path) {
-    if (path[0] != '/') {
-        fprintf(stderr, "Not an absolute path\n");
+int iterate_dentries(fs_ctx *fs, uint32_t dir_inode_num, uint32_t start, dentry_fn fn, void *arg) {
+    if (fs->features & A1FS_FEATURE_VARDIR) {
+        return vardir_iterate(fs, dir_inode_num, start, fn, arg);
+    }
+
+    a1fs_inode *dir = &fs->inode_table[dir_inode_num];
+    uint32_t num_slots = (uint32_t) (dir->size / sizeof(a1fs_dentry));
+    uint32_t dir_count = 0;
+    a1fs_extent extent;
+
+    for (uint32_t block = 0; extent_find(fs, dir, block, &extent); block = extent.logical + extent.count) {
+        uint32_t num_dentries_in_extent = extent.count * A1FS_DENTRIES_PER_BLOCK;
+
+        // skip the whole extent if it ends before the starting slot
+        if (dir_count + num_dentries_in_extent <= start) {
+            dir_count += num_dentries_in_extent;
+            continue;
+        }
+
+        a1fs_dentry *dir_entry_list = (a1fs_dentry *) get_addr_of_block(fs, extent.start);
+        for (uint32_t j = 0; j < num_dentries_in_extent; j++, dir_count++) {
+
+            // no more directory entries left
+            if (dir_count >= num_slots) {
+                return 0;
+            }
+            if (dir_count < start || dir_entry_list[j].name[0] == '\0') {
+                continue;
+            }
+
+            int ret = fn(arg, dir_entry_list[j].ino, dir_entry_list[j].name, dir_count, dir_count + 1);
+            if (ret != 0) {
+                return ret;
+            }
+        }
+    }
+    return 0;
+}
+
+/** Argument of match_dentry(). */
+typedef struct dentry_match {
+    const char *name;
+    int64_t slot;
+} dentry_match;
+
+/** iterate_dentries() callback that stops at the entry with the given name. */
+static int match_dentry(void *arg, a1fs_ino_t ino, const char *name, uint32_t slot, uint32_t next) {
+    (void) ino;
+    (void) next;
+    dentry_match *match = (dentry_match *) arg;
+    if (strcmp(match->name, name) == 0) {
+        match->slot = slot;
+        return 1;
+    }
+    return 0;
+}
+
+int64_t find_dentry_slot(fs_ctx *fs, uint32_t dir_inode_num, const char *name) {
+    if (fs->inode_table[dir_inode_num].flags & A1FS_INODE_DIR_INDEX) {
+        return dx_lookup(fs, dir_inode_num, name);
+    }
+
+    dentry_match match = {name, -1};
+    iterate_dentries(fs, dir_inode_num, 0, match_dentry, &match);
+    return match.slot;
+}
+
+int find_dentry(fs_ctx *fs, uint32_t dir_inode_num, const char *name) {
+    int64_t slot = find_dentry_slot(fs, dir_inode_num, name);
+    if (slot < 0) {
         return -1;
     }
+    a1fs_ino_t ino;
+    get_dentry(fs, dir_inode_num, (uint32_t) slot, &ino);
+    return (int) ino;
+}
 
-    a1fs_inode *itable = fs->inode_table;
+/** Return the fixed size dentry at the given slot of a directory. */
+static a1fs_dentry *get_dentry_slot(fs_ctx *fs, uint32_t dir_inode_num, uint32_t slot) {
+    return (a1fs_dentry *) get_addr_of_file_block(fs, dir_inode_num, slot / A1FS_DENTRIES_PER_BLOCK)
+           + slot % A1FS_DENTRIES_PER_BLOCK;
+}
 
-    char *token = strtok((char *) path, "/");
+/**
+ * Return the first unused fixed size dentry slot of a directory, starting from
+ * its dir_free_slot hint, or the number of slots if there is none.
+ */
+static uint32_t find_unused_slot(fs_ctx *fs, uint32_t dir_inode_num) {
+    a1fs_inode *dir = &fs->inode_table[dir_inode_num];
+    uint32_t num_slots = (uint32_t) (dir->size / sizeof(a1fs_dentry));
+    a1fs_dentry *block = NULL;
+    uint32_t slot;
+    for (slot = dir->dir_free_slot; slot < num_slots; slot++) {
+        if (block == NULL || slot % A1FS_DENTRIES_PER_BLOCK == 0) {
+            block = (a1fs_dentry *) get_addr_of_file_block(fs, dir_inode_num, slot / A1FS_DENTRIES_PER_BLOCK);
+        }
+        if (block[slot % A1FS_DENTRIES_PER_BLOCK].name[0] == '\0') {
+            break;
+        }
+    }
+    return slot;
+}
 
-    // if the path contains only the root directory, i.e. "/"
-    if (token == NULL) {
-        return ROOT_INODE;
+const char *get_dentry(fs_ctx *fs, uint32_t dir_inode_num, uint32_t slot, a1fs_ino_t *ino) {
+    if (fs->features & A1FS_FEATURE_VARDIR) {
+        a1fs_dirent *dirent = vardir_get(fs, dir_inode_num, slot);
+        if (ino != NULL) {
+            *ino = dirent->ino;
+        }
+        return dirent->name;
     }
 
-    // otherwise, get the entries of the root directory
-    int tmp_inode = -1;
-    uint32_t dir_count = 0;
+    a1fs_dentry *dentry = get_dentry_slot(fs, dir_inode_num, slot);
+    if (ino != NULL) {
+        *ino = dentry->ino;
+    }
+    return dentry->name;
+}
 
-    for (uint32_t i = 0; i < itable[ROOT_INODE].extent_num; i++) {
-        a1fs_dentry *dir_entry_list = (a1fs_dentry *) (fs->data_block + ((a1fs_extent *)itable[ROOT_INODE].
-                indirect_pt)[i].start * A1FS_BLOCK_SIZE);
-        uint32_t num_dentries_in_extent = ((a1fs_extent *)itable[ROOT_INODE].indirect_pt)[i].count
-                * A1FS_BLOCK_SIZE / sizeof(a1fs_dentry);
-        for (uint32_t j = 0; j < num_dentries_in_extent; j++) {
+int add_dentry(fs_ctx *fs, uint32_t dir_inode_num, const char *name, a1fs_ino_t ino) {
+    a1fs_inode *dir = &fs->inode_table[dir_inode_num];
+    uint32_t slot;
 
-            if (strcmp(token, dir_entry_list[j].name) == 0) {
-                tmp_inode = dir_entry_list[j].ino;
-                goto NEXT;
+    if (fs->features & A1FS_FEATURE_VARDIR) {
+        int64_t ret = vardir_add(fs, dir_inode_num, name, ino);
+        if (ret < 0) {
+            return (int) ret;
+        }
+        slot = (uint32_t) ret;
+    } else {
+        // reuse the first unused slot if there is one, otherwise add to the
+        // end of the last existing extent if there's any space left
+        uint32_t num_slots = (uint32_t) (dir->size / sizeof(a1fs_dentry));
+        slot = dir->num_dir_entry < num_slots ? find_unused_slot(fs, dir_inode_num) : num_slots;
+        if (slot == num_slots) {
+            if (slot % A1FS_DENTRIES_PER_BLOCK == 0) {
+                // the last block is full, or the directory has no blocks yet
+                int ret = grow_dir_by_a_block(fs, dir_inode_num);
+                if (ret != 0) {
+                    return ret;
+                }
             }
+            dir->size += sizeof(a1fs_dentry);
+        }
+        dir->dir_free_slot = slot + 1;
 
-            dir_count++;
+        a1fs_dentry *new_entry = get_dentry_slot(fs, dir_inode_num, slot);
+        new_entry->ino = ino;
+        strncpy(new_entry->name, name, A1FS_NAME_MAX - 1);
+        new_entry->name[A1FS_NAME_MAX - 1] = '\0';
+    }
+    dir->num_dir_entry++;
+
+    // keep the index up to date, or create it once the directory is large
+    // enough; an index that can't grow any more is dropped, since the linear
+    // entries are always complete on their own, and a large directory without
+    // one (dropped, or not built for lack of space) tries again on each insert
+    if (dir->flags & A1FS_INODE_DIR_INDEX) {
+        if (!dx_insert(fs, dir_inode_num, name, slot)) {
+            dx_destroy(fs, dir_inode_num);
+        }
+    } else if (dir->num_dir_entry >= A1FS_DX_THRESHOLD) {
+        dx_build(fs, dir_inode_num);
+    }
+    return 0;
+}
 
-            // no more directory entries left
-            if (dir_count >= itable[ROOT_INODE].num_dir_entry) {
-                return -1;
+void remove_dentry(fs_ctx *fs, uint32_t dir_inode_num, const char *name) {
+    a1fs_inode *dir = &fs->inode_table[dir_inode_num];
+    int64_t slot = find_dentry_slot(fs, dir_inode_num, name);
+    if (slot < 0) {
+        return;
+    }
+
+    if (dir->flags & A1FS_INODE_DIR_INDEX) {
+        dx_remove(fs, dir_inode_num, name, (uint32_t) slot);
+    }
+
+    if (fs->features & A1FS_FEATURE_VARDIR) {
+        // records don't move, the freed space is merged into the previous one
+        vardir_remove(fs, dir_inode_num, (uint32_t) slot);
+    } else {
+        // the other entries stay where they are, so only mark the slot unused
+        get_dentry_slot(fs, dir_inode_num, (uint32_t) slot)->name[0] = '\0';
+        if ((uint32_t) slot < dir->dir_free_slot) {
+            dir->dir_free_slot = (uint32_t) slot;
+        }
+
+        // drop the unused slots at the end, and the blocks they leave empty
+        while (dir->size > 0) {
+            uint32_t last_slot = (uint32_t) (dir->size / sizeof(a1fs_dentry)) - 1;
+            if (get_dentry_slot(fs, dir_inode_num, last_slot)->name[0] != '\0') {
+                break;
+            }
+            dir->size -= sizeof(a1fs_dentry);
+            if (last_slot % A1FS_DENTRIES_PER_BLOCK == 0) {
+                shrink_dir_by_a_block(fs, dir_inode_num);
             }
         }
     }
+    dir->num_dir_entry--;
 
-    NEXT:
-    token = strtok(NULL, "/");
+    if (dir->num_dir_entry == 0) {
+        dx_destroy(fs, dir_inode_num);
+    }
+}
 
-    while (token != NULL) {
-        // parent directory is empty
-        if (itable[tmp_inode].size == 0) {
-            return -1;
+int grow_dir_by_a_block(fs_ctx *fs, uint32_t dir_inode_num) {
+    a1fs_inode *dir = &fs->inode_table[dir_inode_num];
+
+    uint32_t goal = dir->extent_num > 0 ? find_last_block(fs, (int) dir_inode_num) + 1 : get_inode_goal(fs, dir_inode_num, ALLOC_META);
+    uint32_t new_block_num;
+    if (!allocate_data_extent(fs, 1, goal, 0, ALLOC_META, &new_block_num)) {
+        return -ENOSPC;
+    }
+    if (dir->extent_num > 0 && new_block_num == goal) {
+        // the next block was free, so extend the last extent
+        extent_last(fs, dir)->count++;
+        return 0;
+    }
+
+    // the next block is not free, have to create a new extent
+    int ret = add_extent(fs, dir, new_block_num, 1, 0);
+    if (ret != 0) {
+        free_data_block(fs, new_block_num);
+    }
+    return ret;
+}
+
+void shrink_dir_by_a_block(fs_ctx *fs, uint32_t dir_inode_num) {
+    a1fs_inode *dir = &fs->inode_table[dir_inode_num];
+    shrink_file_blocks(fs, dir_inode_num, get_num_blks_of_file(fs, dir) - 1);
+}
+
+int add_extent(fs_ctx *fs, a1fs_inode *inode, uint32_t start, uint32_t count, uint32_t flags) {
+    a1fs_extent extent = {get_num_blks_of_file(fs, inode), start, count, flags};
+    return extent_insert(fs, inode, &extent);
+}
+
+void shrink_file_blocks(fs_ctx *fs, uint32_t inode_num, uint32_t num_blocks) {
+    extent_truncate(fs, &fs->inode_table[inode_num], num_blocks);
+    // the extents cached by open files may no longer be there
+    fs->extent_generation++;
+}
+
+uint64_t get_addr_of_file_block(fs_ctx *fs, uint32_t inode_num, uint32_t block_index) {
+    extent_cursor cursor = {{0, 0, 0, 0}, 0};
+    return get_addr_of_file_block_at(fs, inode_num, block_index, &cursor);
+}
+
+uint64_t get_addr_of_file_block_at(fs_ctx *fs, uint32_t inode_num, uint32_t block_index,
+                                   extent_cursor *cursor) {
+    a1fs_extent *extent = &cursor->extent;
+    if (cursor->generation != fs->extent_generation
+        || block_index < extent->logical || block_index - extent->logical >= extent->count) {
+        if (!extent_find(fs, &fs->inode_table[inode_num], block_index, extent)
+            || block_index < extent->logical) {
+            extent->count = 0;
+            return 0;
         }
+        cursor->generation = fs->extent_generation;
+    }
+    return get_addr_of_block(fs, extent->start + block_index - extent->logical);
+}
 
+int path_lookup(fs_ctx *fs, const char *path) {
+    if (path[0] != '/') {
+        fprintf(stderr, "Not an absolute path\n");
+        return -1;
+    }
+
+    a1fs_inode *itable = fs->inode_table;
+    int tmp_inode = ROOT_INODE;
+
+    // if the path contains only the root directory, i.e. "/", the loop is skipped
+    char *token = strtok((char *) path, "/");
+
+    while (token != NULL) {
         // file in the middle of the path
-        if (S_ISREG(itable[tmp_inode].mode)) {
+        if (!S_ISDIR(itable[tmp_inode].mode)) {
             return -2;
         }
 
-        dir_count = 0;
+        // only scan the directory if the cache doesn't know the answer,
+        // and remember the answer (even a negative one) for next time
+        int child_inode;
+        if (!dcache_lookup(&fs->dcache, (a1fs_ino_t) tmp_inode, token, &child_inode)) {
+            child_inode = find_dentry(fs, (uint32_t) tmp_inode, token);
+            dcache_insert(&fs->dcache, (a1fs_ino_t) tmp_inode, token,
+                          child_inode < 0 ? DCACHE_NEGATIVE : child_inode);
+        }
+        if (child_inode < 0) {
+            return -1;
+        }
 
-        for (uint32_t i = 0; i < itable[tmp_inode].extent_num; i++) {
-            a1fs_dentry *dir_entry_list = (a1fs_dentry *) (fs->data_block + ((a1fs_extent *)itable[tmp_inode].
-                    indirect_pt)[i].start * A1FS_BLOCK_SIZE);
-            uint32_t num_dentries_in_extent = ((a1fs_extent *)itable[tmp_inode].indirect_pt)[i].count
-                    * A1FS_BLOCK_SIZE / sizeof(a1fs_dentry);
-            for (uint32_t j = 0; j < num_dentries_in_extent; j++) {
+        tmp_inode = child_inode;
+        token = strtok(NULL, "/");
+    }
 
-                if (strcmp(token, dir_entry_list[j].name) == 0) {
-                    tmp_inode = dir_entry_list[j].ino;
-                    goto UPDATE;
-                }
+    return tmp_inode;
+}
 
-                dir_count++;
+uint32_t get_num_blks_of_file(fs_ctx *fs, a1fs_inode *ino) {
+    // the last extent ends the file
+    a1fs_extent *last = extent_last(fs, ino);
+    return last == NULL ? 0 : last->logical + last->count;
+}
 
-                // no more directory entries left
-                if (dir_count >= itable[tmp_inode].num_dir_entry) {
-                    return -1;
-                }
-            }
+uint32_t get_exact_num_blks_of_file(fs_ctx *fs, a1fs_inode *ino) {
+    // inline data and the root of the extent tree live in the inode itself,
+    // and holes take no blocks
+    return extent_mapped(fs, ino) + ino->extent_blocks;
+}
+
+/** Return the index of the group to look for blocks near goal in first. */
+static uint32_t goal_group(fs_ctx *fs, uint32_t goal) {
+    return goal < fs->num_of_data_blocks ? goal / fs->blocks_per_group : 0;
+}
+
+uint32_t get_unreserved_blocks(fs_ctx *fs) {
+    return *fs->available_blocks - fs->delalloc.blocks;
+}
+
+/**
+ * Return the goal to allocate near: in a thin image, none (so that the lowest
+ * free blocks are taken) for a goal past the end of the image file.
+ */
+static uint32_t backed_goal(fs_ctx *fs, uint32_t goal) {
+    return fs->thin_chunk != 0 && goal >= fs->backed_blocks ? UINT32_MAX : goal;
+}
+
+/**
+ * Make sure that the image file has the blocks [start, start + count) just
+ * allocated, growing a thin image by whole chunks up to its full size if they
+ * are past its end. If it can't grow, the blocks are freed again.
+ * Return false in that case.
+ */
+static bool back_blocks(fs_ctx *fs, uint32_t start, uint32_t count) {
+    uint32_t end = start + count;
+    if (end <= fs->backed_blocks) {
+        return true;
+    }
+    uint64_t backed = ((uint64_t) end + fs->thin_chunk - 1) / fs->thin_chunk * fs->thin_chunk;
+    if (backed > fs->num_of_data_blocks) {
+        backed = fs->num_of_data_blocks;
+    }
+    off_t file_size = (off_t) (fs->data_block - (uint64_t) fs->image + backed * A1FS_BLOCK_SIZE);
+    if (fs->image_fd < 0 || ftruncate(fs->image_fd, file_size) != 0) {
+        if (fs->image_fd >= 0) {
+            perror("a1fs: can't grow the image");
         }
-        UPDATE:
-        token = strtok(NULL, "/");
+        free_data_blocks(fs, start, count);
+        return false;
     }
+    fs->backed_blocks = (uint32_t) backed;
+    fs->thin_grows++;
+    return true;
+}
 
-//    END:
-    return tmp_inode;
+static bool find_data_extent(fs_ctx *fs, uint32_t count, uint32_t goal, uint32_t room, alloc_class cls,
+                             uint32_t *start) {
+    if(count > get_unreserved_blocks(fs)){
+        return false;
+    }
+    // the group of the goal, then the others (from the start of the area of
+    // the class)
+    goal = backed_goal(fs, goal);
+    uint32_t first = goal_group(fs, goal);
+    for(uint32_t i = 0; i < fs->num_groups; i++){
+        alloc_group *g = &fs->groups[(first + i) % fs->num_groups];
+        if(group_alloc_extent(g, count, i == 0 ? goal : UINT32_MAX, room, fs->alloc_policy, cls, start)){
+            return back_blocks(fs, *start, count);
+        }
+    }
+    return false;
 }
 
-uint32_t get_num_blks_of_file(a1fs_inode ino) {
+bool allocate_data_extent(fs_ctx *fs, uint32_t count, uint32_t goal, uint32_t room, alloc_class cls,
+                          uint32_t *start) {
+    if(find_data_extent(fs, count, goal, room, cls, start)){
+        return true;
+    }
+    if(fs->prealloc.num_windows == 0){
+        return false;
+    }
+    release_all_prealloc(fs);
+    return find_data_extent(fs, count, goal, room, cls, start);
+}
 
-    uint32_t result = 0;
+uint32_t allocate_data_blocks(fs_ctx *fs, uint32_t count, uint32_t goal, uint32_t room, alloc_class cls,
+                              uint32_t *start) {
+    if(count > get_unreserved_blocks(fs)){
+        release_all_prealloc(fs);
+    }
+    if(count > get_unreserved_blocks(fs)){
+        count = get_unreserved_blocks(fs);
+    }
+    if(count == 0){
+        return 0;
+    }
+    uint32_t n;
+    goal = backed_goal(fs, goal);
+    if(goal < fs->num_of_data_blocks && (n = group_alloc_at(&fs->groups[goal_group(fs, goal)], count, goal)) > 0){
+        // as many as there are from the goal on
+        *start = goal;
+        return back_blocks(fs, goal, n) ? n : 0;
+    }
+    if(allocate_data_extent(fs, count, goal, room, cls, start)){
+        return count;
+    }
 
-    for (uint32_t i = 0; i < ino.extent_num; i++) {
-        result += ((a1fs_extent *)ino.indirect_pt)[i].count;
+    // no free extent is large enough, so take the largest one whole
+    alloc_group *largest = NULL;
+    uint32_t most = 0;
+    for(uint32_t i = 0; i < fs->num_groups; i++){
+        uint32_t free_count = group_largest_free(&fs->groups[i]);
+        if(free_count > most){
+            most = free_count;
+            largest = &fs->groups[i];
+        }
     }
-    return result;
+    if(largest == NULL || (n = group_alloc_largest(largest, count, start)) == 0){
+        return 0;
+    }
+    return back_blocks(fs, *start, n) ? n : 0;
 }
 
-uint32_t get_exact_num_blks_of_file(a1fs_inode ino) {
+bool allocate_data_block(fs_ctx *fs, uint32_t inode_num, uint32_t *block_num) {
+    uint32_t goal = inode_num < fs->num_inodes ? get_inode_goal(fs, inode_num, ALLOC_META) : UINT32_MAX;
+    return allocate_data_extent(fs, 1, goal, 0, ALLOC_META, block_num);
+}
 
-    uint32_t result = 0;
-    if (ino.size == 0) {
-        return result;
-    } else {
-        result = 1;
-        for (uint32_t i = 0; i < ino.extent_num; i++) {
-            result += ((a1fs_extent *)ino.indirect_pt)[i].count;
+void free_data_block(fs_ctx *fs, uint32_t block_num) {
+    free_data_blocks(fs, block_num, 1);
+}
+
+void free_data_blocks(fs_ctx *fs, uint32_t start, uint32_t count) {
+    // if there is no memory to remember the blocks, they just stay on the host
+    bool discard = fs->discard && discard_add(&fs->discards, start, count);
+    // an extent that grew in place past the end of a group goes on in the next
+    while(count > 0){
+        alloc_group *g = &fs->groups[start / fs->blocks_per_group];
+        uint32_t n = g->first_block + group_num_blocks(g) - start;
+        if(n > count){
+            n = count;
         }
+        group_free_blocks(g, start, n);
+        start += n;
+        count -= n;
+    }
+    if(discard && fs->discards.blocks >= fs->discard_batch){
+        flush_discards(fs);
     }
-    return result;
 }
 
-int is_bit_set(uint32_t index, unsigned char *bitmap) {
-    uint32_t byte_index = index / 8;
-    uint32_t bit_index = index % 8;
-    if ((bitmap[byte_index] & (1 << bit_index)) == 0) {
-        return 0; // unset
-    } else {
-        return 1; // set
+void flush_discards(fs_ctx *fs) {
+    // the blocks may have been allocated again since, so only the runs of
+    // them that are still free are punched
+    discard_sort(&fs->discards);
+    for(uint32_t i = 0; i < fs->discards.num_ranges && fs->discard; i++){
+        uint32_t block = fs->discards.ranges[i].start;
+        uint32_t end = block + fs->discards.ranges[i].count;
+        while(block < end){
+            alloc_group *g = &fs->groups[block / fs->blocks_per_group];
+            uint32_t count;
+            uint32_t start = group_next_free(g, block, &count);
+            if(start == UINT32_MAX){
+                block = g->first_block + group_num_blocks(g);
+                continue;
+            }
+            if(start >= end || start >= fs->backed_blocks){
+                break;
+            }
+            // a thin image file has no blocks past its end to punch
+            end = end < fs->backed_blocks ? end : fs->backed_blocks;
+            count = start + count < end ? count : end - start;
+            if(madvise((void *) get_addr_of_block(fs, start), (size_t) count * A1FS_BLOCK_SIZE, MADV_REMOVE) != 0){
+                perror("a1fs: discard");
+                fs->discard = false;
+                break;
+            }
+            fs->discarded_blocks += count;
+            fs->discard_calls++;
+            block = start + count;
+        }
     }
+    discard_clear(&fs->discards);
+}
+
+uint32_t get_inode_goal(fs_ctx *fs, uint32_t inode_num, alloc_class cls) {
+    // the same way into the area as the inode is into the inodes of the group
+    alloc_group *g = &fs->groups[inode_num / fs->inodes_per_group];
+    return group_area_goal(g, cls, inode_num - g->first_inode, fs->inodes_per_group);
 }
 
-uint32_t get_first_available_position(uint32_t n, unsigned char *bitmap) {
-    for (uint32_t i = 0; i < n; i++) {
-        if (is_bit_set(i, bitmap) == 0) {
-            return i;
+/**
+ * Return the index of the group for a new directory (Orlov's allocator). A
+ * directory in the root is placed in the group with the fewest directories of
+ * those with at least the average number of free inodes and blocks, so that
+ * the top-level trees spread over the image. Any other directory stays with
+ * its parent unless the group of the parent has far more directories or far
+ * fewer free inodes or blocks than the average, in which case it goes to the
+ * first group after it that doesn't.
+ */
+static uint32_t find_dir_group(fs_ctx *fs, uint32_t parent) {
+    uint32_t parent_group = parent / fs->inodes_per_group;
+    uint64_t total_dirs = 0;
+    for (uint32_t i = 0; i < fs->num_groups; i++) {
+        total_dirs += *fs->groups[i].used_dirs;
+    }
+    uint32_t avg_free_inodes = *fs->available_inodes / fs->num_groups;
+    uint32_t avg_free_blocks = get_unreserved_blocks(fs) / fs->num_groups;
+    uint32_t avg_dirs = (uint32_t) (total_dirs / fs->num_groups);
+
+    if (parent == ROOT_INODE) {
+        uint32_t best = parent_group;
+        uint32_t best_dirs = UINT32_MAX;
+        for (uint32_t i = 0; i < fs->num_groups; i++) {
+            alloc_group *g = &fs->groups[i];
+            if (*g->inode_bitmap.available > 0 && *g->inode_bitmap.available >= avg_free_inodes
+                && *g->data_bitmap.available >= avg_free_blocks && *g->used_dirs < best_dirs) {
+                best = i;
+                best_dirs = *g->used_dirs;
+            }
         }
+        return best;
     }
-    return (uint32_t) 2e32-1;
+
+    uint32_t max_dirs = avg_dirs + fs->inodes_per_group / 16;
+    uint32_t min_inodes = avg_free_inodes > fs->inodes_per_group / 4 ? avg_free_inodes - fs->inodes_per_group / 4 : 1;
+    uint32_t min_blocks = avg_free_blocks > fs->blocks_per_group / 4 ? avg_free_blocks - fs->blocks_per_group / 4 : 0;
+    for (uint32_t i = 0; i < fs->num_groups; i++) {
+        alloc_group *g = &fs->groups[(parent_group + i) % fs->num_groups];
+        if (*g->used_dirs <= max_dirs && *g->inode_bitmap.available >= min_inodes
+            && *g->data_bitmap.available >= min_blocks) {
+            return (parent_group + i) % fs->num_groups;
+        }
+    }
+    return parent_group;
 }
 
-void set_bitmap(unsigned char *bitmap, uint32_t index) {
-    uint32_t byte_index = index / 8;
-    uint32_t bit_index = index % 8;
-    bitmap[byte_index] |= (1 << bit_index);
+bool allocate_inode(fs_ctx *fs, uint32_t parent, bool dir, uint32_t *inode_num) {
+    // next to the parent, in its group or the one Orlov's allocator picks
+    uint32_t first = parent / fs->inodes_per_group;
+    uint32_t goal = parent;
+    if (dir && fs->num_groups > 1) {
+        first = find_dir_group(fs, parent);
+        goal = first == parent / fs->inodes_per_group ? parent : fs->groups[first].first_inode;
+    }
+    for (uint32_t i = 0; i < fs->num_groups; i++) {
+        alloc_group *g = &fs->groups[(first + i) % fs->num_groups];
+        uint32_t ino = group_alloc_inode(g, i == 0 ? goal : g->first_inode, dir);
+        if (ino != UINT32_MAX) {
+            *inode_num = ino;
+            return true;
+        }
+    }
+    return false;
 }
 
-void unset_bitmap(unsigned char *bitmap, uint32_t index) {
-    uint32_t byte_index = index / 8;
-    uint32_t bit_index = index % 8;
-    bitmap[byte_index] &= ~(1 << bit_index);
+void free_inode(fs_ctx *fs, uint32_t inode_num, bool dir) {
+    group_free_inode(&fs->groups[inode_num / fs->inodes_per_group], inode_num, dir);
 }
 
 
@@ -229,9 +770,9 @@ void extract_child_path(char *path, char *buf) {
 }
 
 uint32_t find_last_block(fs_ctx *fs, int inode_num){
-    a1fs_inode inode = fs->inode_table[inode_num];
-    return (uint32_t) ((a1fs_extent *)inode.indirect_pt)[inode.extent_num - 1].start
-        + (uint32_t) ((a1fs_extent *)inode.indirect_pt)[inode.extent_num - 1].count - 1;
+    a1fs_inode *inode = &fs->inode_table[inode_num];
+    a1fs_extent *last_extent = extent_last(fs, inode);
+    return last_extent->start + last_extent->count - 1;
 }
 
 uint64_t get_addr_of_block(fs_ctx *fs, uint32_t block_num){
@@ -242,119 +783,402 @@ uint32_t get_num_of_block(fs_ctx *fs, uint64_t block_addr){
     return (uint32_t)((block_addr - fs->data_block) / A1FS_BLOCK_SIZE);
 }
 
-uint64_t get_addr_of_starting_write_point(fs_ctx *fs, uint32_t file_inode_num, uint64_t offset){
-
-    
-    uint64_t count = 0;
-    for(uint32_t i = 0; i < fs->inode_table[file_inode_num].extent_num; i++){ //traverse each extent
-        a1fs_extent temp_extent = ((a1fs_extent *)fs->inode_table[file_inode_num].indirect_pt)[i];
-        for(uint32_t j = 0; j < temp_extent.count; j++){ // traverse each block
-            uint64_t temp_block_addr = get_addr_of_block(fs, temp_extent.start + j);
-            if (offset - count < A1FS_BLOCK_SIZE){
-                return temp_block_addr + offset - count;
-            }else{
-                count += A1FS_BLOCK_SIZE;
-            }
-        }
+uint64_t get_addr_of_starting_write_point(fs_ctx *fs, uint32_t file_inode_num, uint64_t offset,
+                                          extent_cursor *cursor){
+    uint64_t block_addr = get_addr_of_file_block_at(fs, file_inode_num, (uint32_t) (offset / A1FS_BLOCK_SIZE), cursor);
+    if(block_addr == 0){
+        return (uint64_t)NULL;
     }
-
-    return (uint64_t)NULL;
-
-
+    return block_addr + offset % A1FS_BLOCK_SIZE;
 }
 
-int growing_a_block_for_file(fs_ctx *fs, uint32_t file_inode_num){
+int grow_file_blocks(fs_ctx *fs, uint32_t file_inode_num, uint32_t count, const char *data, uint32_t flags){
+    a1fs_inode *inode = &fs->inode_table[file_inode_num];
+    uint32_t original_block_count = get_num_blks_of_file(fs, inode);
+    prealloc_window *w = prealloc_find(&fs->prealloc, file_inode_num);
+    if(count > get_unreserved_blocks(fs) + (w != NULL ? w->count : 0)){
+        release_all_prealloc(fs);
+        if(count > get_unreserved_blocks(fs)){
+            return -ENOSPC;
+        }
+    }
 
-    if(*fs->available_blocks == 0){
-        return -1;
+    // zero the rest of the last block, past the end of the file (which may
+    // already be further on, in buffered blocks)
+    if(inode->size < (uint64_t) original_block_count * A1FS_BLOCK_SIZE){
+        zero_block_tail(fs, file_inode_num, inode->size);
     }
 
+    uint32_t block_count = original_block_count;
+    while(count > 0){
+        // continue the last extent if the blocks after it are free; an empty
+        // file has no goal (the one past the end never is)
+        alloc_class cls = file_alloc_class(block_count + count);
+        uint32_t goal = inode->extent_num > 0 ? find_last_block(fs, (int) file_inode_num) + 1 : get_inode_goal(fs, file_inode_num, cls);
+        uint32_t room = block_count < ALLOC_ROOM_MAX ? block_count : ALLOC_ROOM_MAX;
+        uint32_t start;
+        uint32_t got;
+        if((w = prealloc_find(&fs->prealloc, file_inode_num)) != NULL && w->count > 0){
+            start = w->start;
+            got = count < w->count ? count : w->count;
+            w->start += got;
+            w->count -= got;
+            fs->prealloc.blocks -= got;
+        }else if((got = allocate_data_blocks(fs, count, goal, room, cls, &start)) == 0){
+            break;
+        }
+        if(data != NULL){
+            memcpy((char *) get_addr_of_block(fs, start), data, (size_t) got * A1FS_BLOCK_SIZE);
+            data += (size_t) got * A1FS_BLOCK_SIZE;
+        }
 
-    if(fs->inode_table[file_inode_num].size == 0){ // when original file is empty
+        if(inode->extent_num > 0 && start == goal && extent_last(fs, inode)->flags == flags){
+            extent_last(fs, inode)->count += got;
+        }else if(add_extent(fs, inode, start, got, flags) != 0){
+            // the extent tree needed a node and there was no block for it
+            free_data_blocks(fs, start, got);
+            break;
+        }
+        block_count += got;
+        count -= got;
+    }
 
-        // there should be at least 2 available blocks
-        if (*(fs->available_blocks) == 1) {
-        	    return -1;
-    	}
+    if(count > 0){
+        // give back what was added, so that the file is as it was
+        shrink_file_blocks(fs, file_inode_num, original_block_count);
+        return -ENOSPC;
+    }
+    return 0;
+}
 
-        //allocate indirect pointer for the file
-		uint32_t new_single_indirect_block_num = get_first_available_position(fs->num_of_data_blocks, fs->data_bitmap);
-		set_bitmap(fs->data_bitmap, new_single_indirect_block_num);
-		*(fs->available_blocks) -= 1;
+void zero_block_tail(fs_ctx *fs, uint32_t file_inode_num, uint64_t offset){
+    if(offset % A1FS_BLOCK_SIZE == 0){
+        return;
+    }
+    extent_cursor cursor = {{0, 0, 0, 0}, 0};
+    char *block_addr = (char *) get_addr_of_file_block_at(fs, file_inode_num, (uint32_t) (offset / A1FS_BLOCK_SIZE), &cursor);
+    // holes and unwritten blocks read as zeros already
+    if(block_addr != NULL && !(cursor.extent.flags & A1FS_EXTENT_UNWRITTEN)){
+        memset(block_addr + offset % A1FS_BLOCK_SIZE, '\0', A1FS_BLOCK_SIZE - offset % A1FS_BLOCK_SIZE);
+        fs->zeroed_bytes += A1FS_BLOCK_SIZE - offset % A1FS_BLOCK_SIZE;
+    }
+}
 
-        // make the first extent
-		fs->inode_table[file_inode_num].indirect_pt = get_addr_of_block(fs, new_single_indirect_block_num);
+int map_file_blocks(fs_ctx *fs, uint32_t file_inode_num, uint32_t logical, uint32_t count, uint32_t flags){
+    a1fs_inode *inode = &fs->inode_table[file_inode_num];
+    while(count > 0){
+        // continue the extent of the block before if the blocks after it are
+        // free; past a hole, keep as far from the extent before the hole as
+        // the blocks are from it in the file, so that filling the hole later
+        // can join them, if the image is large enough for that
+        a1fs_extent *prev = logical > 0 ? extent_before(fs, inode, logical - 1) : NULL;
+        alloc_class cls = file_alloc_class(logical + count);
+        uint32_t goal = get_inode_goal(fs, file_inode_num, cls);
+        if(prev != NULL){
+            uint64_t near = (uint64_t) prev->start + (logical - prev->logical);
+            goal = near < fs->num_of_data_blocks ? (uint32_t) near : prev->start + prev->count;
+        }
+        uint32_t start;
+        uint32_t got = allocate_data_blocks(fs, count, goal, 0, cls, &start);
+        if(got == 0){
+            return -ENOSPC;
+        }
 
-        // allocate data block 
-        ((a1fs_extent *) fs->inode_table[file_inode_num].indirect_pt)[0].start = (uint32_t)get_first_available_position(fs->num_of_data_blocks, fs->data_bitmap);
-        set_bitmap(fs->data_bitmap, new_single_indirect_block_num);
-		*(fs->available_blocks) -= 1;
+        if(prev != NULL && prev->logical + prev->count == logical && start == goal && prev->flags == flags){
+            prev->count += got;
+        }else{
+            a1fs_extent extent = {logical, start, got, flags};
+            if(extent_insert(fs, inode, &extent) != 0){
+                free_data_blocks(fs, start, got);
+                return -ENOSPC;
+            }
+        }
+        logical += got;
+        count -= got;
+    }
+    return 0;
+}
 
-        ((a1fs_extent *)fs->inode_table[file_inode_num].indirect_pt)[0].count = 1;
+uint64_t get_block_for_write(fs_ctx *fs, uint32_t file_inode_num, uint32_t block_index,
+                             uint32_t from, uint32_t to, extent_cursor *cursor){
+    uint64_t block_addr = get_addr_of_file_block_at(fs, file_inode_num, block_index, cursor);
+    if(block_addr == 0){
+        if(map_file_blocks(fs, file_inode_num, block_index, 1, 0) != 0){
+            return 0;
+        }
+        block_addr = get_addr_of_file_block_at(fs, file_inode_num, block_index, cursor);
+        zero_block_around(fs, (char *) block_addr, from, to);
+        return block_addr;
+    }
+    if(!(cursor->extent.flags & A1FS_EXTENT_UNWRITTEN)){
+        return block_addr;
+    }
 
-        // set inode
-        fs->inode_table[file_inode_num].size = A1FS_BLOCK_SIZE;
-        fs->inode_table[file_inode_num].extent_num = 1;
+    a1fs_inode *inode = &fs->inode_table[file_inode_num];
+    if(extent_mark_written(fs, inode, block_index) == 0){
+        zero_block_around(fs, (char *) block_addr, from, to);
+    }else{
+        // the tree can't grow to split the extent, so write all of it instead
+        a1fs_extent *extent = extent_lookup(fs, inode, block_index);
+        memset((char *) get_addr_of_block(fs, extent->start), '\0', (size_t) extent->count * A1FS_BLOCK_SIZE);
+        fs->zeroed_bytes += (uint64_t) extent->count * A1FS_BLOCK_SIZE;
+        extent->flags &= ~A1FS_EXTENT_UNWRITTEN;
+    }
+    // the cursors may hold the extent as it was
+    fs->extent_generation++;
+    return get_addr_of_file_block_at(fs, file_inode_num, block_index, cursor);
+}
 
-        
-        memset((char *) get_addr_of_block(fs, ((a1fs_extent *)fs->inode_table[file_inode_num].indirect_pt)[0].start), '\0', A1FS_BLOCK_SIZE);
+void zero_block_around(fs_ctx *fs, char *block, uint32_t from, uint32_t to){
+    memset(block, '\0', from);
+    memset(block + to, '\0', A1FS_BLOCK_SIZE - to);
+    fs->zeroed_bytes += A1FS_BLOCK_SIZE - (to - from);
+}
 
-        return 0;
-        
+int allocate_file_range(fs_ctx *fs, uint32_t file_inode_num, uint32_t first, uint32_t count){
+    a1fs_inode *inode = &fs->inode_table[file_inode_num];
+    uint32_t end = first + count;
+    a1fs_extent extent;
+
+    // count the blocks that are not mapped, to fail before taking any
+    uint32_t holes = 0;
+    for(uint32_t block = first; block < end; block = extent.logical + extent.count){
+        if(!extent_find(fs, inode, block, &extent) || extent.logical >= end){
+            holes += end - block;
+            break;
+        }
+        holes += extent.logical > block ? extent.logical - block : 0;
+    }
+    if(holes > get_unreserved_blocks(fs)){
+        release_all_prealloc(fs);
+        if(holes > get_unreserved_blocks(fs)){
+            return -ENOSPC;
+        }
+    }
 
+    for(uint32_t block = first; block < end;){
+        uint32_t hole_end = end;
+        if(extent_find(fs, inode, block, &extent) && extent.logical < end){
+            if(extent.logical <= block){
+                block = extent.logical + extent.count;
+                continue;
+            }
+            hole_end = extent.logical;
+        }
+        int ret = map_file_blocks(fs, file_inode_num, block, hole_end - block, A1FS_EXTENT_UNWRITTEN);
+        if(ret != 0){
+            return ret;
+        }
+        block = hole_end;
     }
+    return 0;
+}
 
-    char* original_last_block_addr = (char*)get_addr_of_block(fs, find_last_block(fs, file_inode_num));
-    uint_fast32_t original_block_count_of_file = get_num_blks_of_file(fs->inode_table[file_inode_num]);
+int punch_file_range(fs_ctx *fs, uint32_t file_inode_num, uint32_t first, uint32_t count){
+    int ret = extent_punch(fs, &fs->inode_table[file_inode_num], first, count);
+    // the extents cached by open files may no longer be there
+    fs->extent_generation++;
+    return ret;
+}
 
-    if(fs->inode_table[file_inode_num].size % A1FS_BLOCK_SIZE != 0){ // there is a hole after the file inside the block
-        memset((original_last_block_addr + fs->inode_table[file_inode_num].size % A1FS_BLOCK_SIZE), '\0', A1FS_BLOCK_SIZE * original_block_count_of_file - fs->inode_table[file_inode_num].size);
+int spill_inline_data(fs_ctx *fs, uint32_t file_inode_num){
+    a1fs_inode *inode = &fs->inode_table[file_inode_num];
+    char data[A1FS_INLINE_DATA_SIZE];
+    uint64_t size = inode->size;
+    memcpy(data, inode->inline_data, A1FS_INLINE_DATA_SIZE);
+
+    // the first block of the (now empty) file, with the data and then zeros
+    inode->flags &= ~A1FS_INODE_INLINE_DATA;
+    inode->size = 0;
+    if(grow_file_blocks(fs, file_inode_num, 1, NULL, 0) != 0){
+        inode->flags |= A1FS_INODE_INLINE_DATA;
+        inode->size = size;
+        return -ENOSPC;
     }
 
-    
-
-    if(is_bit_set(find_last_block(fs, file_inode_num) + 1, fs->data_bitmap) == 0){
-        // the next block of the last block of the file is free, so no need to add extent
-        set_bitmap(fs->data_bitmap, find_last_block(fs, file_inode_num) + 1);
-        *(fs->available_blocks) -= 1;
+    char *block = (char *) get_addr_of_block(fs, find_last_block(fs, (int) file_inode_num));
+    memcpy(block, data, size);
+    zero_block_around(fs, block, 0, (uint32_t) size);
+    inode->size = size;
+    return 0;
+}
 
-        //
+int delalloc_write(fs_ctx *fs, uint32_t file_inode_num, const char *buf, size_t size, off_t offset){
+    a1fs_inode *inode = &fs->inode_table[file_inode_num];
+    delalloc_file *f = delalloc_find(&fs->delalloc, file_inode_num);
+    uint32_t first = f != NULL ? f->first : get_num_blks_of_file(fs, inode);
+    uint64_t end = (uint64_t) offset + size;
+    if((uint64_t) offset < (uint64_t) first * A1FS_BLOCK_SIZE){
+        // within the blocks the file has
+        return 0;
+    }
+    if(f == NULL && inode->extent_num == 0 && end <= A1FS_INLINE_DATA_SIZE){
+        // stays in the inode
+        return 0;
+    }
 
+    uint32_t count = (uint32_t) ((end + A1FS_BLOCK_SIZE - 1) / A1FS_BLOCK_SIZE) - first;
+    uint32_t buffered = f != NULL ? f->count : 0;
+    if(count > DELALLOC_FILE_MAX || (uint64_t) offset / A1FS_BLOCK_SIZE > first + buffered){
+        // too much to keep in memory, or past a hole that would be buffered
+        // (and then written) as zeros: place what there is and write in place
+        return flush_delalloc(fs, file_inode_num);
+    }
+    uint32_t more = count > buffered ? count - buffered : 0;
+    if(fs->delalloc.blocks + more > DELALLOC_TOTAL_MAX){
+        int ret = flush_all_delalloc(fs);
+        if(ret != 0){
+            return ret;
+        }
+        return delalloc_write(fs, file_inode_num, buf, size, offset);
+    }
+    if(more > get_unreserved_blocks(fs)){
+        release_all_prealloc(fs);
+        if(more > get_unreserved_blocks(fs)){
+            return -ENOSPC;
+        }
+    }
 
-        ((a1fs_extent *)fs->inode_table[file_inode_num].indirect_pt)[fs->inode_table[file_inode_num].extent_num - 1].count += 1;
-        fs->inode_table[file_inode_num].size =  (original_block_count_of_file + 1)* A1FS_BLOCK_SIZE;  
+    if(f == NULL){
+        if((f = delalloc_add(&fs->delalloc, file_inode_num, first)) == NULL){
+            // out of memory: write in place instead
+            return 0;
+        }
+        // zero the rest of the last block now, as the size moves past it
+        zero_block_tail(fs, file_inode_num, inode->size);
+    }
+    bool inline_data = f->count == 0 && (inode->flags & A1FS_INODE_INLINE_DATA);
+    if(!delalloc_grow(&fs->delalloc, f, count)){
+        // out of memory: place what there is and write in place
+        if(f->count == 0){
+            delalloc_remove(&fs->delalloc, f);
+            return 0;
+        }
+        return flush_delalloc(fs, file_inode_num);
+    }
+    if(inline_data){
+        // the inline data becomes the start of the first buffered block
+        memcpy(f->data, inode->inline_data, inode->size);
+        inode->flags &= ~A1FS_INODE_INLINE_DATA;
+    }
 
-        // fill the last block with 0
-        memset(original_last_block_addr + A1FS_BLOCK_SIZE, '\0', A1FS_BLOCK_SIZE);
+    memcpy(f->data + (offset - (uint64_t) first * A1FS_BLOCK_SIZE), buf, size);
+    if(end > inode->size){
+        inode->size = end;
+    }
+    return (int) size;
+}
 
-        return 0;   
+bool delalloc_read(fs_ctx *fs, uint32_t file_inode_num, char *buf, size_t size, off_t offset){
+    delalloc_file *f = delalloc_find(&fs->delalloc, file_inode_num);
+    // the file may go on past the buffered blocks, in a hole
+    if(f == NULL || (uint64_t) offset < (uint64_t) f->first * A1FS_BLOCK_SIZE
+       || (uint64_t) offset >= (uint64_t) (f->first + f->count) * A1FS_BLOCK_SIZE){
+        return false;
+    }
+    memcpy(buf, f->data + (offset - (uint64_t) f->first * A1FS_BLOCK_SIZE), size);
+    return true;
+}
 
-    }else{ // the next block is not free, have to firstly create an extent.
+int flush_delalloc(fs_ctx *fs, uint32_t file_inode_num){
+    delalloc_file *f = delalloc_find(&fs->delalloc, file_inode_num);
+    if(f == NULL){
+        return 0;
+    }
+    // the blocks are allocated out of the reservation, all at once, so that
+    // they can be placed together
+    uint32_t count = f->count;
+    fs->delalloc.blocks -= count;
+    int ret = grow_file_blocks(fs, file_inode_num, count, f->data, 0);
+    fs->delalloc.blocks += count;
+    if(ret == 0){
+        delalloc_remove(&fs->delalloc, f);
+    }
+    return ret;
+}
 
-        if(fs->inode_table[file_inode_num].extent_num == 512){
-            return -1;
+int flush_all_delalloc(fs_ctx *fs){
+    int ret = 0;
+    uint32_t i = 0;
+    while(i < fs->delalloc.num_files){
+        // a flushed file is replaced by the last one, so only move on if it
+        // is still there
+        int r = flush_delalloc(fs, fs->delalloc.files[i].ino);
+        if(r != 0){
+            if(ret == 0){
+                ret = r;
+            }
+            i++;
         }
+    }
+    return ret;
+}
+
+void discard_delalloc(fs_ctx *fs, uint32_t file_inode_num){
+    delalloc_file *f = delalloc_find(&fs->delalloc, file_inode_num);
+    if(f != NULL){
+        delalloc_remove(&fs->delalloc, f);
+    }
+}
 
-        uint_fast32_t new_block_num = (uint32_t)get_first_available_position(fs->num_of_data_blocks, fs->data_bitmap);
-        set_bitmap(fs->data_bitmap, new_block_num);
-        *(fs->available_blocks) -= 1;
+void speculative_prealloc(fs_ctx *fs, uint32_t file_inode_num){
+    if(fs->prealloc_min == 0){
+        return;
+    }
+    prealloc_window *w = prealloc_find(&fs->prealloc, file_inode_num);
+    if(w == NULL && (w = prealloc_add(&fs->prealloc, file_inode_num, fs->prealloc_min)) == NULL){
+        return;
+    }
+    // keep to the blocks no one else needs, so as not to have to give the
+    // window back right away
+    if(w->count > 0 || (uint64_t) w->next * 4 > get_unreserved_blocks(fs)){
+        return;
+    }
 
-        //create a new extent
-        a1fs_extent new_extent;
-        // put the block inside it and put the extent into the indirect pointer
-        new_extent.start = new_block_num;
-        new_extent.count = 1;
-        ((a1fs_extent *)fs->inode_table[file_inode_num].indirect_pt)[fs->inode_table[file_inode_num].extent_num] = new_extent;
-        fs->inode_table[file_inode_num].extent_num += 1;
-        fs->inode_table[file_inode_num].size = (original_block_count_of_file + 1) * A1FS_BLOCK_SIZE;
+    // right after the file if those blocks are free, as its next extent if
+    // not, placed as grow_file_blocks() would
+    // (a window is only a guess at how large the file will get, so its class
+    // is that of the file as it is)
+    a1fs_inode *inode = &fs->inode_table[file_inode_num];
+    uint32_t block_count = get_num_blks_of_file(fs, inode);
+    alloc_class cls = file_alloc_class(block_count);
+    uint32_t goal = inode->extent_num > 0 ? find_last_block(fs, (int) file_inode_num) + 1 : get_inode_goal(fs, file_inode_num, cls);
+    uint32_t room = block_count < ALLOC_ROOM_MAX ? block_count : ALLOC_ROOM_MAX;
+    uint32_t next = w->next;
+    uint32_t start;
+    uint32_t got = allocate_data_blocks(fs, next, goal, room, cls, &start);
+    if(got == 0){
+        return;
+    }
+    // running out of free extents gives back all windows, this one as well
+    if((w = prealloc_find(&fs->prealloc, file_inode_num)) == NULL
+       && (w = prealloc_add(&fs->prealloc, file_inode_num, next)) == NULL){
+        free_data_blocks(fs, start, got);
+        return;
+    }
+    w->start = start;
+    w->count = got;
+    fs->prealloc.blocks += got;
+    w->next = next * 2 < fs->prealloc_max ? next * 2 : fs->prealloc_max;
+}
 
-        // fill the last block with 0
-        
-        memset((char *) get_addr_of_block(fs, new_block_num), '\0', A1FS_BLOCK_SIZE);
-        return 0;    
+/** Free the blocks left in a window and remove it. */
+static void release_window(fs_ctx *fs, prealloc_window *w){
+    if(w->count > 0){
+        free_data_blocks(fs, w->start, w->count);
+    }
+    prealloc_remove(&fs->prealloc, w);
+}
 
+void release_prealloc(fs_ctx *fs, uint32_t file_inode_num){
+    prealloc_window *w = prealloc_find(&fs->prealloc, file_inode_num);
+    if(w != NULL){
+        release_window(fs, w);
     }
+}
 
-    
-    
-}
\ No newline at end of file
+void release_all_prealloc(fs_ctx *fs){
+    while(fs->prealloc.num_windows > 0){
+        release_window(fs, &fs->prealloc.windows[0]);
+    }
+}
@@ -20,14 +20,38 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 #include "options.h"
 #include "a1fs.h"
+#include "bitmap.h"
+#include "dcache.h"
+#include "delalloc.h"
+#include "discard.h"
+#include "free_extents.h"
+#include "group.h"
+#include "handle.h"
+#include "prealloc.h"
 
 #define ROOT_INODE 0
 
+/**
+ * Most blocks left free before a new extent of a growing file that could not
+ * take the block after its last one, see allocate_data_extent().
+ */
+#define ALLOC_ROOM_MAX 2048
+
+/**
+ * Most blocks of a file whose blocks are allocated as those of a small file,
+ * in the small files area of a group, see alloc_class.
+ */
+#define ALLOC_SMALL_FILE 16
+
 /**
  * Mounted file system runtime state - "fs context".
+ *
+ * Only the allocation groups can be used by more than one thread at a time:
+ * everything else assumes the single-threaded mount.
  */
 typedef struct fs_ctx {
 	/** Pointer to the start of the image. */
@@ -36,14 +60,36 @@ typedef struct fs_ctx {
 	size_t size;
 
 	// ADDED: useful runtime state of the mounted file system should be cached
-	unsigned char *inode_bitmap;
-	unsigned char *data_bitmap;
+	alloc_group *groups; // the inodes and data blocks, one group for an image without groups
+	uint32_t num_groups;
+	uint32_t blocks_per_group;
+	uint32_t inodes_per_group;
+	alloc_policy alloc_policy; // how allocate_data_extent() picks a free extent in a group
 	a1fs_inode *inode_table;
 	uint64_t data_block; // address of the first data block
-	uint32_t* available_blocks; // a pointer to superblock->avaiable_inode
+	uint32_t* available_blocks; // a pointer to superblock->avaiable_inode, the total of all groups
 	uint32_t num_inodes;
 	uint32_t* available_inodes; // a pointer to superblock->available_inode
 	uint32_t num_of_data_blocks;
+	uint32_t features; // A1FS_FEATURE_* flags from the superblock
+	dcache dcache; // (parent inode, name) -> inode cache in front of path_lookup
+	handle_table handles; // open files and directories, indexed by fuse_file_info.fh
+	uint32_t extent_generation; // bumped whenever blocks are unmapped, see extent_cursor
+	bool delayed_alloc; // buffer appended blocks in delalloc until they are flushed
+	delalloc_table delalloc; // the buffered blocks, reserved out of available_blocks
+	prealloc_table prealloc; // blocks taken ahead of appends, see speculative_prealloc()
+	uint32_t prealloc_min; // blocks in the first window of a file, 0 for no windows
+	uint32_t prealloc_max; // most blocks in a window
+	uint64_t zeroed_bytes; // bytes of data blocks zeroed rather than written with data, reported at unmount
+	bool discard; // give freed blocks back to the host file of the image, see flush_discards()
+	discard_list discards; // the blocks freed since the last flush_discards()
+	uint32_t discard_batch; // blocks gathered before flush_discards()
+	uint64_t discarded_blocks; // blocks given back, reported at unmount
+	uint64_t discard_calls; // holes punched for them
+	int image_fd; // the image file, kept open to grow a thin image, -1 if not
+	uint32_t backed_blocks; // data blocks the image file has, all but for a thin image
+	uint32_t thin_chunk; // data blocks a thin image file grows by, see back_blocks()
+	uint32_t thin_grows; // times it grew, reported at unmount
 
 } fs_ctx;
 
@@ -64,6 +110,14 @@ bool fs_ctx_init(fs_ctx *fs, void *image, size_t size);
  */
 void fs_ctx_destroy(fs_ctx *fs);
 
+/**
+ * Hand the open image file of a thin image over to the context, which closes
+ * it in fs_ctx_destroy(), and count the data blocks it has from its size. The
+ * image must be mapped to its full size (the size in the superblock) for the
+ * file to grow into.
+ */
+void set_image_file(fs_ctx *fs, int fd, size_t file_size);
+
 /**
  * Return ceil(n)
  */
@@ -81,34 +135,209 @@ int roundup(double n);
 int path_lookup(fs_ctx *fs, const char *path);
 
 /**
- * Return the number of blocks allocated to the given file
+ * Called by iterate_dentries() for each entry of a directory.
+ *
+ * @param arg   the argument passed to iterate_dentries().
+ * @param ino   inode number of the entry.
+ * @param name  name of the entry.
+ * @param slot  position of the entry in the directory.
+ * @param next  position to resume the iteration from, right after the entry.
+ * @return      0 to continue; any other value stops the iteration.
+ */
+typedef int (*dentry_fn)(void *arg, a1fs_ino_t ino, const char *name, uint32_t slot, uint32_t next);
+
+/**
+ * Call fn for every entry of the given directory, in on-disk order, starting
+ * from the given position (0 for the first entry).
+ * Return the value that stopped the iteration, or 0 if fn returned 0 for all.
+ */
+int iterate_dentries(fs_ctx *fs, uint32_t dir_inode_num, uint32_t start, dentry_fn fn, void *arg);
+
+/**
+ * Find the entry with the given name in the given directory, using its hashed
+ * index if it has one. Return the slot of the entry, or -1 if there is none.
+ */
+int64_t find_dentry_slot(fs_ctx *fs, uint32_t dir_inode_num, const char *name);
+
+/**
+ * Return the inode number of the entry with the given name in the given
+ * directory, or -1 if there is no such entry.
+ */
+int find_dentry(fs_ctx *fs, uint32_t dir_inode_num, const char *name);
+
+/**
+ * Return the name of the entry at the given slot of the given directory, and
+ * store its inode number in *ino unless ino is NULL.
+ */
+const char *get_dentry(fs_ctx *fs, uint32_t dir_inode_num, uint32_t slot, a1fs_ino_t *ino);
+
+/**
+ * Add an entry to the given directory, growing it by a block if needed.
+ * Return 0 on success, or -ENOSPC if there is no space.
+ */
+int add_dentry(fs_ctx *fs, uint32_t dir_inode_num, const char *name, a1fs_ino_t ino);
+
+/**
+ * Remove the entry with the given name from the given directory, and free the
+ * blocks at the end of the directory that no longer
+ * hold any entries.
  */
-uint32_t get_num_blks_of_file(a1fs_inode ino);
+void remove_dentry(fs_ctx *fs, uint32_t dir_inode_num, const char *name);
 
 /**
- * Return the exact number(with indirect block if possible) of blocks allocated to the given file
+ * Append a block to the given directory.
+ * Return 0 on success, or -ENOSPC if there is no space.
  */
-uint32_t get_exact_num_blks_of_file(a1fs_inode ino);
+int grow_dir_by_a_block(fs_ctx *fs, uint32_t dir_inode_num);
 
 /**
- * Check if bitmap[index] is available or not
+ * Free the last block of the given directory.
  */
-int is_bit_set(uint32_t index, unsigned char *bitmap);
+void shrink_dir_by_a_block(fs_ctx *fs, uint32_t dir_inode_num);
 
 /**
- * Return the number of the first available inode in inode_bitmap
+ * Append an extent with the given A1FS_EXTENT_* flags to a file or
+ * directory, right after its last block.
+ * Return 0 on success, or -ENOSPC if the extent tree can't grow.
  */
-uint32_t get_first_available_position(uint32_t n, unsigned char *bitmap);
+int add_extent(fs_ctx *fs, a1fs_inode *inode, uint32_t start, uint32_t count, uint32_t flags);
 
 /**
- * Set the corresponding bit in the inode_bitmap to 1
+ * Free the blocks of a file or directory past the first num_blocks, and the
+ * extent tree nodes that are no longer needed.
  */
-void set_bitmap(unsigned char *bitmap, uint32_t index);
+void shrink_file_blocks(fs_ctx *fs, uint32_t inode_num, uint32_t num_blocks);
 
 /**
- * Unset the corresponding bit in the inode_bitmap
+ * Return the address of the given block (counting from 0) of the given
+ * file or directory, or 0 if the file is not that large.
  */
-void unset_bitmap(unsigned char *bitmap, uint32_t index);
+uint64_t get_addr_of_file_block(fs_ctx *fs, uint32_t inode_num, uint32_t block_index);
+
+/**
+ * Same as get_addr_of_file_block(), but try the extent of the cursor first,
+ * and leave the cursor at the extent of the block.
+ */
+uint64_t get_addr_of_file_block_at(fs_ctx *fs, uint32_t inode_num, uint32_t block_index,
+                                   extent_cursor *cursor);
+
+/**
+ * Return the number of blocks of the given file, up to the last one mapped
+ */
+uint32_t get_num_blks_of_file(fs_ctx *fs, a1fs_inode *ino);
+
+/**
+ * Return the exact number(with extent tree nodes) of blocks allocated to the given file,
+ * not counting its holes
+ */
+uint32_t get_exact_num_blks_of_file(fs_ctx *fs, a1fs_inode *ino);
+
+/**
+ * Return the number of free blocks that are not reserved for buffered data,
+ * i.e. that can be allocated.
+ */
+uint32_t get_unreserved_blocks(fs_ctx *fs);
+
+/**
+ * After an append to a file, take a window of free blocks for the appends to
+ * come if the file has used up the one it had. The windows of a file double
+ * from prealloc_min up to prealloc_max blocks. grow_file_blocks() takes blocks
+ * from the window first.
+ */
+void speculative_prealloc(fs_ctx *fs, uint32_t file_inode_num);
+
+/** Free the blocks left in the window of a file, if it has one. */
+void release_prealloc(fs_ctx *fs, uint32_t file_inode_num);
+
+/**
+ * Free the blocks left in all windows. Done when the free blocks run out, and
+ * at unmount.
+ */
+void release_all_prealloc(fs_ctx *fs);
+
+/**
+ * Allocate count contiguous data blocks and return the first one in *start.
+ * If there are none, the preallocated windows are freed and tried as well.
+ *
+ * The blocks from goal on are taken if they are free. Otherwise the policy of
+ * the mount picks a free extent of at least count + room blocks and the
+ * blocks are taken room blocks into it, so that the file that ends right
+ * before the extent (if any) can still grow in place; if there is no such
+ * extent, any free extent of count blocks will do. The group of the goal is
+ * searched first (the first group if there is no goal), then the groups after
+ * it in turn, each from the start of the area of the class of the blocks.
+ * Return false if there are no count contiguous free blocks.
+ */
+bool allocate_data_extent(fs_ctx *fs, uint32_t count, uint32_t goal, uint32_t room, alloc_class cls,
+                          uint32_t *start);
+
+/**
+ * Allocate up to count contiguous data blocks and return the first one in
+ * *start: as many as are free from goal on if goal is free, else count blocks
+ * as allocate_data_extent() does, else the largest free extent.
+ * Return the number of blocks allocated, 0 if there are no free blocks.
+ */
+uint32_t allocate_data_blocks(fs_ctx *fs, uint32_t count, uint32_t goal, uint32_t room, alloc_class cls,
+                              uint32_t *start);
+
+/**
+ * Allocate a metadata block of the given inode (a node of its extent tree or
+ * directory index), the first free one from its goal in the metadata area
+ * with next-fit or the first one of the smallest free extent with best-fit.
+ * Return false if there are no free blocks.
+ */
+bool allocate_data_block(fs_ctx *fs, uint32_t inode_num, uint32_t *block_num);
+
+/**
+ * Return the goal for the first blocks of a class of a file or directory: as
+ * far into the area of the class in the group of its inode as the inode is
+ * into the inodes of the group. Inodes next to each other thus get their
+ * blocks close together too.
+ */
+uint32_t get_inode_goal(fs_ctx *fs, uint32_t inode_num, alloc_class cls);
+
+/**
+ * Return the class of the blocks of a file that will have the given number of
+ * blocks.
+ */
+static inline alloc_class file_alloc_class(uint32_t num_blocks)
+{
+	return num_blocks <= ALLOC_SMALL_FILE ? ALLOC_SMALL : ALLOC_LARGE;
+}
+
+/**
+ * Allocate an inode for a new file or directory in the given parent
+ * directory: the first free one from the parent on, in the group of the
+ * parent, except for a directory in an image with groups, which goes where
+ * Orlov's allocator places it. If that group is full, the groups after it are
+ * tried in turn.
+ * Return false if there are no free inodes.
+ */
+bool allocate_inode(fs_ctx *fs, uint32_t parent, bool dir, uint32_t *inode_num);
+
+/** Free an inode: unset its bit in the inode bitmap of its group. */
+void free_inode(fs_ctx *fs, uint32_t inode_num, bool dir);
+
+/**
+ * Free a data block: unset its bit in the data bitmap and update the
+ * number of available blocks.
+ */
+void free_data_block(fs_ctx *fs, uint32_t block_num);
+
+/**
+ * Free the data blocks [start, start + count), e.g. those of an extent, in one
+ * pass over the data bitmap.
+ */
+void free_data_blocks(fs_ctx *fs, uint32_t start, uint32_t count);
+
+/**
+ * Give the blocks freed since the last call that are still free back to the
+ * host file the image is in, by punching holes in it through the mapping, so
+ * that they read as zeros and take no space on the host. Called when
+ * discard_batch blocks have been freed, and at unmount. If the host file
+ * system can't punch holes, discard is turned off.
+ */
+void flush_discards(fs_ctx *fs);
 
 /**
  * Get the path without the last component and store the result in buf
@@ -137,14 +366,107 @@ uint64_t get_addr_of_block(fs_ctx *fs, uint32_t block_num);
 uint32_t get_num_of_block(fs_ctx *fs, uint64_t block_addr);
 
 /**
- * Return the address of the byte which we need to begin to write.
+ * Return the address of the byte which we need to begin to write, finding its
+ * block from the cursor.
  * Precondition: offset % A1FS_BLOCK_SIZE != 0
  */
-uint64_t get_addr_of_starting_write_point(fs_ctx *fs, uint32_t file_inode_num, uint64_t offset);
+uint64_t get_addr_of_starting_write_point(fs_ctx *fs, uint32_t file_inode_num, uint64_t offset,
+                                          extent_cursor *cursor);
+
+/**
+ * Grow a file by count blocks, from its preallocated window first and then in
+ * as few extents as the free space allows,
+ * and zero the rest of its last block past the end of the file. The new blocks
+ * are filled from data (count blocks of it) if it is not NULL. Otherwise they
+ * are mapped in unwritten extents, which read as zeros without being zeroed,
+ * if flags has A1FS_EXTENT_UNWRITTEN, or left as they are for the caller to
+ * fill if not.
+ * The size of the file is left for the caller to set.
+ * Return 0 on success, or -ENOSPC (with the file as it was) if there are not
+ * enough free blocks.
+ */
+int grow_file_blocks(fs_ctx *fs, uint32_t file_inode_num, uint32_t count, const char *data, uint32_t flags);
+
+/**
+ * Zero the rest of the block of a file that holds the given offset, from the
+ * offset on, if the block is mapped and written; e.g. at the end of the file,
+ * before the file is extended past it.
+ */
+void zero_block_tail(fs_ctx *fs, uint32_t file_inode_num, uint64_t offset);
+
+/**
+ * Map the blocks [logical, logical + count) of a file, which must not be
+ * mapped, to newly allocated ones, left as they are: in an unwritten extent if
+ * flags has A1FS_EXTENT_UNWRITTEN, else for the caller to fill.
+ * Return 0 on success, or -ENOSPC if there are not enough free blocks.
+ */
+int map_file_blocks(fs_ctx *fs, uint32_t file_inode_num, uint32_t logical, uint32_t count, uint32_t flags);
+
+/**
+ * Return the address of the given block of a file, ready for the bytes
+ * [from, to) of it to be written: a block in a hole is allocated, and one in
+ * an unwritten extent is marked written, and either has the rest of it
+ * zeroed. Return 0 if there is no space to do either.
+ */
+uint64_t get_block_for_write(fs_ctx *fs, uint32_t file_inode_num, uint32_t block_index,
+                             uint32_t from, uint32_t to, extent_cursor *cursor);
+
+/**
+ * Zero the bytes of a new block of a file that are not about to be written,
+ * those before from and those from to on.
+ */
+void zero_block_around(fs_ctx *fs, char *block, uint32_t from, uint32_t to);
+
+/**
+ * Allocate unwritten extents for the blocks of [first, first + count) of a
+ * file that are not mapped, for fallocate().
+ * Return 0 on success, or -ENOSPC (before allocating anything) if there are
+ * not enough free blocks.
+ */
+int allocate_file_range(fs_ctx *fs, uint32_t file_inode_num, uint32_t first, uint32_t count);
+
+/**
+ * Free the blocks [first, first + count) of a file, leaving a hole.
+ * Return 0 on success, or -ENOSPC with the file as it was.
+ */
+int punch_file_range(fs_ctx *fs, uint32_t file_inode_num, uint32_t first, uint32_t count);
+
+/**
+ * Move the inline data of a file (A1FS_INODE_INLINE_DATA) into its first block.
+ * Return 0 on success, or -ENOSPC if the block can't be allocated.
+ */
+int spill_inline_data(fs_ctx *fs, uint32_t file_inode_num);
+
+/**
+ * With delayed allocation, buffer a write that reaches past the blocks a file
+ * has, reserving the blocks it needs, and update the size of the file.
+ * Return size if the data was buffered; 0 if the write is to be done in place
+ * (within the blocks of the file, in its inline data, or because there is not
+ * enough memory to buffer it); or -ENOSPC if the blocks can't be reserved.
+ */
+int delalloc_write(fs_ctx *fs, uint32_t file_inode_num, const char *buf, size_t size, off_t offset);
+
+/**
+ * Copy size bytes at offset from the buffered blocks of a file, if that is
+ * where they are. Return false if the file has no blocks there.
+ */
+bool delalloc_read(fs_ctx *fs, uint32_t file_inode_num, char *buf, size_t size, off_t offset);
+
+/**
+ * Allocate blocks for the buffered data of a file and write it out.
+ * Return 0 on success (or if nothing is buffered), or -ENOSPC with the data
+ * still buffered.
+ */
+int flush_delalloc(fs_ctx *fs, uint32_t file_inode_num);
+
+/**
+ * Flush the buffered data of all files.
+ * Return 0 on success, or the error of the first file that failed.
+ */
+int flush_all_delalloc(fs_ctx *fs);
 
 /**
- * growing the file by allocating one more blocks for it.
- * the growing part will be filled by 0.
- * It will return -1 if there is too much extent, or there has no enough blocks; otherwise return 0;
+ * Drop the buffered data of a file without writing it, e.g. when it is
+ * removed.
  */
-int growing_a_block_for_file(fs_ctx *fs, uint32_t file_inode_num);
\ No newline at end of file
+void discard_delalloc(fs_ctx *fs, uint32_t file_inode_num);
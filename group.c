@@ -0,0 +1,321 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Allocation groups implementation.
+ */
+
+#include <string.h>
+
+#include "group.h"
+
+
+/** Set up a bitmap over part of an on-disk bitmap, which may be empty. */
+static bool init_part(bitmap *bm, unsigned char *bits, uint32_t first, uint32_t size, uint32_t *available)
+{
+	if (size == 0) {
+		memset(bm, 0, sizeof(*bm));
+		bm->available = available;
+		return true;
+	}
+	return bitmap_init(bm, bits + first / 8, size, available);
+}
+
+bool group_init(alloc_group *g, unsigned char *inode_bits, uint32_t first_inode, uint32_t num_inodes,
+                uint32_t *free_inodes, unsigned char *data_bits, uint32_t first_block, uint32_t num_blocks,
+                uint32_t *free_blocks)
+{
+	memset(g, 0, sizeof(*g));
+	g->first_inode = first_inode;
+	g->first_block = first_block;
+	if (!init_part(&g->inode_bitmap, inode_bits, first_inode, num_inodes, free_inodes)) {
+		return false;
+	}
+	if (!init_part(&g->data_bitmap, data_bits, first_block, num_blocks, free_blocks)) {
+		bitmap_destroy(&g->inode_bitmap);
+		return false;
+	}
+	if (!free_extents_init(&g->free_extents, &g->data_bitmap)) {
+		bitmap_destroy(&g->inode_bitmap);
+		bitmap_destroy(&g->data_bitmap);
+		return false;
+	}
+	// a small part for metadata, a quarter for small files and the rest for
+	// large files, to start with
+	g->area_end[ALLOC_META] = num_blocks / 32;
+	g->area_end[ALLOC_SMALL] = g->area_end[ALLOC_META] + num_blocks / 4;
+	g->area_end[ALLOC_LARGE] = num_blocks;
+	pthread_mutex_init(&g->lock, NULL);
+	return true;
+}
+
+void group_destroy(alloc_group *g)
+{
+	bitmap_destroy(&g->inode_bitmap);
+	bitmap_destroy(&g->data_bitmap);
+	free_extents_destroy(&g->free_extents);
+	pthread_mutex_destroy(&g->lock);
+}
+
+/**
+ * Carry a change of a free count of the group over to the total, if there is
+ * one. Other groups change the total at the same time, so it is updated
+ * atomically.
+ */
+static void update_total(uint32_t *total, uint32_t before, uint32_t after)
+{
+	if (total != NULL && before != after) {
+		__atomic_add_fetch(total, after - before, __ATOMIC_RELAXED);
+	}
+}
+
+uint32_t group_alloc_inode(alloc_group *g, uint32_t goal, bool dir)
+{
+	uint32_t local = goal - g->first_inode;
+	pthread_mutex_lock(&g->lock);
+	uint32_t before = *g->inode_bitmap.available;
+	uint32_t index = UINT32_MAX;
+	if (before > 0) {
+		uint32_t count;
+		if (goal >= g->first_inode && local < g->inode_bitmap.size) {
+			index = bitmap_next_free_run(&g->inode_bitmap, local, &count);
+		}
+		if (index == UINT32_MAX) {
+			index = get_first_available_position(&g->inode_bitmap);
+		}
+	}
+	if (index != UINT32_MAX) {
+		set_bitmap(&g->inode_bitmap, index);
+		update_total(g->total_free_inodes, before, *g->inode_bitmap.available);
+		if (dir && g->used_dirs != NULL) {
+			(*g->used_dirs)++;
+		}
+	}
+	pthread_mutex_unlock(&g->lock);
+	return index == UINT32_MAX ? UINT32_MAX : g->first_inode + index;
+}
+
+void group_free_inode(alloc_group *g, uint32_t ino, bool dir)
+{
+	pthread_mutex_lock(&g->lock);
+	uint32_t before = *g->inode_bitmap.available;
+	unset_bitmap(&g->inode_bitmap, ino - g->first_inode);
+	update_total(g->total_free_inodes, before, *g->inode_bitmap.available);
+	if (dir && g->used_dirs != NULL) {
+		(*g->used_dirs)--;
+	}
+	pthread_mutex_unlock(&g->lock);
+}
+
+/**
+ * Take the free blocks [start, start + count) of the group (numbered from its
+ * start) out of the index and the bitmap. The lock must be held.
+ */
+static bool take_blocks(alloc_group *g, uint32_t start, uint32_t count)
+{
+	if (!free_extents_remove(&g->free_extents, start, count)) {
+		return false;
+	}
+	uint32_t before = *g->data_bitmap.available;
+	bitmap_set_range(&g->data_bitmap, start, count);
+	update_total(g->total_free_blocks, before, *g->data_bitmap.available);
+	return true;
+}
+
+/** Return the start of the area of a class. The lock must be held. */
+static uint32_t area_start(alloc_group *g, alloc_class cls)
+{
+	return cls == ALLOC_META ? 0 : g->area_end[cls - 1];
+}
+
+/**
+ * Return the blocks that a new extent of count blocks of a class is aligned
+ * to, 1 for none.
+ */
+static uint32_t extent_align(alloc_group *g, alloc_class cls, uint32_t count)
+{
+	if (cls != ALLOC_LARGE || g->stripe_unit == 0) {
+		return 1;
+	}
+	return count >= g->stripe_width ? g->stripe_width : g->stripe_unit;
+}
+
+/** Round a block of the group up to a multiple of align. */
+static uint32_t align_block(uint32_t block, uint32_t align)
+{
+	return (block + align - 1) / align * align;
+}
+
+uint32_t group_area_goal(alloc_group *g, alloc_class cls, uint32_t num, uint32_t den)
+{
+	if (g->low_first) {
+		return g->first_block;
+	}
+	pthread_mutex_lock(&g->lock);
+	uint32_t start = area_start(g, cls);
+	uint32_t goal = start + (uint32_t) ((uint64_t) (g->area_end[cls] - start) * num / den);
+	goal = align_block(goal, extent_align(g, cls, 1));
+	pthread_mutex_unlock(&g->lock);
+	return g->first_block + goal;
+}
+
+/**
+ * Move the ends of the areas so that the blocks [start, end) just allocated
+ * for a class are in its area. The lock must be held.
+ */
+static void fit_areas(alloc_group *g, alloc_class cls, uint32_t start, uint32_t end)
+{
+	for (int c = cls; c < ALLOC_LARGE && g->area_end[c] < end; c++) {
+		g->area_end[c] = end;
+	}
+	if (start < area_start(g, cls)) {
+		for (int c = cls - 1; c >= ALLOC_META && g->area_end[c] > start; c--) {
+			g->area_end[c] = start;
+		}
+	}
+}
+
+/**
+ * Find where to put a new extent of count blocks, starting on a multiple of
+ * align: room blocks into a free extent chosen by the policy (with next-fit,
+ * from block from on) if there is one with enough blocks for that, else in any
+ * free extent large enough. The lock must be held.
+ * Return false if there is no free extent large enough.
+ */
+static bool find_extent(alloc_group *g, uint32_t count, uint32_t room, uint32_t from, alloc_policy policy,
+                        uint32_t align, uint32_t *start)
+{
+	// next-fit only looks at the free extents that start after from, so the
+	// one from is in counts as well, from from on
+	uint32_t left = 0;
+	free_extent *found;
+	if (policy == ALLOC_NEXT_FIT && (found = free_extents_lookup(&g->free_extents, from)) != NULL) {
+		left = found->start + found->count - from;
+	}
+	uint32_t need = count + align - 1;
+	if (left >= need + room) {
+		*start = align_block(from + room, align);
+	} else if ((found = free_extents_find(&g->free_extents, need + room, from, policy)) != NULL) {
+		*start = align_block(found->start + room, align);
+	} else if (left >= need) {
+		*start = align_block(from, align);
+	} else if ((found = free_extents_find(&g->free_extents, need, from, policy)) != NULL) {
+		*start = align_block(found->start, align);
+	} else {
+		return false;
+	}
+	return true;
+}
+
+bool group_alloc_extent(alloc_group *g, uint32_t count, uint32_t goal, uint32_t room, alloc_policy policy,
+                        alloc_class cls, uint32_t *start)
+{
+	pthread_mutex_lock(&g->lock);
+	uint32_t local = goal - g->first_block;
+	if (goal < g->first_block || local >= group_num_blocks(g)) {
+		local = area_start(g, cls);
+	}
+
+	free_extent *found = free_extents_lookup(&g->free_extents, local);
+	if (found != NULL && found->start + found->count - local >= count) {
+		*start = local;
+		bool ok = take_blocks(g, *start, count);
+		pthread_mutex_unlock(&g->lock);
+		*start += g->first_block;
+		return ok;
+	}
+
+	// a new extent goes in the area of the class, after the goal if the goal
+	// is in there; or as low as it fits with low_first
+	uint32_t from = local;
+	if (g->low_first) {
+		from = 0;
+	} else if (local < area_start(g, cls) || local >= g->area_end[cls]) {
+		from = area_start(g, cls);
+	}
+	// aligned if there is room for that, else wherever it fits
+	uint32_t align = extent_align(g, cls, count);
+	bool ok = find_extent(g, count, room, from, policy, align, start)
+	          || (align > 1 && find_extent(g, count, room, from, policy, 1, start));
+	ok = ok && take_blocks(g, *start, count);
+	// best-fit goes wherever the smallest free extent is, which says nothing
+	// about where the areas should be
+	if (ok && policy == ALLOC_NEXT_FIT && !g->low_first) {
+		fit_areas(g, cls, *start, *start + count);
+	}
+	pthread_mutex_unlock(&g->lock);
+	*start += g->first_block;
+	return ok;
+}
+
+uint32_t group_alloc_at(alloc_group *g, uint32_t count, uint32_t goal)
+{
+	uint32_t local = goal - g->first_block;
+	pthread_mutex_lock(&g->lock);
+	free_extent *found = free_extents_lookup(&g->free_extents, local);
+	uint32_t n = 0;
+	if (found != NULL) {
+		n = found->start + found->count - local < count ? found->start + found->count - local : count;
+		if (!take_blocks(g, local, n)) {
+			n = 0;
+		}
+	}
+	pthread_mutex_unlock(&g->lock);
+	return n;
+}
+
+uint32_t group_largest_free(alloc_group *g)
+{
+	pthread_mutex_lock(&g->lock);
+	free_extent *found = free_extents_largest(&g->free_extents);
+	uint32_t n = found != NULL ? found->count : 0;
+	pthread_mutex_unlock(&g->lock);
+	return n;
+}
+
+uint32_t group_next_free(alloc_group *g, uint32_t from, uint32_t *count)
+{
+	pthread_mutex_lock(&g->lock);
+	uint32_t index = bitmap_next_free_run(&g->data_bitmap, from - g->first_block, count);
+	pthread_mutex_unlock(&g->lock);
+	return index == UINT32_MAX ? UINT32_MAX : g->first_block + index;
+}
+
+uint32_t group_alloc_largest(alloc_group *g, uint32_t count, uint32_t *start)
+{
+	pthread_mutex_lock(&g->lock);
+	free_extent *found = free_extents_largest(&g->free_extents);
+	uint32_t n = 0;
+	if (found != NULL) {
+		n = found->count < count ? found->count : count;
+		*start = g->first_block + found->start;
+		if (!take_blocks(g, found->start, n)) {
+			n = 0;
+		}
+	}
+	pthread_mutex_unlock(&g->lock);
+	return n;
+}
+
+void group_free_blocks(alloc_group *g, uint32_t start, uint32_t count)
+{
+	pthread_mutex_lock(&g->lock);
+	uint32_t before = *g->data_bitmap.available;
+	bitmap_clear_range(&g->data_bitmap, start - g->first_block, count);
+	update_total(g->total_free_blocks, before, *g->data_bitmap.available);
+	// if there is no memory for a new free extent, the blocks are free on
+	// disk but only found again by the index built at the next mount
+	free_extents_add(&g->free_extents, start - g->first_block, count);
+	pthread_mutex_unlock(&g->lock);
+}
@@ -0,0 +1,173 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Allocation groups header file.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bitmap.h"
+#include "free_extents.h"
+
+
+/** What data blocks are for, each kind with an area of its own in a group. */
+typedef enum alloc_class {
+	/** Directory blocks and the nodes of extent trees and directory indexes. */
+	ALLOC_META,
+	/** The blocks of small files. */
+	ALLOC_SMALL,
+	/** The blocks of large files. */
+	ALLOC_LARGE,
+	ALLOC_CLASSES,
+
+} alloc_class;
+
+/**
+ * The inodes and data blocks of one allocation group, with the summary of
+ * their bitmaps and the index of the free data blocks. Each group has its own
+ * lock, taken by all of the functions below, so that allocations in different
+ * groups don't wait for each other. Inode and block numbers passed to and
+ * returned by them are those of the whole file system.
+ */
+typedef struct alloc_group {
+	/** First inode of the group. */
+	uint32_t first_inode;
+	/** First data block of the group. */
+	uint32_t first_block;
+	/** The inodes of the group; the free count is the group's. */
+	bitmap inode_bitmap;
+	/** The data blocks of the group; the free count is the group's. */
+	bitmap data_bitmap;
+	/** The free runs of data_bitmap, numbered from the start of the group. */
+	free_extents free_extents;
+	/** Number of directories in the group, or NULL if not counted. */
+	uint32_t *used_dirs;
+	/** Free counts of the whole file system to keep in step, or NULL. */
+	uint32_t *total_free_inodes;
+	uint32_t *total_free_blocks;
+	/**
+	 * Ends of the areas of the classes, numbered from the start of the group:
+	 * metadata from the start of the group, then small files, then large
+	 * files to the end. New extents of a class are looked for in its area
+	 * first, so that small blocks don't break up the free space large files
+	 * grow into; an area that runs out grows over the one next to it.
+	 */
+	uint32_t area_end[ALLOC_CLASSES];
+	/**
+	 * Stripe unit and full stripe of the device in blocks, 0 if it is not
+	 * striped. The group must start on a full stripe.
+	 */
+	uint32_t stripe_unit;
+	uint32_t stripe_width;
+	/**
+	 * Ignore the areas and put new extents in the first free extent of the
+	 * group large enough, so that the highest block in use stays as low as it
+	 * can (see A1FS_FEATURE_THIN).
+	 */
+	bool low_first;
+	pthread_mutex_t lock;
+
+} alloc_group;
+
+/**
+ * Initialize a group over its part of the bitmaps.
+ *
+ * @param g            the group to initialize.
+ * @param inode_bits   the whole inode bitmap in the image.
+ * @param first_inode  first inode of the group, a multiple of A1FS_GROUP_ALIGN.
+ * @param num_inodes   number of inodes in the group (may be 0).
+ * @param free_inodes  free inode count of the group.
+ * @param data_bits    the whole data bitmap in the image.
+ * @param first_block  first data block of the group, a multiple of A1FS_GROUP_ALIGN.
+ * @param num_blocks   number of data blocks in the group.
+ * @param free_blocks  free block count of the group.
+ * @return             true on success; false if out of memory.
+ */
+bool group_init(alloc_group *g, unsigned char *inode_bits, uint32_t first_inode, uint32_t num_inodes,
+                uint32_t *free_inodes, unsigned char *data_bits, uint32_t first_block, uint32_t num_blocks,
+                uint32_t *free_blocks);
+
+/** Free all memory used by the group. */
+void group_destroy(alloc_group *g);
+
+/** Return the number of data blocks in the group. */
+static inline uint32_t group_num_blocks(const alloc_group *g)
+{
+	return g->data_bitmap.size;
+}
+
+/**
+ * Allocate the first free inode of the group at or after goal, wrapping around
+ * to the start of the group, and count it in used_dirs if dir is true.
+ * Return UINT32_MAX if there is none.
+ */
+uint32_t group_alloc_inode(alloc_group *g, uint32_t goal, bool dir);
+
+/** Free an inode of the group, and uncount it from used_dirs if dir is true. */
+void group_free_inode(alloc_group *g, uint32_t ino, bool dir);
+
+/**
+ * Return the block num / den of the way into the area of a class, e.g. 0 / 1
+ * for its start; for large files, the first stripe unit from there on. With
+ * low_first, the start of the group.
+ */
+uint32_t group_area_goal(alloc_group *g, alloc_class cls, uint32_t num, uint32_t den);
+
+/**
+ * Allocate count contiguous blocks of the group for a class and return the
+ * first one in *start: from goal on if they are free, else room blocks into a
+ * free extent of at least count + room blocks chosen by the policy, else from
+ * any free extent of count blocks. A goal outside of the group is the start
+ * of the area of the class, and next-fit looks for a free extent from the
+ * goal if it is in the area of the class, else from the start of the area.
+ * If it finds one past the end of the area, the area grows to take it in
+ * (and the areas after it shrink); if it wrapped around to one before the
+ * start of the area, the areas before it shrink. On a striped device, a new
+ * extent of a large file starts on a stripe unit (a full stripe if count is
+ * at least that) if there is a free extent large enough for that.
+ * Return false if there are no count contiguous free blocks in the group.
+ */
+bool group_alloc_extent(alloc_group *g, uint32_t count, uint32_t goal, uint32_t room, alloc_policy policy,
+                        alloc_class cls, uint32_t *start);
+
+/**
+ * Allocate up to count of the blocks of the group from goal on, as many as
+ * are free, whatever area they are in. Return the number of blocks allocated, 0 if goal is not free.
+ */
+uint32_t group_alloc_at(alloc_group *g, uint32_t count, uint32_t goal);
+
+/** Return the number of blocks in the largest free extent of the group. */
+uint32_t group_largest_free(alloc_group *g);
+
+/**
+ * Return the first block of the first run of free blocks of the group at or
+ * after the given one, and its length in count; UINT32_MAX if there are no
+ * free blocks from there on.
+ */
+uint32_t group_next_free(alloc_group *g, uint32_t from, uint32_t *count);
+
+/**
+ * Allocate up to count blocks from the start of the largest free extent of the
+ * group and return the first one in *start.
+ * Return the number of blocks allocated, 0 if the group has no free blocks.
+ */
+uint32_t group_alloc_largest(alloc_group *g, uint32_t count, uint32_t *start);
+
+/** Free the blocks [start, start + count), which must all be in the group. */
+void group_free_blocks(alloc_group *g, uint32_t start, uint32_t count);
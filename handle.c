@@ -0,0 +1,87 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Open file handle table implementation.
+ */
+
+#include <stdlib.h>
+
+#include "handle.h"
+
+
+/** Number of slots in a new table. */
+#define HANDLE_TABLE_INITIAL 64
+
+/** Chain the slots from first to the end of the table into the free list. */
+static void handle_free_slots(handle_table *ht, uint32_t first)
+{
+	for (uint32_t i = first; i < ht->capacity; i++) {
+		ht->handles[i].next_free = i + 1 < ht->capacity ? i + 1 : UINT32_MAX;
+	}
+	ht->free_head = first;
+}
+
+bool handle_table_init(handle_table *ht)
+{
+	ht->handles = calloc(HANDLE_TABLE_INITIAL, sizeof(a1fs_handle));
+	if (ht->handles == NULL) {
+		return false;
+	}
+	ht->capacity = HANDLE_TABLE_INITIAL;
+	handle_free_slots(ht, 0);
+	return true;
+}
+
+void handle_table_destroy(handle_table *ht)
+{
+	free(ht->handles);
+	ht->handles = NULL;
+	ht->capacity = 0;
+}
+
+uint64_t handle_open(handle_table *ht, a1fs_ino_t ino)
+{
+	if (ht->free_head == UINT32_MAX) {
+		// all slots are used, so double the table
+		a1fs_handle *handles = realloc(ht->handles, 2 * ht->capacity * sizeof(a1fs_handle));
+		if (handles == NULL) {
+			return 0;
+		}
+		ht->handles = handles;
+		ht->capacity *= 2;
+		handle_free_slots(ht, ht->capacity / 2);
+	}
+
+	uint32_t slot = ht->free_head;
+	a1fs_handle *handle = &ht->handles[slot];
+	ht->free_head = handle->next_free;
+	handle->ino = ino;
+	handle->cursor.extent.count = 0;
+	return (uint64_t) slot + 1;
+}
+
+a1fs_handle *handle_get(handle_table *ht, uint64_t fh)
+{
+	return fh == 0 ? NULL : &ht->handles[fh - 1];
+}
+
+void handle_release(handle_table *ht, uint64_t fh)
+{
+	if (fh == 0) {
+		return;
+	}
+	ht->handles[fh - 1].next_free = ht->free_head;
+	ht->free_head = (uint32_t) (fh - 1);
+}
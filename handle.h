@@ -0,0 +1,84 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Open file handle table header file.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "a1fs.h"
+
+/**
+ * The extent of a file that was used last, so that mapping the next offset
+ * doesn't have to search the extent tree again.
+ */
+typedef struct extent_cursor {
+	/** Copy of the extent; count is 0 if there is none. */
+	a1fs_extent extent;
+	/** Value of fs_ctx.extent_generation when the extent was copied. */
+	uint32_t generation;
+
+} extent_cursor;
+
+/** An open file or directory. */
+typedef struct a1fs_handle {
+	/** Inode number of the file. */
+	a1fs_ino_t ino;
+	/** Next free slot, while the slot is free. */
+	uint32_t next_free;
+	/** Where the last offset of the file was found. */
+	extent_cursor cursor;
+
+} a1fs_handle;
+
+/**
+ * Table of open files. A handle is stored in fuse_file_info.fh as its slot
+ * number plus one, so that 0 means "no handle".
+ */
+typedef struct handle_table {
+	/** capacity slots, used and free. */
+	a1fs_handle *handles;
+	/** Number of slots. */
+	uint32_t capacity;
+	/** First free slot, or UINT32_MAX if all slots are used. */
+	uint32_t free_head;
+
+} handle_table;
+
+/**
+ * Initialize an empty table.
+ *
+ * @return  true on success; false if out of memory.
+ */
+bool handle_table_init(handle_table *ht);
+
+/** Free all memory used by the table. */
+void handle_table_destroy(handle_table *ht);
+
+/**
+ * Open a handle for a file.
+ *
+ * @return  the value for fuse_file_info.fh, or 0 if out of memory.
+ */
+uint64_t handle_open(handle_table *ht, a1fs_ino_t ino);
+
+/** Return the handle for a fuse_file_info.fh value, or NULL if fh is 0. */
+a1fs_handle *handle_get(handle_table *ht, uint64_t fh);
+
+/** Close a handle returned by handle_open(). */
+void handle_release(handle_table *ht, uint64_t fh);
@@ -69,3 +69,36 @@ end:
 	close(fd);
 	return addr;
 }
+
+void *map_file_growable(const char *path, size_t block_size, size_t map_size, size_t *file_size, int *fd)
+{
+	*fd = open(path, O_RDWR);
+	if (*fd < 0) {
+		perror(path);
+		return NULL;
+	}
+
+	struct stat s;
+	if (fstat(*fd, &s) < 0) {
+		perror("fstat");
+		goto fail;
+	}
+	if (s.st_size == 0 || s.st_size % block_size != 0 || (size_t) s.st_size > map_size) {
+		fprintf(stderr, "Image file size is not a multiple of block size, or too large\n");
+		goto fail;
+	}
+
+	void *addr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+	if (addr == MAP_FAILED) {
+		perror("mmap");
+		goto fail;
+	}
+	assert(is_aligned((size_t)addr, block_size));
+	*file_size = s.st_size;
+	return addr;
+
+fail:
+	close(*fd);
+	*fd = -1;
+	return NULL;
+}
@@ -33,3 +33,21 @@
  *                    NULL on failure.
  */
 void *map_file(const char *path, size_t block_size, size_t *size);
+
+/**
+ * Map map_size bytes of a file into memory for reading and writing, even if
+ * the file is shorter, so that it can grow into the mapping with ftruncate().
+ * The part of the mapping past the end of the file must not be touched until
+ * the file has grown over it. The file is left open for that.
+ *
+ * File size must be a non-zero multiple of the block_size.
+ *
+ * @param path        image file path.
+ * @param block_size  file system block size.
+ * @param map_size    size of the mapping, a multiple of block_size.
+ * @param file_size   pointer to the variable that will be set to file size.
+ * @param fd          pointer to the variable that will be set to the open file.
+ * @return            pointer to the mapping in memory on success;
+ *                    NULL on failure.
+ */
+void *map_file_growable(const char *path, size_t block_size, size_t map_size, size_t *file_size, int *fd);
@@ -16,6 +16,7 @@
  * CSC369 Assignment 1 - a1fs formatting tool.
  */
 
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -42,6 +43,18 @@ typedef struct mkfs_opts {
 	bool force;
 	/** Zero out image contents. */
 	bool zero;
+	/** Use variable length directory entries. */
+	bool vardir;
+	/** Number of data blocks in an allocation group, 0 for no groups. */
+	size_t blocks_per_group;
+	/** Stripe unit of the device in bytes, 0 if not striped. */
+	size_t stripe_unit;
+	/** Number of stripe units in a full stripe, 0 for 1. */
+	size_t stripe_units;
+	/** Largest size of a thin-provisioned image in bytes, 0 for a full one. */
+	size_t thin_size;
+	/** Bytes a thin-provisioned image file grows by at a time. */
+	size_t thin_chunk;
 
 } mkfs_opts;
 
@@ -49,13 +62,27 @@ static const char *help_str = "\
 Usage: %s options image\n\
 \n\
 Format the image file into a1fs file system. The file must exist and\n\
-its size must be a multiple of a1fs block size - %zu bytes.\n\
+its size must be a multiple of a1fs block size - %zu bytes, unless -T\n\
+is given.\n\
 \n\
 Options:\n\
     -i num  number of inodes; required argument\n\
     -h      print help and exit\n\
     -f      force format - overwrite existing a1fs file system\n\
     -z      zero out image contents\n\
+    -V      use variable length directory entries\n\
+    -g num  divide the image into allocation groups of num data blocks\n\
+            (a multiple of 64), each with its own inodes and free counts\n\
+    -u num  stripe unit of the device in bytes (a multiple of the block\n\
+            size): align the data blocks and large files to it\n\
+    -w num  number of stripe units in a full stripe (default 1); groups\n\
+            are rounded up to a multiple of a full stripe\n\
+    -T size largest size of a thin-provisioned image in bytes (a multiple\n\
+            of the block size; k, m, g and t suffixes are allowed): the\n\
+            image file is created if it doesn't exist and only has the\n\
+            metadata and one chunk of data blocks, and grows by a chunk at\n\
+            a time when mounted, up to size\n\
+    -C size chunk a thin-provisioned image grows by (default 16m)\n\
 ";
 
 static void print_help(FILE *f, const char *progname)
@@ -64,16 +91,53 @@ static void print_help(FILE *f, const char *progname)
 }
 
 
+/**
+ * Parse a size in bytes with an optional k, m, g or t suffix.
+ * Return 0 if it is invalid.
+ */
+static size_t parse_size(const char *str)
+{
+	char *end;
+	unsigned long long n = strtoull(str, &end, 10);
+	int shift = 0;
+	switch (*end) {
+		case 't': case 'T': shift += 10; // fall through
+		case 'g': case 'G': shift += 10; // fall through
+		case 'm': case 'M': shift += 10; // fall through
+		case 'k': case 'K': shift += 10; end++; break;
+		default: break;
+	}
+	if (end == str || *end != '\0' || n > (SIZE_MAX >> shift)) {
+		return 0;
+	}
+	return (size_t) n << shift;
+}
+
 static bool parse_args(int argc, char *argv[], mkfs_opts *opts)
 {
 	char o;
-	while ((o = getopt(argc, argv, "i:hfvz")) != -1) {
+	opts->thin_chunk = 16 << 20;
+	while ((o = getopt(argc, argv, "i:g:u:w:T:C:hfvzV")) != -1) {
 		switch (o) {
 			case 'i': opts->n_inodes = strtoul(optarg, NULL, 10); break;
 
 			case 'h': opts->help  = true; return true;// skip other arguments
 			case 'f': opts->force = true; break;
 			case 'z': opts->zero  = true; break;
+			case 'V': opts->vardir = true; break;
+			case 'g': opts->blocks_per_group = strtoul(optarg, NULL, 10); break;
+			case 'u': opts->stripe_unit = strtoul(optarg, NULL, 10); break;
+			case 'w': opts->stripe_units = strtoul(optarg, NULL, 10); break;
+			case 'T':
+			case 'C': {
+				size_t n = parse_size(optarg);
+				if (n == 0 || n % A1FS_BLOCK_SIZE != 0) {
+					fprintf(stderr, "Invalid size %s\n", optarg);
+					return false;
+				}
+				*(o == 'T' ? &opts->thin_size : &opts->thin_chunk) = n;
+				break;
+			}
 
 			case '?': return false;
 			default : assert(false);
@@ -90,6 +154,19 @@ static bool parse_args(int argc, char *argv[], mkfs_opts *opts)
 		fprintf(stderr, "Missing or invalid number of inodes\n");
 		return false;
 	}
+	if (opts->blocks_per_group % A1FS_GROUP_ALIGN != 0 || opts->blocks_per_group > UINT32_MAX) {
+		fprintf(stderr, "Invalid number of blocks per group\n");
+		return false;
+	}
+	if (opts->stripe_unit % A1FS_BLOCK_SIZE != 0 || opts->stripe_unit / A1FS_BLOCK_SIZE > UINT16_MAX
+	    || (opts->stripe_units != 0 && opts->stripe_unit == 0) || opts->stripe_units > UINT16_MAX) {
+		fprintf(stderr, "Invalid stripe unit or width\n");
+		return false;
+	}
+	if (opts->thin_chunk / A1FS_BLOCK_SIZE > UINT32_MAX) {
+		fprintf(stderr, "Invalid thin-provisioning chunk\n");
+		return false;
+	}
 	return true;
 }
 
@@ -113,6 +190,48 @@ int roundup(double n) {
 	}
 }
 
+/** Return the greatest common divisor of a and b. */
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+	while (b != 0) {
+		uint32_t r = a % b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
+
+/**
+ * Divide the data blocks and inodes into groups and fill in the group table.
+ * The inodes are spread evenly, a multiple of 64 per group, so the last groups
+ * may have fewer or none. The root directory (inode 0) is in the first group.
+ */
+static void init_groups(void *image, a1fs_superblock *superblock, uint32_t blocks_per_group)
+{
+	uint32_t num_groups = (uint32_t) roundup((double) superblock->available_blocks / blocks_per_group);
+	uint32_t inodes_per_group = (uint32_t) roundup((double) superblock->num_inodes / num_groups);
+	inodes_per_group = (uint32_t) roundup((double) inodes_per_group / A1FS_GROUP_ALIGN) * A1FS_GROUP_ALIGN;
+	superblock->num_groups = num_groups;
+	superblock->blocks_per_group = blocks_per_group;
+	superblock->inodes_per_group = inodes_per_group;
+
+	a1fs_group_desc *descs = (a1fs_group_desc *) ((char *) image + A1FS_BLOCK_SIZE);
+	for (uint32_t i = 0; i < num_groups; i++) {
+		uint32_t first_block = i * blocks_per_group;
+		uint32_t first_inode = i * inodes_per_group;
+		descs[i].free_blocks = superblock->available_blocks - first_block < blocks_per_group
+				? superblock->available_blocks - first_block : blocks_per_group;
+		descs[i].free_inodes = first_inode >= superblock->num_inodes ? 0
+				: superblock->num_inodes - first_inode < inodes_per_group
+				? superblock->num_inodes - first_inode : inodes_per_group;
+		descs[i].used_dirs = 0;
+		descs[i].padding = 0;
+	}
+	// the root directory
+	descs[0].free_inodes--;
+	descs[0].used_dirs = 1;
+}
+
 /**
  * Format the image into a1fs.
  *
@@ -132,10 +251,26 @@ static bool mkfs(void *image, size_t size, mkfs_opts *opts)
 	superblock->magic = A1FS_MAGIC;
 	superblock->size = size;
 	superblock->num_inodes = (uint32_t) opts->n_inodes;
+	superblock->features = opts->vardir ? A1FS_FEATURE_VARDIR : 0;
+	superblock->thin_chunk = 0;
+	if (opts->thin_size != 0) {
+		superblock->features |= A1FS_FEATURE_THIN;
+		superblock->thin_chunk = (uint32_t) (opts->thin_chunk / A1FS_BLOCK_SIZE);
+	}
 	superblock->available_inodes = superblock->num_inodes - 1;
 
+	// with allocation groups, the group table comes before the bitmaps; it is
+	// sized as if all the blocks were data blocks
+	superblock->group_table_length = 0;
+	if (opts->blocks_per_group != 0) {
+		uint32_t max_groups = (uint32_t) roundup((double) (size / A1FS_BLOCK_SIZE) / opts->blocks_per_group);
+		superblock->group_table_length = (uint32_t) roundup(
+				(double) max_groups / A1FS_GROUP_DESCS_PER_BLOCK);
+		superblock->features |= A1FS_FEATURE_GROUPS;
+	}
+
 	// set the address of inode_bitmap
-	superblock->inode_bitmap = (uint64_t) (image + A1FS_BLOCK_SIZE);
+	superblock->inode_bitmap = (uint64_t) (image + (1 + superblock->group_table_length) * A1FS_BLOCK_SIZE);
 	// set the corresponding bit of the root inode to 1
 	unsigned char *bm = (unsigned char *) superblock->inode_bitmap;
 	bm[0] |= 1;
@@ -147,8 +282,8 @@ static bool mkfs(void *image, size_t size, mkfs_opts *opts)
 	superblock->data_bitmap = superblock->inode_bitmap
 			+ superblock->inode_bitmap_length * A1FS_BLOCK_SIZE;
 
-	superblock->available_blocks = (uint32_t) size / A1FS_BLOCK_SIZE - 1
-			- superblock->inode_bitmap_length;
+	superblock->available_blocks = (uint32_t) (size / A1FS_BLOCK_SIZE) - 1
+			- superblock->group_table_length - superblock->inode_bitmap_length;
 	// compute the number of blocks the data bitmap takes
 	superblock->data_bitmap_length = (uint32_t) roundup(
 			(double) superblock->available_blocks / A1FS_BLOCK_SIZE);
@@ -162,17 +297,50 @@ static bool mkfs(void *image, size_t size, mkfs_opts *opts)
 
 	superblock->available_blocks -= superblock->data_bitmap_length;
 	superblock->available_blocks -= superblock->inode_table_length;
+
+	// on a striped device, the inode table takes up the rest of the stripe it
+	// ends in, so that the data blocks start on a full stripe
+	superblock->stripe_unit = 0;
+	superblock->stripe_width = 0;
+	if (opts->stripe_unit != 0) {
+		superblock->stripe_unit = (uint32_t) (opts->stripe_unit / A1FS_BLOCK_SIZE);
+		superblock->stripe_width = superblock->stripe_unit * (opts->stripe_units ? (uint32_t) opts->stripe_units : 1);
+		superblock->features |= A1FS_FEATURE_STRIPE;
+		uint32_t used = 1 + superblock->group_table_length + superblock->inode_bitmap_length
+				+ superblock->data_bitmap_length + superblock->inode_table_length;
+		uint32_t pad = (superblock->stripe_width - used % superblock->stripe_width) % superblock->stripe_width;
+		if (pad >= superblock->available_blocks) {
+			return false;
+		}
+		superblock->inode_table_length += pad;
+		superblock->available_blocks -= pad;
+	}
 //	superblock->reserved_inodes = 1;
 //	superblock->reserved_blocks = 1 + superblock->inode_bitmap_length
 //			+ superblock->data_bitmap_length + superblock->inode_table_length;
 
 	// ADDED: check if mkfs will succeed
-	uint32_t num_reserved_blocks = 1 + superblock->inode_bitmap_length
+	uint32_t num_reserved_blocks = 1 + superblock->group_table_length + superblock->inode_bitmap_length
 			+ superblock->data_bitmap_length + superblock->inode_table_length;
 	if (num_reserved_blocks * A1FS_BLOCK_SIZE >= size || superblock->available_blocks <= 0) {
 		return false;
 	}
 
+	if (opts->blocks_per_group != 0) {
+		// and so do the groups
+		uint32_t blocks_per_group = (uint32_t) opts->blocks_per_group;
+		if (superblock->stripe_width != 0) {
+			uint32_t align = A1FS_GROUP_ALIGN / gcd(A1FS_GROUP_ALIGN, superblock->stripe_width)
+					* superblock->stripe_width;
+			blocks_per_group = (uint32_t) roundup((double) blocks_per_group / align) * align;
+		}
+		init_groups(image, superblock, blocks_per_group);
+	} else {
+		superblock->num_groups = 1;
+		superblock->blocks_per_group = superblock->available_blocks;
+		superblock->inodes_per_group = superblock->num_inodes;
+	}
+
 	// NOTE: the mode of the root directory inode should be set to S_IFDIR | 0777
 	// ADDED: configure root directory inode
 	superblock->root_directory_inode = 0;
@@ -185,12 +353,44 @@ static bool mkfs(void *image, size_t size, mkfs_opts *opts)
 		exit(1);
 	}
 	root_inode.extent_num = 0;
+	root_inode.extent_blocks = 0;
 	root_inode.num_dir_entry = 0;
+	root_inode.dir_free_slot = 0;
+	root_inode.flags = 0;
     ((a1fs_inode *) superblock->inode_table)[0] = root_inode;
 	return true;
 }
 
 
+/**
+ * Create the file of a thin image, or empty the existing one, and extend it
+ * to the largest size of the image without writing anything. Refuse to
+ * overwrite a file system without -f.
+ */
+static bool create_thin_image(mkfs_opts *opts)
+{
+	int fd = open(opts->img_path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		perror(opts->img_path);
+		return false;
+	}
+	a1fs_superblock superblock;
+	if (!opts->force && pread(fd, &superblock, sizeof(superblock), 0) == sizeof(superblock)
+	    && a1fs_is_present(&superblock)) {
+		fprintf(stderr, "Image already contains a1fs; use -f to overwrite\n");
+		close(fd);
+		return false;
+	}
+	if (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t) opts->thin_size) != 0) {
+		perror(opts->img_path);
+		close(fd);
+		return false;
+	}
+	close(fd);
+	return true;
+}
+
+
 int main(int argc, char *argv[])
 {
 	mkfs_opts opts = {0};// defaults are all 0
@@ -205,6 +405,10 @@ int main(int argc, char *argv[])
 		return 0;
 	}
 
+	// A thin image file starts as a hole of the largest size, so that it is
+	// all zeros and only the blocks mkfs writes take space on the host
+	if (opts.thin_size != 0 && !create_thin_image(&opts)) return 1;
+
 	// Map image file into memory
 	size_t size;
 	void *image = map_file(opts.img_path, A1FS_BLOCK_SIZE, &size);
@@ -212,19 +416,30 @@ int main(int argc, char *argv[])
 
 	// Check if overwriting existing file system
 	int ret = 1;
+	uint64_t thin_end = size;
 	if (!opts.force && a1fs_is_present(image)) {
 		fprintf(stderr, "Image already contains a1fs; use -f to overwrite\n");
 		goto end;
 	}
 
-	if (opts.zero) memset(image, 0, size);
+	if (opts.zero && opts.thin_size == 0) memset(image, 0, size);
 	if (!mkfs(image, size, &opts)) {
 		fprintf(stderr, "Failed to format the image\n");
 		goto end;
 	}
 
 	ret = 0;
+	// and is then cut down to the metadata and the first chunk of data blocks
+	if (opts.thin_size != 0) {
+		a1fs_superblock *superblock = (a1fs_superblock *) image;
+		thin_end = superblock->inode_table - (uint64_t) image
+				+ (uint64_t) superblock->inode_table_length * A1FS_BLOCK_SIZE + opts.thin_chunk;
+	}
 end:
 	munmap(image, size);
+	if (thin_end < size && truncate(opts.img_path, (off_t) thin_end) != 0) {
+		perror(opts.img_path);
+		ret = 1;
+	}
 	return ret;
 }
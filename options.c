@@ -27,10 +27,19 @@
 // See fuse_opt.h in libfuse source code for details.
 
 #define A1FS_OPT(t, p) { t, offsetof(a1fs_opts, p), 1 }
+// An option with a value, e.g. "name=%u"
+#define A1FS_OPT_VAL(t, p) { t, offsetof(a1fs_opts, p), 0 }
 
 static const struct fuse_opt opt_spec[] = {
 	A1FS_OPT("-h"    , help),
 	A1FS_OPT("--help", help),
+	A1FS_OPT("best_fit", best_fit),
+	A1FS_OPT("delalloc", delalloc),
+	A1FS_OPT_VAL("prealloc_min=%u", prealloc_min),
+	A1FS_OPT_VAL("prealloc_max=%u", prealloc_max),
+	A1FS_OPT("noprealloc", noprealloc),
+	A1FS_OPT("discard", discard),
+	A1FS_OPT_VAL("discard_batch=%u", discard_batch),
 	FUSE_OPT_END
 };
 
@@ -44,6 +53,17 @@ general options:\n\
     -o opt,[opt...]        mount options\n\
     -h   --help            print help\n\
 \n\
+a1fs options:\n\
+    -o best_fit            allocate new extents best-fit instead of next-fit\n\
+    -o delalloc            buffer appended data and allocate it when flushed\n\
+    -o prealloc_min=N      blocks preallocated for the first appends to a file\n\
+                           (default: 16)\n\
+    -o prealloc_max=N      most blocks preallocated at a time (default: 1024)\n\
+    -o noprealloc          don't preallocate blocks for appends\n\
+    -o discard             punch holes in the image file for freed blocks\n\
+    -o discard_batch=N     blocks freed before holes are punched for them,\n\
+                           1 for every time (default: 2048)\n\
+\n\
 ";
 
 // Callback for fuse_opt_parse()
@@ -74,6 +94,11 @@ bool a1fs_opt_parse(struct fuse_args *args, a1fs_opts *opts)
 		return false;
 	}
 
+	// The image is only changed through this mount, so the kernel can keep
+	// the attributes and lookups it gets for a while, and use the inode
+	// numbers passed with them. Inserted first so that they can be overridden.
+	fuse_opt_insert_arg(args, 1, "-ouse_ino,attr_timeout=60,entry_timeout=60");
+
 	// Only single-threaded mount is supported
 	fuse_opt_add_arg(args, "-s");
 	// Limit the size of reads and writes to 4K
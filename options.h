@@ -29,6 +29,20 @@ typedef struct a1fs_opts {
 	const char *img_path;
 	/** Print help and exit. FUSE option. */
 	int help;
+	/** Allocate new extents from the smallest free extent that fits. */
+	int best_fit;
+	/** Buffer appended data, and allocate blocks for it only when flushed. */
+	int delalloc;
+	/** Blocks preallocated for the first appends to a file, 0 for default. */
+	unsigned int prealloc_min;
+	/** Most blocks preallocated for the appends to a file, 0 for default. */
+	unsigned int prealloc_max;
+	/** Don't preallocate blocks for appends. */
+	int noprealloc;
+	/** Give freed blocks back to the host file of the image. */
+	int discard;
+	/** Blocks freed before they are given back, 0 for default. */
+	unsigned int discard_batch;
 
 } a1fs_opts;
 
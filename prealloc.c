@@ -0,0 +1,78 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Speculative preallocation implementation.
+ */
+
+#include <stdlib.h>
+
+#include "prealloc.h"
+
+
+/** Number of entries in a new table. */
+#define PREALLOC_TABLE_INITIAL 16
+
+bool prealloc_init(prealloc_table *pt)
+{
+	pt->windows = malloc(PREALLOC_TABLE_INITIAL * sizeof(prealloc_window));
+	pt->num_windows = 0;
+	pt->capacity = PREALLOC_TABLE_INITIAL;
+	pt->blocks = 0;
+	return pt->windows != NULL;
+}
+
+void prealloc_destroy(prealloc_table *pt)
+{
+	free(pt->windows);
+	pt->windows = NULL;
+	pt->num_windows = 0;
+	pt->capacity = 0;
+	pt->blocks = 0;
+}
+
+prealloc_window *prealloc_find(prealloc_table *pt, a1fs_ino_t ino)
+{
+	// only the open files being appended to have windows, so there are few
+	for (uint32_t i = 0; i < pt->num_windows; i++) {
+		if (pt->windows[i].ino == ino) {
+			return &pt->windows[i];
+		}
+	}
+	return NULL;
+}
+
+prealloc_window *prealloc_add(prealloc_table *pt, a1fs_ino_t ino, uint32_t next)
+{
+	if (pt->num_windows == pt->capacity) {
+		prealloc_window *windows = realloc(pt->windows, 2 * pt->capacity * sizeof(prealloc_window));
+		if (windows == NULL) {
+			return NULL;
+		}
+		pt->windows = windows;
+		pt->capacity *= 2;
+	}
+	prealloc_window *w = &pt->windows[pt->num_windows++];
+	w->ino = ino;
+	w->start = 0;
+	w->count = 0;
+	w->next = next;
+	return w;
+}
+
+void prealloc_remove(prealloc_table *pt, prealloc_window *w)
+{
+	pt->blocks -= w->count;
+	*w = pt->windows[--pt->num_windows];
+}
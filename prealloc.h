@@ -0,0 +1,88 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Speculative preallocation header file.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "a1fs.h"
+
+
+/** Blocks in the first window of a file, unless set by a mount option. */
+#define PREALLOC_MIN_DEFAULT 16
+
+/** Most blocks in a window, unless set by a mount option. */
+#define PREALLOC_MAX_DEFAULT 1024
+
+/**
+ * Free blocks taken for a file that is being appended to, ahead of the writes
+ * that will need them. They don't belong to the file yet: the file takes them
+ * as it grows, and the rest are freed when it is closed.
+ */
+typedef struct prealloc_window {
+	/** Inode number of the file. */
+	a1fs_ino_t ino;
+	/** First block of the window that the file has not taken yet. */
+	uint32_t start;
+	/** Number of blocks left in the window. */
+	uint32_t count;
+	/** Number of blocks to take for the next window. */
+	uint32_t next;
+
+} prealloc_window;
+
+/** The windows of the files being appended to. */
+typedef struct prealloc_table {
+	prealloc_window *windows;
+	uint32_t num_windows;
+	uint32_t capacity;
+	/** Number of blocks left in all windows. */
+	uint32_t blocks;
+
+} prealloc_table;
+
+/**
+ * Initialize an empty table.
+ *
+ * @return  true on success; false if out of memory.
+ */
+bool prealloc_init(prealloc_table *pt);
+
+/**
+ * Free all memory used by the table. The blocks of the windows are left for
+ * the caller to free.
+ */
+void prealloc_destroy(prealloc_table *pt);
+
+/** Return the window of a file, or NULL if it has none. */
+prealloc_window *prealloc_find(prealloc_table *pt, a1fs_ino_t ino);
+
+/**
+ * Add an empty window for a file, the first next blocks of which are to be
+ * taken. The pointers returned before for other files may no longer be valid.
+ *
+ * @return  the new window; NULL if out of memory.
+ */
+prealloc_window *prealloc_add(prealloc_table *pt, a1fs_ino_t ino, uint32_t next);
+
+/**
+ * Remove the window of a file, without freeing its blocks. The last window of
+ * the table takes the place of the removed one.
+ */
+void prealloc_remove(prealloc_table *pt, prealloc_window *w);
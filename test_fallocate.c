@@ -0,0 +1,323 @@
+//
+// Checks of fallocate() on a mounted a1fs, for each mode it takes or rejects.
+//
+// Usage: ./test_fallocate <directory>
+//
+// Runs each case on a new file in the directory, which must be on a1fs, and
+// prints the checks that fail; exits with 1 if any did. The cases: the modes
+// a1fs rejects; the default mode on an empty file, on an inline file (one
+// small enough to be kept in its inode) and over the hole of a holed file;
+// FALLOC_FL_KEEP_SIZE past the end of a file; FALLOC_FL_PUNCH_HOLE on inline
+// and empty files, over whole blocks, inside one block (also from its start),
+// across block boundaries, past the end and in the middle of preallocated
+// blocks; 1000 holes, so that the extent tree of the file needs blocks of its
+// own, filled again with the default mode; and a range larger than the free
+// space, which must fail with ENOSPC without taking any blocks. The size and
+// the number of blocks (st_blocks) are checked along with the contents.
+//
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/falloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+#define BLOCK 4096
+#define PUNCH (FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE)
+
+static const char *dir;
+static const char *test_name;
+static int failures;
+
+static void check(int ok, const char *what) {
+    if (!ok) {
+        printf("FAIL %s: %s\n", test_name, what);
+        failures++;
+    }
+}
+
+// Start a case on a new empty file.
+static int new_file(const char *name) {
+    char path[4096 + 32];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    test_name = name;
+    int fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if (fd == -1) {
+        perror(path);
+        exit(1);
+    }
+    return fd;
+}
+
+// End a case, deleting its file.
+static void end_file(int fd, const char *name) {
+    char path[4096 + 32];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    close(fd);
+    unlink(path);
+}
+
+static void fill(int fd, off_t off, size_t len, char c) {
+    char buf[BLOCK];
+    memset(buf, c, sizeof(buf));
+    while (len > 0) {
+        size_t n = len < sizeof(buf) ? len : sizeof(buf);
+        if (pwrite(fd, buf, n, off) != (ssize_t) n) {
+            perror("pwrite");
+            exit(1);
+        }
+        off += n;
+        len -= n;
+    }
+}
+
+// Whether the bytes [off, off + len) of the file are all c.
+static int all(int fd, off_t off, size_t len, char c) {
+    char buf[BLOCK];
+    while (len > 0) {
+        size_t n = len < sizeof(buf) ? len : sizeof(buf);
+        if (pread(fd, buf, n, off) != (ssize_t) n) {
+            return 0;
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (buf[i] != c) {
+                return 0;
+            }
+        }
+        off += n;
+        len -= n;
+    }
+    return 1;
+}
+
+static off_t size_of(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 ? st.st_size : -1;
+}
+
+// The number of blocks the file takes, from st_blocks.
+static long blocks_of(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 ? (long) (st.st_blocks / (BLOCK / 512)) : -1;
+}
+
+static void test_rejected(void) {
+    int fd = new_file("rejected");
+    fill(fd, 0, 2 * BLOCK, 'a');
+    int modes[] = {FALLOC_FL_PUNCH_HOLE, FALLOC_FL_ZERO_RANGE, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE,
+                   FALLOC_FL_COLLAPSE_RANGE, FALLOC_FL_INSERT_RANGE};
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        errno = 0;
+        check(fallocate(fd, modes[i], 0, BLOCK) == -1 && errno == EOPNOTSUPP, "mode not rejected with EOPNOTSUPP");
+    }
+    errno = 0;
+    check(fallocate(fd, 0, 0, 0) == -1 && errno == EINVAL, "empty range not rejected with EINVAL");
+    check(size_of(fd) == 2 * BLOCK && blocks_of(fd) == 2, "size or blocks changed");
+    check(all(fd, 0, 2 * BLOCK, 'a'), "data changed");
+    end_file(fd, "rejected");
+}
+
+static void test_empty(void) {
+    int fd = new_file("empty");
+    check(fallocate(fd, 0, 0, 3 * BLOCK + 100) == 0, "fallocate failed");
+    check(size_of(fd) == 3 * BLOCK + 100, "size not extended");
+    check(blocks_of(fd) == 4, "blocks not allocated");
+    check(all(fd, 0, 3 * BLOCK + 100, 0), "allocated blocks not zeros");
+    end_file(fd, "empty");
+
+    // from an offset, only the blocks of the range are allocated
+    fd = new_file("empty-offset");
+    check(fallocate(fd, 0, 2 * BLOCK, BLOCK) == 0, "fallocate failed");
+    check(size_of(fd) == 3 * BLOCK && blocks_of(fd) == 1, "wrong size or blocks");
+    check(all(fd, 0, 3 * BLOCK, 0), "not zeros");
+    end_file(fd, "empty-offset");
+}
+
+static void test_inline(void) {
+    int fd = new_file("inline");
+    fill(fd, 0, 50, 'a');
+    check(blocks_of(fd) == 0, "small file not inline");
+    // still small enough for the inode
+    check(fallocate(fd, 0, 0, 100) == 0, "fallocate failed");
+    check(size_of(fd) == 100 && blocks_of(fd) == 0, "wrong size or blocks within the inode");
+    check(all(fd, 0, 50, 'a') && all(fd, 50, 50, 0), "wrong data within the inode");
+    // too large for it, the data moves to the first block
+    check(fallocate(fd, 0, 0, 10000) == 0, "fallocate failed");
+    check(size_of(fd) == 10000 && blocks_of(fd) == 3, "wrong size or blocks after leaving the inode");
+    check(all(fd, 0, 50, 'a') && all(fd, 50, 10000 - 50, 0), "wrong data after leaving the inode");
+    end_file(fd, "inline");
+}
+
+static void test_holed(void) {
+    int fd = new_file("holed");
+    fill(fd, 0, BLOCK, 'a');
+    fill(fd, 10 * BLOCK, BLOCK, 'b');
+    check(blocks_of(fd) == 2, "hole allocated");
+    check(fallocate(fd, 0, BLOCK, 9 * BLOCK) == 0, "fallocate failed");
+    check(size_of(fd) == 11 * BLOCK && blocks_of(fd) == 11, "wrong size or blocks");
+    check(all(fd, 0, BLOCK, 'a') && all(fd, BLOCK, 9 * BLOCK, 0) && all(fd, 10 * BLOCK, BLOCK, 'b'),
+          "wrong data");
+    // written in the middle of the allocated blocks
+    fill(fd, 5 * BLOCK + 10, 100, 'c');
+    check(blocks_of(fd) == 11, "blocks changed by a write into them");
+    check(all(fd, BLOCK, 4 * BLOCK + 10, 0) && all(fd, 5 * BLOCK + 10, 100, 'c')
+          && all(fd, 5 * BLOCK + 110, 5 * BLOCK - 110, 0) && all(fd, 10 * BLOCK, BLOCK, 'b'),
+          "wrong data after a write");
+    end_file(fd, "holed");
+}
+
+static void test_keep_size(void) {
+    int fd = new_file("keep-size");
+    check(fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, 4 * BLOCK) == 0, "fallocate failed");
+    check(size_of(fd) == 0 && blocks_of(fd) == 4, "wrong size or blocks of an empty file");
+    end_file(fd, "keep-size");
+
+    // past the end of an inline file
+    fd = new_file("keep-size-past-end");
+    fill(fd, 0, 100, 'a');
+    check(fallocate(fd, FALLOC_FL_KEEP_SIZE, 2 * BLOCK, 2 * BLOCK) == 0, "fallocate failed");
+    check(size_of(fd) == 100, "size changed");
+    check(blocks_of(fd) == 3, "blocks past the end not allocated");
+    check(all(fd, 0, 100, 'a'), "data changed");
+    char c;
+    check(pread(fd, &c, 1, 100) == 0, "read past the end");
+    // a write into them extends the file, leaving the block between a hole
+    fill(fd, 9000, 10, 'b');
+    check(size_of(fd) == 9010 && blocks_of(fd) == 3, "wrong size or blocks after a write");
+    check(all(fd, 0, 100, 'a') && all(fd, 100, 9000 - 100, 0) && all(fd, 9000, 10, 'b'), "wrong data after a write");
+    end_file(fd, "keep-size-past-end");
+}
+
+static void test_punch(void) {
+    int fd = new_file("punch-empty");
+    check(fallocate(fd, PUNCH, 0, BLOCK) == 0, "punch failed");
+    check(size_of(fd) == 0 && blocks_of(fd) == 0, "wrong size or blocks");
+    end_file(fd, "punch-empty");
+
+    fd = new_file("punch-inline");
+    fill(fd, 0, 150, 'a');
+    check(fallocate(fd, PUNCH, 20, 30) == 0, "punch failed");
+    check(size_of(fd) == 150 && blocks_of(fd) == 0, "wrong size or blocks");
+    check(all(fd, 0, 20, 'a') && all(fd, 20, 30, 0) && all(fd, 50, 100, 'a'), "wrong data");
+    end_file(fd, "punch-inline");
+
+    fd = new_file("punch");
+    fill(fd, 0, 16 * BLOCK, 'a');
+    // whole blocks are freed
+    check(fallocate(fd, PUNCH, 4 * BLOCK, 4 * BLOCK) == 0, "punch failed");
+    check(size_of(fd) == 16 * BLOCK && blocks_of(fd) == 12, "whole blocks: wrong size or blocks");
+    check(all(fd, 0, 4 * BLOCK, 'a') && all(fd, 4 * BLOCK, 4 * BLOCK, 0) && all(fd, 8 * BLOCK, 8 * BLOCK, 'a'),
+          "whole blocks: wrong data");
+    // inside one block, it is only zeroed
+    check(fallocate(fd, PUNCH, 100, 200) == 0, "punch failed");
+    check(blocks_of(fd) == 12, "inside a block: blocks changed");
+    check(all(fd, 0, 100, 'a') && all(fd, 100, 200, 0) && all(fd, 300, BLOCK - 300, 'a'),
+          "inside a block: wrong data");
+    // from the start of a block to inside it, the same
+    check(fallocate(fd, PUNCH, 2 * BLOCK, 100) == 0, "punch failed");
+    check(blocks_of(fd) == 12, "start of a block: blocks changed");
+    check(all(fd, BLOCK, BLOCK, 'a') && all(fd, 2 * BLOCK, 100, 0) && all(fd, 2 * BLOCK + 100, 2 * BLOCK - 100, 'a'),
+          "start of a block: wrong data");
+    // across block boundaries, the one whole block is freed
+    check(fallocate(fd, PUNCH, 10 * BLOCK + 1000, 2 * BLOCK) == 0, "punch failed");
+    check(blocks_of(fd) == 11, "across blocks: wrong blocks");
+    check(all(fd, 8 * BLOCK, 2 * BLOCK + 1000, 'a') && all(fd, 10 * BLOCK + 1000, 2 * BLOCK, 0)
+          && all(fd, 12 * BLOCK + 1000, 4 * BLOCK - 1000, 'a'), "across blocks: wrong data");
+    // past the end, only the part in the file is zeroed
+    check(fallocate(fd, PUNCH, 16 * BLOCK - 100, 2 * BLOCK) == 0, "punch failed");
+    check(size_of(fd) == 16 * BLOCK && blocks_of(fd) == 11, "past the end: wrong size or blocks");
+    check(all(fd, 12 * BLOCK + 1000, 4 * BLOCK - 1100, 'a') && all(fd, 16 * BLOCK - 100, 100, 0),
+          "past the end: wrong data");
+    // all of it
+    check(fallocate(fd, PUNCH, 0, 16 * BLOCK) == 0, "punch failed");
+    check(size_of(fd) == 16 * BLOCK && blocks_of(fd) == 0, "all: wrong size or blocks");
+    check(all(fd, 0, 16 * BLOCK, 0), "all: not zeros");
+    end_file(fd, "punch");
+
+    // in the middle of preallocated blocks, which are split around the hole
+    fd = new_file("punch-preallocated");
+    check(fallocate(fd, 0, 0, 16 * BLOCK) == 0, "fallocate failed");
+    check(fallocate(fd, PUNCH, 4 * BLOCK, 2 * BLOCK) == 0, "punch failed");
+    check(size_of(fd) == 16 * BLOCK && blocks_of(fd) == 14, "wrong size or blocks");
+    fill(fd, 3 * BLOCK, BLOCK, 'a');
+    fill(fd, 6 * BLOCK, BLOCK, 'b');
+    fill(fd, 10 * BLOCK, 10, 'c');
+    check(blocks_of(fd) == 14, "blocks changed by writes into them");
+    check(all(fd, 0, 3 * BLOCK, 0) && all(fd, 3 * BLOCK, BLOCK, 'a') && all(fd, 4 * BLOCK, 2 * BLOCK, 0)
+          && all(fd, 6 * BLOCK, BLOCK, 'b') && all(fd, 7 * BLOCK, 3 * BLOCK, 0) && all(fd, 10 * BLOCK, 10, 'c')
+          && all(fd, 10 * BLOCK + 10, 6 * BLOCK - 10, 0), "wrong data");
+    end_file(fd, "punch-preallocated");
+}
+
+static void test_many_holes(void) {
+    int fd = new_file("many-holes");
+    fill(fd, 0, 2000 * BLOCK, 'a');
+    for (off_t b = 1; b < 2000; b += 2) {
+        check(fallocate(fd, PUNCH, b * BLOCK, BLOCK) == 0, "punch failed");
+    }
+    // the 1000 extents that are left don't fit in the inode
+    long blocks = blocks_of(fd);
+    check(blocks > 1000 && blocks < 1100, "wrong blocks with holes");
+    int data_ok = 1;
+    for (off_t b = 0; b < 2000; b++) {
+        data_ok = data_ok && all(fd, b * BLOCK, BLOCK, b % 2 == 0 ? 'a' : 0);
+    }
+    check(data_ok, "wrong data with holes");
+
+    check(fallocate(fd, 0, 0, 2000 * BLOCK) == 0, "fallocate failed");
+    blocks = blocks_of(fd);
+    check(size_of(fd) == 2000 * BLOCK && blocks >= 2000 && blocks < 2100, "wrong size or blocks after filling");
+    for (off_t b = 1; b < 2000; b += 2) {
+        fill(fd, b * BLOCK, BLOCK, 'b');
+    }
+    data_ok = 1;
+    for (off_t b = 0; b < 2000; b++) {
+        data_ok = data_ok && all(fd, b * BLOCK, BLOCK, b % 2 == 0 ? 'a' : 'b');
+    }
+    check(data_ok, "wrong data after filling");
+    check(fallocate(fd, PUNCH, 0, 2000 * BLOCK) == 0, "punch failed");
+    check(blocks_of(fd) == 0, "blocks left after punching all");
+    end_file(fd, "many-holes");
+}
+
+static void test_enospc(void) {
+    int fd = new_file("enospc");
+    struct statvfs before, after;
+    if (statvfs(dir, &before) != 0) {
+        perror(dir);
+        exit(1);
+    }
+    errno = 0;
+    check(fallocate(fd, 0, 0, (off_t) (before.f_bfree + 16) * BLOCK) == -1 && errno == ENOSPC,
+          "range larger than the free space not rejected with ENOSPC");
+    check(size_of(fd) == 0 && blocks_of(fd) == 0, "size or blocks changed");
+    check(statvfs(dir, &after) == 0 && after.f_bfree == before.f_bfree, "free blocks changed");
+    end_file(fd, "enospc");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <directory>\n", argv[0]);
+        return 1;
+    }
+    dir = argv[1];
+    test_rejected();
+    test_empty();
+    test_inline();
+    test_holed();
+    test_keep_size();
+    test_punch();
+    test_many_holes();
+    test_enospc();
+    if (failures > 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
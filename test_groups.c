@@ -0,0 +1,343 @@
+//
+// Checks of the allocation groups of an a1fs image, through the file system.
+//
+// Usage: gcc -O2 $(pkg-config fuse --cflags) test_groups.c fs_ctx.c dir_index.c vardir.c
+//            extent_tree.c handle.c dcache.c delalloc.c prealloc.c bitmap.c free_extents.c
+//            group.c discard.c -pthread -o test_groups
+//        ./test_groups <directory> <image>
+//        ./test_groups <image>
+//
+// With a directory, which must be the root of the image mounted without
+// -o delalloc (the mounted file system keeps the image mapped shared, so the
+// image seen here has its current contents): makes 8 directories with 8
+// one-block files each, then fills the image with one more file until a write
+// fails with ENOSPC, reads it back, and deletes everything again. The image is
+// checked at the start, after the small files, when full and at the end:
+//
+// - each group's free block and inode counts against its bitmaps, and the
+//   totals in the superblock against the groups;
+// - each group's directory count against the directories in it;
+// - every block of every file is marked in use and belongs to no other file;
+// - with a stripe (-u), each group starts on a full stripe of the device.
+//
+// The small files must have their inodes in the group of their directory,
+// after the directory's inode, and their blocks in the same group. The blocks
+// of the directories must be in the metadata areas of their groups and those
+// of the files in the small file areas, as the areas are at mount. The file
+// that fills the image must have blocks in every group (it spills over from
+// its own), and at the end every group must have the free blocks, inodes and
+// directory count it had at the start.
+//
+// With the image alone, which must not be mounted, only checks the image: run
+// it after unmounting to check the counts that are kept across a remount.
+// Prints the checks that fail; exits with 1 if any did.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fs_ctx.h"
+#include "extent_tree.h"
+
+#define BLOCK 4096
+#define DIRS 8
+#define FILES 8
+#define CHUNK 16
+
+static const char *image_path;
+static void *image;
+static size_t image_size;
+static fs_ctx fs;
+static int failures;
+
+static void check(int ok, const char *when, const char *what) {
+    if (!ok) {
+        printf("FAIL %s: %s\n", when, what);
+        failures++;
+    }
+}
+
+// Map the image as it is now.
+static void open_image(void) {
+    int fd = open(image_path, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        perror(image_path);
+        exit(1);
+    }
+    image_size = (size_t) st.st_size;
+    image = mmap(NULL, image_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED || !fs_ctx_init(&fs, image, image_size)) {
+        fprintf(stderr, "%s: can't map the image\n", image_path);
+        exit(1);
+    }
+}
+
+static void close_image(void) {
+    fs_ctx_destroy(&fs);
+    munmap(image, image_size);
+}
+
+static alloc_group *group_of_block(uint32_t block) {
+    return &fs.groups[block / fs.blocks_per_group];
+}
+
+static alloc_group *group_of_inode(uint32_t ino) {
+    return &fs.groups[ino / fs.inodes_per_group];
+}
+
+static int inode_in_use(uint32_t ino) {
+    alloc_group *g = group_of_inode(ino);
+    return is_bit_set(ino - g->first_inode, &g->inode_bitmap);
+}
+
+// Check the counts and the blocks of the mapped image.
+static void check_image(const char *when) {
+    uint64_t free_blocks = 0, free_inodes = 0;
+    for (uint32_t i = 0; i < fs.num_groups; i++) {
+        alloc_group *g = &fs.groups[i];
+        uint32_t blocks = bitmap_count_free(&g->data_bitmap, 0, g->data_bitmap.size);
+        uint32_t inodes = g->inode_bitmap.size > 0 ? bitmap_count_free(&g->inode_bitmap, 0, g->inode_bitmap.size) : 0;
+        check(blocks == *g->data_bitmap.available, when, "free blocks of a group don't match its bitmap");
+        check(inodes == *g->inode_bitmap.available, when, "free inodes of a group don't match its bitmap");
+        free_blocks += *g->data_bitmap.available;
+        free_inodes += *g->inode_bitmap.available;
+        if (g->stripe_width > 0) {
+            uint64_t start = (get_addr_of_block(&fs, g->first_block) - (uint64_t) image) / BLOCK;
+            check(start % g->stripe_width == 0, when, "group not on a full stripe");
+        }
+    }
+    check(free_blocks == *fs.available_blocks, when, "free blocks of the groups don't add up to the total");
+    check(free_inodes == *fs.available_inodes, when, "free inodes of the groups don't add up to the total");
+
+    uint32_t *dirs = calloc(fs.num_groups, sizeof(uint32_t));
+    uint32_t *owner = malloc(fs.num_of_data_blocks * sizeof(uint32_t));
+    memset(owner, 0xff, fs.num_of_data_blocks * sizeof(uint32_t));
+    int shared = 0, unmarked = 0;
+    for (uint32_t ino = 0; ino < fs.num_inodes; ino++) {
+        if (!inode_in_use(ino)) {
+            continue;
+        }
+        a1fs_inode *inode = &fs.inode_table[ino];
+        if (S_ISDIR(inode->mode)) {
+            dirs[ino / fs.inodes_per_group]++;
+        }
+        a1fs_extent extent;
+        for (uint32_t block = 0; inode->extent_num > 0 && extent_find(&fs, inode, block, &extent);
+             block = extent.logical + extent.count) {
+            for (uint32_t b = extent.start; b < extent.start + extent.count; b++) {
+                alloc_group *g = group_of_block(b);
+                unmarked += !is_bit_set(b - g->first_block, &g->data_bitmap);
+                shared += owner[b] != UINT32_MAX;
+                owner[b] = ino;
+            }
+        }
+    }
+    check(unmarked == 0, when, "blocks of files are free in the bitmap");
+    check(shared == 0, when, "blocks belong to more than one file");
+    for (uint32_t i = 0; i < fs.num_groups; i++) {
+        if (fs.groups[i].used_dirs != NULL) {
+            check(dirs[i] == *fs.groups[i].used_dirs, when, "directory count of a group is wrong");
+        }
+    }
+    free(owner);
+    free(dirs);
+}
+
+// Check the image as it is now, and keep each group's counts in saved.
+static void check_now(const char *when, uint32_t *saved) {
+    open_image();
+    check_image(when);
+    for (uint32_t i = 0; saved != NULL && i < fs.num_groups; i++) {
+        alloc_group *g = &fs.groups[i];
+        saved[3 * i] = *g->data_bitmap.available;
+        saved[3 * i + 1] = *g->inode_bitmap.available;
+        saved[3 * i + 2] = g->used_dirs != NULL ? *g->used_dirs : 0;
+    }
+    close_image();
+}
+
+static int lookup(const char *name, int parent) {
+    return parent < 0 ? -1 : find_dentry(&fs, (uint32_t) parent, name);
+}
+
+// Whether a block is in the area of the given class in its group, as the
+// areas are at mount.
+static int in_area(uint32_t block, alloc_class cls) {
+    alloc_group *g = group_of_block(block);
+    uint32_t local = block - g->first_block;
+    return local >= (cls == ALLOC_META ? 0 : g->area_end[cls - 1]) && local < g->area_end[cls];
+}
+
+// The small files are in the groups of their directories, after them, with
+// their blocks; the blocks of the directories are in the metadata areas, those
+// of the files in the small file areas.
+static void check_small_files(void) {
+    open_image();
+    char name[32];
+    int misplaced_inodes = 0, misplaced_blocks = 0, before_dir = 0, out_of_area = 0;
+    for (int d = 0; d < DIRS; d++) {
+        snprintf(name, sizeof(name), "g%d", d);
+        int dir = lookup(name, ROOT_INODE);
+        a1fs_extent extent;
+        if (dir < 0 || !extent_find(&fs, &fs.inode_table[dir], 0, &extent)) {
+            check(0, "small files", "directory or its block not found");
+            continue;
+        }
+        out_of_area += !in_area(extent.start, ALLOC_META);
+        for (int f = 0; f < FILES; f++) {
+            snprintf(name, sizeof(name), "f%d", f);
+            int ino = lookup(name, dir);
+            if (ino < 0 || !extent_find(&fs, &fs.inode_table[ino], 0, &extent)) {
+                check(0, "small files", "file or its block not found");
+                continue;
+            }
+            misplaced_inodes += group_of_inode((uint32_t) ino) != group_of_inode((uint32_t) dir);
+            misplaced_blocks += group_of_block(extent.start) != group_of_inode((uint32_t) ino);
+            before_dir += ino < dir;
+            out_of_area += !in_area(extent.start, ALLOC_SMALL);
+        }
+    }
+    check(misplaced_inodes == 0, "small files", "inodes not in the group of their directory");
+    check(misplaced_blocks == 0, "small files", "blocks not in the group of their inode");
+    check(before_dir == 0, "small files", "inodes before the inode of their directory");
+    check(out_of_area == 0, "small files", "blocks not in the area of their class");
+    close_image();
+}
+
+// The file that filled the image has blocks in every group.
+static void check_spill(void) {
+    open_image();
+    int ino = lookup("fill", lookup("g0", ROOT_INODE));
+    check(ino >= 0, "full", "fill file not found");
+    char *used = calloc(fs.num_groups, 1);
+    a1fs_extent extent;
+    for (uint32_t block = 0; ino >= 0 && extent_find(&fs, &fs.inode_table[ino], block, &extent);
+         block = extent.logical + extent.count) {
+        for (uint32_t b = extent.start; b < extent.start + extent.count; b++) {
+            used[b / fs.blocks_per_group] = 1;
+        }
+    }
+    int missed = 0;
+    for (uint32_t i = 0; i < fs.num_groups; i++) {
+        missed += !used[i];
+    }
+    check(missed == 0, "full", "the file that filled the image has no blocks in some groups");
+    free(used);
+    close_image();
+}
+
+static void fill_chunk(char *buf, off_t chunk) {
+    for (int b = 0; b < CHUNK; b++) {
+        memset(buf + b * BLOCK, (int) ((chunk * CHUNK + b) % 251), BLOCK);
+    }
+}
+
+// Write a file until the image is full, then read it back.
+static void fill(const char *dir) {
+    char path[4096 + 32];
+    snprintf(path, sizeof(path), "%s/g0/fill", dir);
+    int fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if (fd == -1) {
+        perror(path);
+        exit(1);
+    }
+    static char buf[CHUNK * BLOCK], back[CHUNK * BLOCK];
+    off_t size = 0;
+    for (;;) {
+        fill_chunk(buf, size / sizeof(buf));
+        ssize_t n = pwrite(fd, buf + size % sizeof(buf), sizeof(buf) - size % sizeof(buf), size);
+        if (n == -1) {
+            check(errno == ENOSPC, "full", "write failed with something other than ENOSPC");
+            break;
+        }
+        size += n;
+    }
+    check(size > 0, "full", "nothing written");
+    for (off_t off = 0; off < size; off += sizeof(buf)) {
+        size_t len = size - off < (off_t) sizeof(buf) ? (size_t) (size - off) : sizeof(buf);
+        fill_chunk(buf, off / sizeof(buf));
+        if (pread(fd, back, len, off) != (ssize_t) len || memcmp(buf, back, len) != 0) {
+            check(0, "full", "data read back is wrong");
+            break;
+        }
+    }
+    close(fd);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage: %s <directory> <image>\n       %s <image>\n", argv[0], argv[0]);
+        return 1;
+    }
+    if (argc == 2) {
+        image_path = argv[1];
+        check_now("image", NULL);
+    } else {
+        const char *dir = argv[1];
+        image_path = argv[2];
+        open_image();
+        uint32_t num_groups = fs.num_groups;
+        close_image();
+        uint32_t *start = malloc(3 * num_groups * sizeof(uint32_t));
+        uint32_t *end = malloc(3 * num_groups * sizeof(uint32_t));
+        check_now("start", start);
+
+        char path[4096 + 64], buf[BLOCK];
+        memset(buf, 'x', BLOCK);
+        for (int d = 0; d < DIRS; d++) {
+            snprintf(path, sizeof(path), "%s/g%d", dir, d);
+            if (mkdir(path, 0755) != 0) {
+                perror(path);
+                return 1;
+            }
+            for (int f = 0; f < FILES; f++) {
+                snprintf(path, sizeof(path), "%s/g%d/f%d", dir, d, f);
+                int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+                if (fd == -1 || write(fd, buf, BLOCK) != BLOCK) {
+                    perror(path);
+                    return 1;
+                }
+                close(fd);
+            }
+        }
+        check_now("small files", NULL);
+        check_small_files();
+
+        fill(dir);
+        check_now("full", NULL);
+        check_spill();
+
+        snprintf(path, sizeof(path), "%s/g0/fill", dir);
+        unlink(path);
+        for (int d = 0; d < DIRS; d++) {
+            for (int f = 0; f < FILES; f++) {
+                snprintf(path, sizeof(path), "%s/g%d/f%d", dir, d, f);
+                unlink(path);
+            }
+            snprintf(path, sizeof(path), "%s/g%d", dir, d);
+            if (rmdir(path) != 0) {
+                perror(path);
+                return 1;
+            }
+        }
+        check_now("end", end);
+        check(memcmp(start, end, 3 * num_groups * sizeof(uint32_t)) == 0, "end",
+              "groups don't have the free blocks, inodes and directory counts they had at the start");
+        free(start);
+        free(end);
+    }
+    if (failures > 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,37 @@
+#!/usr/bin/env bash
+#
+# Run test_groups on 64 MiB images with 1, 4, 16 and 255 allocation groups
+# (no -g, then -g 4096, 1024 and 64), and with 4 groups on a stripe of 4 units
+# of 64 KiB: on the mounted image, on the unmounted image, then again after
+# mounting it a second time.
+#
+# Usage: ./test_groups.sh <mount point>
+#
+
+if [ $# -ne 1 ]; then
+    echo "Usage: $0 <mount point>"
+    exit 1
+fi
+mnt=$1
+img=test_groups.img
+status=0
+
+for groups in "" "-g 4096" "-g 1024" "-g 64" "-g 4096 -u 65536 -w 4"; do
+    echo "== mkfs.a1fs -i 1024 $groups"
+    rm -f $img
+    truncate -s 64M $img
+    ./mkfs.a1fs -i 1024 -f -z $groups $img || exit 1
+
+    ./a1fs $img $mnt || exit 1
+    ./test_groups $mnt $img || status=1
+    fusermount -u $mnt
+    ./test_groups $img || status=1
+
+    ./a1fs $img $mnt || exit 1
+    ./test_groups $mnt $img || status=1
+    fusermount -u $mnt
+    ./test_groups $img || status=1
+done
+
+rm -f $img
+exit $status
@@ -0,0 +1,251 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Variable length directory entries implementation.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "extent_tree.h"
+#include "vardir.h"
+
+
+/** Return the record at the given offset of a directory block. */
+static a1fs_dirent *dirent_at(char *block, uint32_t offset)
+{
+	return (a1fs_dirent *) (block + offset);
+}
+
+/** Return the number of bytes of a record that hold its entry (0 if unused). */
+static uint32_t dirent_used(a1fs_dirent *dirent)
+{
+	return dirent->name_len == 0 ? 0 : A1FS_DIRENT_SIZE(dirent->name_len);
+}
+
+/** Call fn for every record of a block (or of an inline area) of the given size. */
+static int vardir_iterate_block(char *block, uint32_t block_size, uint32_t block_pos,
+                                uint32_t start, dentry_fn fn, void *arg)
+{
+	for (uint32_t offset = 0; offset < block_size; offset += dirent_at(block, offset)->rec_len) {
+		a1fs_dirent *dirent = dirent_at(block, offset);
+		if (dirent->name_len == 0 || block_pos + offset < start) {
+			continue;
+		}
+		int ret = fn(arg, dirent->ino, dirent->name, block_pos + offset,
+		             block_pos + offset + dirent->rec_len);
+		if (ret != 0) {
+			return ret;
+		}
+	}
+	return 0;
+}
+
+int vardir_iterate(fs_ctx *fs, uint32_t dir_inode_num, uint32_t start, dentry_fn fn, void *arg)
+{
+	a1fs_inode *dir = &fs->inode_table[dir_inode_num];
+	if (dir->flags & A1FS_INODE_INLINE_DATA) {
+		return vardir_iterate_block(dir->inline_data, A1FS_INLINE_DATA_SIZE, 0, start, fn, arg);
+	}
+
+	a1fs_extent extent;
+	for (uint32_t block = 0; extent_find(fs, dir, block, &extent); block = extent.logical + extent.count) {
+		for (uint32_t j = 0; j < extent.count; j++) {
+			uint32_t block_pos = (extent.logical + j) * A1FS_BLOCK_SIZE;
+			if (block_pos + A1FS_BLOCK_SIZE <= start) {
+				continue;
+			}
+			int ret = vardir_iterate_block((char *) get_addr_of_block(fs, extent.start + j),
+			                               A1FS_BLOCK_SIZE, block_pos, start, fn, arg);
+			if (ret != 0) {
+				return ret;
+			}
+		}
+	}
+	return 0;
+}
+
+a1fs_dirent *vardir_get(fs_ctx *fs, uint32_t dir_inode_num, uint32_t slot)
+{
+	a1fs_inode *dir = &fs->inode_table[dir_inode_num];
+	if (dir->flags & A1FS_INODE_INLINE_DATA) {
+		return dirent_at(dir->inline_data, slot);
+	}
+	char *block = (char *) get_addr_of_file_block(fs, dir_inode_num, slot / A1FS_BLOCK_SIZE);
+	return dirent_at(block, slot % A1FS_BLOCK_SIZE);
+}
+
+/** Make a block (or an inline area) a single unused record. */
+static void vardir_init_block(char *block, uint32_t block_size)
+{
+	dirent_at(block, 0)->rec_len = (uint16_t) block_size;
+	dirent_at(block, 0)->name_len = 0;
+}
+
+/**
+ * Put an entry into the free space of a block (or of an inline area), splitting
+ * the record that has the free space. Return the offset of the entry, or -1 if
+ * the block has no room for it.
+ */
+static int64_t vardir_add_to_block(char *block, uint32_t block_size, const char *name, a1fs_ino_t ino)
+{
+	uint32_t name_len = (uint32_t) strlen(name);
+	uint32_t needed = A1FS_DIRENT_SIZE(name_len);
+
+	for (uint32_t offset = 0; offset < block_size; offset += dirent_at(block, offset)->rec_len) {
+		a1fs_dirent *dirent = dirent_at(block, offset);
+		uint32_t used = dirent_used(dirent);
+		if (dirent->rec_len - used < needed) {
+			continue;
+		}
+
+		// the new entry takes over the unused tail of the record
+		a1fs_dirent *new_dirent = dirent_at(block, offset + used);
+		new_dirent->rec_len = (uint16_t) (dirent->rec_len - used);
+		if (used != 0) {
+			dirent->rec_len = (uint16_t) used;
+		}
+		new_dirent->ino = ino;
+		new_dirent->name_len = (uint8_t) name_len;
+		memcpy(new_dirent->name, name, name_len + 1);
+		return offset + used;
+	}
+	return -1;
+}
+
+/**
+ * Remove the record at the given offset of a block (or of an inline area).
+ * Return true if the block is left with no entries.
+ */
+static bool vardir_remove_from_block(char *block, uint32_t block_size, uint32_t offset)
+{
+	if (offset == 0) {
+		// the first record of a block can't be merged into anything
+		dirent_at(block, 0)->name_len = 0;
+	} else {
+		uint32_t prev = 0;
+		while (prev + dirent_at(block, prev)->rec_len < offset) {
+			prev += dirent_at(block, prev)->rec_len;
+		}
+		dirent_at(block, prev)->rec_len += dirent_at(block, offset)->rec_len;
+	}
+	return dirent_at(block, 0)->name_len == 0 && dirent_at(block, 0)->rec_len == block_size;
+}
+
+/**
+ * Move the records of an inline directory into its first block. The records
+ * keep their offsets, so their slots don't change.
+ */
+static int vardir_spill_inline(fs_ctx *fs, uint32_t dir_inode_num)
+{
+	a1fs_inode *dir = &fs->inode_table[dir_inode_num];
+	// the first extent takes the place of the inline records
+	char records[A1FS_INLINE_DATA_SIZE];
+	memcpy(records, dir->inline_data, A1FS_INLINE_DATA_SIZE);
+	int ret = grow_dir_by_a_block(fs, dir_inode_num);
+	if (ret != 0) {
+		memcpy(dir->inline_data, records, A1FS_INLINE_DATA_SIZE);
+		return ret;
+	}
+
+	char *block = (char *) get_addr_of_file_block(fs, dir_inode_num, 0);
+	memcpy(block, records, A1FS_INLINE_DATA_SIZE);
+	// the last record now extends to the end of the block
+	uint32_t last = 0;
+	while (last + dirent_at(block, last)->rec_len < A1FS_INLINE_DATA_SIZE) {
+		last += dirent_at(block, last)->rec_len;
+	}
+	dirent_at(block, last)->rec_len += A1FS_BLOCK_SIZE - A1FS_INLINE_DATA_SIZE;
+
+	dir->flags &= ~A1FS_INODE_INLINE_DATA;
+	dir->size = A1FS_BLOCK_SIZE;
+	return 0;
+}
+
+int64_t vardir_add(fs_ctx *fs, uint32_t dir_inode_num, const char *name, a1fs_ino_t ino)
+{
+	a1fs_inode *dir = &fs->inode_table[dir_inode_num];
+
+	// the first entries of a directory are kept in the inode
+	if (dir->size == 0) {
+		vardir_init_block(dir->inline_data, A1FS_INLINE_DATA_SIZE);
+		dir->flags |= A1FS_INODE_INLINE_DATA;
+		dir->size = A1FS_INLINE_DATA_SIZE;
+	}
+	if (dir->flags & A1FS_INODE_INLINE_DATA) {
+		int64_t offset = vardir_add_to_block(dir->inline_data, A1FS_INLINE_DATA_SIZE, name, ino);
+		if (offset >= 0) {
+			return offset;
+		}
+		int ret = vardir_spill_inline(fs, dir_inode_num);
+		if (ret != 0) {
+			return ret;
+		}
+	}
+
+	uint32_t num_blocks = (uint32_t) (dir->size / A1FS_BLOCK_SIZE);
+
+	// an indexed directory only tries its last block, so that an insert
+	// doesn't have to read all the blocks of a large directory
+	uint32_t first_block = 0;
+	if ((dir->flags & A1FS_INODE_DIR_INDEX) && num_blocks > 0) {
+		first_block = num_blocks - 1;
+	}
+	for (uint32_t b = first_block; b < num_blocks; b++) {
+		int64_t offset = vardir_add_to_block((char *) get_addr_of_file_block(fs, dir_inode_num, b),
+		                                     A1FS_BLOCK_SIZE, name, ino);
+		if (offset >= 0) {
+			return b * A1FS_BLOCK_SIZE + offset;
+		}
+	}
+
+	// no room anywhere, so start a new block with a single unused record
+	int ret = grow_dir_by_a_block(fs, dir_inode_num);
+	if (ret != 0) {
+		return ret;
+	}
+	char *block = (char *) get_addr_of_file_block(fs, dir_inode_num, num_blocks);
+	vardir_init_block(block, A1FS_BLOCK_SIZE);
+	dir->size += A1FS_BLOCK_SIZE;
+	return num_blocks * A1FS_BLOCK_SIZE + vardir_add_to_block(block, A1FS_BLOCK_SIZE, name, ino);
+}
+
+void vardir_remove(fs_ctx *fs, uint32_t dir_inode_num, uint32_t slot)
+{
+	a1fs_inode *dir = &fs->inode_table[dir_inode_num];
+
+	if (dir->flags & A1FS_INODE_INLINE_DATA) {
+		if (vardir_remove_from_block(dir->inline_data, A1FS_INLINE_DATA_SIZE, slot)) {
+			dir->flags &= ~A1FS_INODE_INLINE_DATA;
+			dir->size = 0;
+		}
+		return;
+	}
+
+	char *block = (char *) get_addr_of_file_block(fs, dir_inode_num, slot / A1FS_BLOCK_SIZE);
+	vardir_remove_from_block(block, A1FS_BLOCK_SIZE, slot % A1FS_BLOCK_SIZE);
+
+	// free the blocks at the end that are now a single unused record
+	while (dir->size > 0) {
+		a1fs_dirent *first = (a1fs_dirent *) get_addr_of_file_block(fs, dir_inode_num,
+				(uint32_t) (dir->size / A1FS_BLOCK_SIZE) - 1);
+		if (first->name_len != 0 || first->rec_len != A1FS_BLOCK_SIZE) {
+			break;
+		}
+		shrink_dir_by_a_block(fs, dir_inode_num);
+		dir->size -= A1FS_BLOCK_SIZE;
+	}
+}
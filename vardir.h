@@ -0,0 +1,49 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Variable length directory entries header file.
+ *
+ * Used instead of the fixed size a1fs_dentry when the file system has the
+ * A1FS_FEATURE_VARDIR feature. The slot of an entry is its byte offset in the
+ * directory, and the size of a directory is the size of its blocks. A small
+ * directory keeps its records in the inode (A1FS_INODE_INLINE_DATA) until they
+ * no longer fit, and its size is then A1FS_INLINE_DATA_SIZE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "fs_ctx.h"
+
+
+/** Iterate the entries of a directory; see iterate_dentries(). */
+int vardir_iterate(fs_ctx *fs, uint32_t dir_inode_num, uint32_t start, dentry_fn fn, void *arg);
+
+/** Return the record at the given slot of a directory. */
+a1fs_dirent *vardir_get(fs_ctx *fs, uint32_t dir_inode_num, uint32_t slot);
+
+/**
+ * Add a record to a directory, moving an inline directory to its first block or
+ * growing the directory by a block if there is no room for the record.
+ * Return the slot of the new record, or -ENOSPC.
+ */
+int64_t vardir_add(fs_ctx *fs, uint32_t dir_inode_num, const char *name, a1fs_ino_t ino);
+
+/**
+ * Remove the record at the given slot of a directory, and free the blocks at
+ * the end of the directory that no longer hold any records.
+ */
+void vardir_remove(fs_ctx *fs, uint32_t dir_inode_num, uint32_t slot);